@@ -0,0 +1,81 @@
+#ifndef BATCHING_EXECUTOR_H
+#define BATCHING_EXECUTOR_H
+
+#include "neural/multilayer_perceptron.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <future>
+#include <mutex>
+#include <thread>
+
+struct BatchingParameters
+{
+    // Largest batch given to one forward pass
+    size_t maxBatchSize = 32;
+
+    // Longest time a request waits for others to join its batch
+    std::chrono::microseconds maxWaitTime = std::chrono::microseconds(500);
+};
+
+/*
+ * Micro-batching inference.
+ * Callers submit single samples from any thread and get
+ * a future. A dispatcher thread coalesces pending requests
+ * until maxBatchSize are waiting or the oldest one waited
+ * maxWaitTime, then runs one batched forward pass and
+ * completes the futures.
+ * The network must not be trained while the executor runs.
+ */
+class BatchingExecutor
+{
+public:
+    BatchingExecutor(const MultilayerPerceptron &multilayerPerceptron, const BatchingParameters &parameters);
+
+    // Requests already submitted are completed before returning
+    ~BatchingExecutor();
+
+    BatchingExecutor(const BatchingExecutor &) = delete;
+    BatchingExecutor &operator=(const BatchingExecutor &) = delete;
+
+    std::future<LayerOutputs> submit(LayerInputs aInputs);
+
+    // Counters since construction, mean batch size is requests / batches
+    size_t numberOfRequests() const;
+    size_t numberOfBatches() const;
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    struct Request
+    {
+        LayerInputs aInputs;
+        std::promise<LayerOutputs> promise;
+        Clock::time_point submitTime;
+    };
+
+    const MultilayerPerceptron &m_multilayerPerceptron;
+    size_t m_maxBatchSize;
+    std::chrono::microseconds m_maxWaitTime;
+
+    std::thread m_thread;
+    mutable std::mutex m_mutex;
+    std::condition_variable m_condition;
+
+    std::deque<Request> m_aRequests;
+    size_t m_numberOfRequests = 0;
+    size_t m_numberOfBatches = 0;
+    bool m_bStop = false;
+
+    // Used by the dispatcher thread only
+    std::vector<Request> m_aBatch;
+    std::vector<real> m_arBatchInputs;
+    MultilayerPerceptronWorkspace m_workspace;
+
+private:
+    void run();
+    void evaluateBatch();
+};
+
+#endif // BATCHING_EXECUTOR_H
@@ -0,0 +1,72 @@
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+#include "neural/defines.h"
+
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+
+class MultilayerPerceptron;
+
+/*
+ * Everything besides the network needed
+ * to resume Trainer::train where it stopped
+ */
+struct TrainingState
+{
+    unsigned long iterationsIndex = 0;
+    real rError = 0.0;
+    real rPreviousError = 0.0;
+    real rTrainingRate = 0.0;
+};
+
+/*
+ * Writes checkpoints from a background thread.
+ * save() only serialises the network into memory,
+ * disk I/O is done by the writer thread, so training
+ * does not stall. If a checkpoint is still pending when
+ * a new one is saved, the pending one is replaced.
+ * Files are written to a temporary path, then renamed,
+ * so an interrupted write never corrupts the last checkpoint.
+ */
+class Checkpointer
+{
+public:
+    Checkpointer(const std::string &strPath);
+    ~Checkpointer();
+
+    Checkpointer(const Checkpointer &) = delete;
+    Checkpointer &operator=(const Checkpointer &) = delete;
+
+    void save(const MultilayerPerceptron &multilayerPerceptron, const TrainingState &state);
+
+    // Block until every saved checkpoint is on disk
+    void flush();
+
+    // True if any write failed since construction
+    bool failed() const;
+
+    // Restore network and state, both are left untouched on failure
+    static bool load(const std::string &strPath, MultilayerPerceptron &multilayerPerceptron, TrainingState &state);
+
+private:
+    std::string m_strPath;
+
+    std::thread m_thread;
+    mutable std::mutex m_mutex;
+    std::condition_variable m_condition;
+
+    std::string m_strPendingSnapshot;
+    bool m_bPending = false;
+    bool m_bWriting = false;
+    bool m_bStop = false;
+    bool m_bFailed = false;
+
+private:
+    void run();
+    bool writeSnapshot(const std::string &strSnapshot) const;
+};
+
+#endif // CHECKPOINT_H
@@ -0,0 +1,50 @@
+#ifndef COMPILED_MULTILAYER_PERCEPTRON_H
+#define COMPILED_MULTILAYER_PERCEPTRON_H
+
+#include "neural/multilayer_perceptron.h"
+
+/*
+ * Inference-only snapshot of a Multilayer Perceptron.
+ * Consecutive narrow fully connected Layers (at most
+ * s_maxFusedWidth wide) are fused into one kernel: samples are
+ * processed in groups of two SIMD vectors, interleaved (structure
+ * of arrays), so that the lanes are filled whatever the Layer
+ * width, and intermediate values stay in registers and a small
+ * L1-resident tile instead of going through the workspace.
+ * Other Layers use their own forward pass.
+ * The snapshot does not follow later training, compile again.
+ */
+class CompiledMultilayerPerceptron
+{
+public:
+    static const size_t s_maxFusedWidth = 32;
+
+    CompiledMultilayerPerceptron(const MultilayerPerceptron &multilayerPerceptron);
+
+    // Thread-safe, pOutputs holds batchSize x numberOfOutputs values (row-major)
+    void evaluate(const real *pInputs, size_t batchSize, real *pOutputs) const;
+
+    INLINE size_t numberOfInputs() const{return m_aLayers.front().numberOfInputs();}
+    INLINE size_t numberOfOutputs() const{return m_aLayers.back().size();}
+    INLINE size_t numberOfStages() const{return m_aStages.size();}
+
+private:
+    // Layers [begin, end), fused or evaluated one by one
+    struct Stage
+    {
+        size_t begin;
+        size_t end;
+        bool bFused;
+    };
+
+    std::vector<Layer> m_aLayers;
+    std::vector<Stage> m_aStages;
+    LossFunction m_lossFunction;
+
+private:
+    void evaluateLayers(const Stage &stage, const real *pInputs, size_t batchSize, real *pOutputs) const;
+    void evaluateFused(const Stage &stage, const real *pInputs, size_t batchSize, real *pOutputs) const;
+    void evaluateGroup(const Stage &stage, const real *pInputs, size_t numberOfSamples, real *pOutputs) const;
+};
+
+#endif // COMPILED_MULTILAYER_PERCEPTRON_H
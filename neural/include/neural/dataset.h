@@ -1,8 +1,11 @@
 #ifndef DATASET_H
 #define DATASET_H
 
+#include <cstdint>
+#include <fstream>
 #include <string>
 #include "neural/defines.h"
+#include "neural/span.h"
 
 struct DatasetParameters
 {
@@ -24,27 +27,71 @@ struct DatasetParameters
     }
 };
 
+enum class DatasetLayout
+{
+    // Values of a sample are contiguous
+    RowMajor,
+    // Values of an input (or output) are contiguous
+    ColumnMajor
+};
+
+/*
+ * Samples are stored in two contiguous buffers, one for
+ * the inputs and one for the outputs, in the layout of the
+ * Dataset. inputs(i) and outputs(i) are views into them,
+ * strided in column-major layout.
+ */
 class Dataset
 {
 public:
     Dataset();
     Dataset(const std::vector<LayerInputs> &aInputs, const std::vector<LayerOutputs> &aOutputs, const DatasetParameters &parameters = DatasetParameters());
+    // Rows are released as soon as they are copied
+    Dataset(std::vector<LayerInputs> &&aInputs, std::vector<LayerOutputs> &&aOutputs, const DatasetParameters &parameters = DatasetParameters());
+
+    // Buffers already in eLayout, taken over without copying
+    Dataset(size_t numberOfInputs, size_t numberOfOutputs, std::vector<real> &&arInputs, std::vector<real> &&arOutputs,
+        const DatasetParameters &parameters = DatasetParameters(), DatasetLayout eLayout = DatasetLayout::RowMajor);
+    // Buffers already in eLayout, copied once
+    Dataset(size_t numberOfInputs, size_t numberOfOutputs, Span<const real> arInputs, Span<const real> arOutputs,
+        const DatasetParameters &parameters = DatasetParameters(), DatasetLayout eLayout = DatasetLayout::RowMajor);
+
+    INLINE Span<const real> inputs(const size_t i) const{return view(m_arInputs, i, m_numberOfInputs);}
+    INLINE Span<const real> outputs(const size_t i) const{return view(m_arOutputs, i, m_numberOfOutputs);}
+    INLINE size_t size() const{return m_size;}
+    INLINE size_t numberOfInputs() const{return m_numberOfInputs;}
+    INLINE size_t numberOfOutputs() const{return m_numberOfOutputs;}
+
+    // Whole buffers, in the layout of the Dataset
+    INLINE const real *inputsData() const{return m_arInputs.data();}
+    INLINE const real *outputsData() const{return m_arOutputs.data();}
 
-    INLINE const LayerInputs &inputs(const size_t i) const{return m_aInputs[i];}
-    INLINE const LayerOutputs &outputs(const size_t i) const{return m_aOutputs[i];}
-    INLINE size_t size() const{return m_aInputs.size();}
+    INLINE DatasetLayout layout() const{return m_eLayout;}
+    // Transposes the buffers if the layout changes
+    void setLayout(DatasetLayout eLayout);
 
     void normalise();
     void standardise();
 
+    // Row-major Datasets only
     void addData(const LayerInputs &aInputs, const LayerOutputs &aOutputs);
 
     void loadFile(const std::string &strDatasetPath);
     void writeFile(const std::string &strDatasetPath) const;
 
+    // Binary format of DatasetWriter, loaded in row-major layout
+    bool loadBinaryFile(const std::string &strDatasetPath);
+    bool writeBinaryFile(const std::string &strDatasetPath) const;
+
 private:
-    std::vector<LayerInputs> m_aInputs;
-    std::vector<LayerOutputs> m_aOutputs;
+    DatasetLayout m_eLayout = DatasetLayout::RowMajor;
+    size_t m_numberOfInputs = 0;
+    size_t m_numberOfOutputs = 0;
+    size_t m_size = 0;
+
+    // size() x numberOfInputs() and size() x numberOfOutputs()
+    std::vector<real> m_arInputs;
+    std::vector<real> m_arOutputs;
 
     LayerInputs m_inputsMin;
     LayerInputs m_inputsMax;
@@ -55,9 +102,50 @@ private:
     LayerInputs m_inputsStandardDeviation;
     LayerOutputs m_outputsMean;
     LayerOutputs m_outputsStandardDeviation;
-    
+
 private:
+    // Value j of sample i in a buffer of count values per sample
+    INLINE size_t index(size_t i, size_t j, size_t count) const{return m_eLayout == DatasetLayout::RowMajor ? i * count + j : j * m_size + i;}
+    INLINE Span<const real> view(const std::vector<real> &arValues, size_t i, size_t count) const
+    {
+        return m_eLayout == DatasetLayout::RowMajor ? Span<const real>(arValues.data() + i * count, count) : Span<const real>(arValues.data() + i, count, m_size);
+    }
+
+    void setParameters(const DatasetParameters &parameters);
     void computeStatistics();
 };
 
+/*
+ * Streams samples to a binary Dataset file: a header
+ * (size of a real, sizes and number of samples) followed by
+ * the inputs and outputs of each sample, in host byte order.
+ * Files written with another real type are not loaded.
+ * Datasets larger than memory can be written chunk by chunk.
+ */
+class DatasetWriter
+{
+public:
+    DatasetWriter(const std::string &strDatasetPath, size_t numberOfInputs, size_t numberOfOutputs);
+
+    // Closes the file if needed
+    ~DatasetWriter();
+
+    DatasetWriter(const DatasetWriter &) = delete;
+    DatasetWriter &operator=(const DatasetWriter &) = delete;
+
+    // numberOfSamples row-major inputs and outputs
+    bool write(const real *pInputs, const real *pOutputs, size_t numberOfSamples);
+
+    // Writes the final number of samples in the header
+    bool close();
+
+    INLINE size_t numberOfSamples() const{return m_numberOfSamples;}
+
+private:
+    std::ofstream m_file;
+    size_t m_numberOfInputs;
+    size_t m_numberOfOutputs;
+    size_t m_numberOfSamples = 0;
+};
+
 #endif // DATASET_H
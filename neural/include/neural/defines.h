@@ -3,7 +3,7 @@
 
 #ifdef _MSC_VER
     #define INLINE __forceinline
-#elif __GCC__ or __clang__
+#elif defined(__GNUC__) || defined(__clang__)
     #define INLINE inline
 #else
     #define INLINE
@@ -0,0 +1,164 @@
+#ifndef DISTRIBUTED_H
+#define DISTRIBUTED_H
+
+#include "neural/span.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+
+class MultilayerPerceptron;
+
+enum class DistributedTransport
+{
+    Tcp,
+    UnixDomain
+};
+
+struct DistributedParameters
+{
+    // This worker, among numberOfWorkers processes
+    size_t rank = 0;
+    size_t numberOfWorkers = 1;
+
+    DistributedTransport eTransport = DistributedTransport::Tcp;
+    // Tcp: worker r listens on strHost, port basePort + r (IPv4)
+    std::string strHost = "127.0.0.1";
+    uint16_t basePort = 29500;
+    // UnixDomain: worker r listens on strSocketPath.r
+    std::string strSocketPath = "/tmp/neural_ring";
+
+    // Gradient steps between two averagings
+    size_t averagingInterval = 16;
+
+    // Longest wait for the other workers, to connect and in a reduction
+    std::chrono::milliseconds timeout = std::chrono::milliseconds(30000);
+};
+
+/*
+ * Worker processes connected in a ring: each one sends to the
+ * next and receives from the previous. allReduce sums a buffer
+ * over the workers in 2 (N - 1) steps of 1 / N of the buffer
+ * (reduce-scatter, then all-gather), so that every link carries
+ * the same traffic whatever the number of workers, and every
+ * worker ends with bitwise identical sums.
+ * Sending and receiving are interleaved (poll), so that large
+ * chunks cannot deadlock on full socket buffers.
+ * Linux only, connect fails on other systems.
+ */
+class RingAllReduce
+{
+public:
+    RingAllReduce(const DistributedParameters &parameters);
+    ~RingAllReduce();
+
+    RingAllReduce(const RingAllReduce &) = delete;
+    RingAllReduce &operator=(const RingAllReduce &) = delete;
+
+    // Blocks until the neighbours are connected, or the timeout
+    bool connect();
+    void close();
+
+    // Every worker calls it with the same number of values
+    bool allReduce(Span<real> arValues);
+
+    INLINE size_t rank() const{return m_rank;}
+    INLINE size_t numberOfWorkers() const{return m_numberOfWorkers;}
+
+private:
+    size_t m_rank;
+    size_t m_numberOfWorkers;
+    DistributedTransport m_eTransport;
+    std::string m_strHost;
+    uint16_t m_basePort;
+    std::string m_strSocketPath;
+    std::chrono::milliseconds m_timeout;
+
+    int m_listenSocket = -1;
+    int m_nextSocket = -1;
+    int m_previousSocket = -1;
+
+    // Chunk received in the reduce-scatter steps
+    std::vector<real> m_arReceived;
+
+private:
+    int listen() const;
+    int connectTo(size_t rank) const;
+    bool exchange(const real *pSend, size_t sendCount, real *pReceive, size_t receiveCount);
+};
+
+/*
+ * Data-parallel training over several processes (see Trainer::setParameterAverager).
+ * Each worker trains on its own shard of the samples, and the
+ * weights are averaged every averagingInterval gradient steps.
+ * The averaging overlaps the computation: the weights are
+ * snapshot and reduced by a background thread while training
+ * goes on, the average is applied at the next averaging with
+ * the local progress made meanwhile, w = mean + (w - snapshot).
+ * synchronise blocks until the networks are equal on every worker.
+ * The momentum state stays local.
+ * On a communication failure averaging stops, failed() is set
+ * and every worker goes on training alone.
+ */
+class ParameterAverager
+{
+public:
+    ParameterAverager(const DistributedParameters &parameters);
+    ~ParameterAverager();
+
+    ParameterAverager(const ParameterAverager &) = delete;
+    ParameterAverager &operator=(const ParameterAverager &) = delete;
+
+    bool connect();
+
+    // Samples [begin, end) of [0, count) trained by this worker,
+    // the shard sizes differ by one sample at most (count / numberOfWorkers
+    // samples for the smallest one)
+    void shard(size_t count, size_t &begin, size_t &end) const;
+
+    // Weights (and arValues, same size on every worker) of worker 0 copied to every worker
+    bool broadcast(MultilayerPerceptron &multilayerPerceptron);
+    bool broadcast(MultilayerPerceptron &multilayerPerceptron, std::vector<real> &arValues);
+
+    // After each gradient step
+    void step(MultilayerPerceptron &multilayerPerceptron);
+
+    bool synchronise(MultilayerPerceptron &multilayerPerceptron);
+
+    // True until connected, and after a failed reduction
+    bool failed() const;
+
+    INLINE size_t rank() const{return m_ring.rank();}
+    INLINE size_t numberOfWorkers() const{return m_ring.numberOfWorkers();}
+
+private:
+    RingAllReduce m_ring;
+    size_t m_averagingInterval;
+    size_t m_step = 0;
+
+    // Weights sent, their sum over the workers once reduced
+    std::vector<real> m_arSnapshot;
+    std::vector<real> m_arReduced;
+    std::vector<real> m_arCurrent;
+    bool m_bInFlight = false;
+
+    std::thread m_thread;
+    mutable std::mutex m_mutex;
+    std::condition_variable m_condition;
+
+    bool m_bPending = false;
+    bool m_bReducing = false;
+    bool m_bStop = false;
+    bool m_bFailed = false;
+
+private:
+    void run();
+    void startReduction();
+    bool waitReduction();
+    void applyReduction(MultilayerPerceptron &multilayerPerceptron);
+};
+
+#endif // DISTRIBUTED_H
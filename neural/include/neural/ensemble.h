@@ -0,0 +1,87 @@
+#ifndef ENSEMBLE_H
+#define ENSEMBLE_H
+
+#include "neural/multilayer_perceptron.h"
+
+struct TrainingParameters;
+class Dataset;
+
+enum class EnsembleAggregation
+{
+    Mean,
+    // Weighted by arWeights (one per model)
+    WeightedMean,
+    // Each model votes for its largest output, outputs are the
+    // fractions of the votes (classification)
+    Vote
+};
+
+struct EnsembleParameters
+{
+    EnsembleAggregation eAggregation = EnsembleAggregation::Mean;
+    std::vector<real> arWeights;
+};
+
+/*
+ * Models with the same inputs and outputs evaluated together.
+ * Their fully connected first Layers are stacked into one weight
+ * matrix, so that a single matrix product computes all of them,
+ * the other Layers are evaluated model by model, in parallel.
+ * The stacked weights are a copy: call update after changing
+ * the models directly (train does it).
+ */
+class Ensemble
+{
+public:
+    Ensemble(std::vector<MultilayerPerceptron> aModels, const EnsembleParameters &parameters = EnsembleParameters());
+
+    // Aggregated outputs, batchSize x numberOfOutputs (row-major)
+    const LayerOutputs &evaluate(const real *pInputs, size_t batchSize);
+
+    // Outputs of model k in the last evaluate
+    INLINE const LayerOutputs &modelOutputs(size_t k) const{return m_aaModelOutputs[k];}
+
+    /*
+     * Train every model on the shared (already scaled) Dataset,
+     * in parallel over the global ThreadPool. Model k shuffles
+     * with shuffleSeed + k, so that the models see different orders,
+     * and checkpoints to strCheckpointPath.k (resumed from there).
+     */
+    void train(const TrainingParameters &parameters, const Dataset &dataset);
+
+    // Evaluation error of model k at the end of the last train
+    INLINE real error(size_t k) const{return m_arErrors[k];}
+
+    // Copy the first Layers of the models into the stacked weights
+    void update();
+
+    INLINE size_t size() const{return m_aModels.size();}
+    INLINE MultilayerPerceptron &model(size_t k){return m_aModels[k];}
+    INLINE size_t numberOfInputs() const{return m_aModels.front().numberOfInputs();}
+    INLINE size_t numberOfOutputs() const{return m_aModels.front().numberOfOutputs();}
+
+private:
+    std::vector<MultilayerPerceptron> m_aModels;
+    EnsembleAggregation m_eAggregation;
+    std::vector<real> m_arWeights;
+    std::vector<real> m_arErrors;
+
+    // First Layers of the models, one row per Perceptron,
+    // model k starting at row m_aStackedOffsets[k]
+    bool m_bStacked = false;
+    std::vector<real> m_arStackedWeights;
+    std::vector<size_t> m_aStackedOffsets;
+
+    // Buffers of the last evaluate, one per model for the others
+    std::vector<real> m_arStackedActivations;
+    std::vector<LayerOutputs> m_aaModelOutputs;
+    std::vector<std::vector<real>> m_aarActivations;
+    std::vector<std::vector<real>> m_aarLayerInputs;
+    LayerOutputs m_arOutputs;
+
+private:
+    void evaluateModel(size_t k, const real *pInputs, size_t batchSize);
+    void aggregate(size_t batchSize);
+};
+
+#endif // ENSEMBLE_H
@@ -0,0 +1,27 @@
+#ifndef GEMM_H
+#define GEMM_H
+
+#include "neural/defines.h"
+
+#include <cstddef>
+
+enum class Transpose
+{
+    No,
+    Yes
+};
+
+/*
+ * General matrix product on row-major matrices:
+ * C = rAlpha * op(A) * op(B) + rBeta * C
+ * with op(A) of size m x k, op(B) of size k x n and C of size m x n.
+ * lda, ldb and ldc are the row strides of the stored matrices.
+ * When rBeta is 0, C is not read.
+ */
+void gemm(Transpose eTransposeA, Transpose eTransposeB,
+    size_t m, size_t n, size_t k,
+    real rAlpha, const real *pA, size_t lda,
+    const real *pB, size_t ldb,
+    real rBeta, real *pC, size_t ldc);
+
+#endif // GEMM_H
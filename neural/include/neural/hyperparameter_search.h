@@ -0,0 +1,118 @@
+#ifndef HYPERPARAMETER_SEARCH_H
+#define HYPERPARAMETER_SEARCH_H
+
+#include "neural/multilayer_perceptron.h"
+
+class Dataset;
+
+enum class SearchStrategy
+{
+    // Every combination of the candidates
+    Grid,
+    // numberOfTrials random combinations
+    Random,
+    // numberOfTrials random combinations, the best 1 / uiReductionFactor
+    // of them are kept after each rung while the budget grows
+    SuccessiveHalving,
+    // Successive halving brackets trading number of trials for budget
+    Hyperband
+};
+
+/*
+ * Candidates of the search.
+ * Grid search tries every combination. Random searches pick
+ * topologies and activation functions among the candidates, and
+ * draw learning rate (log-uniform) and momentum (uniform) between
+ * the smallest and largest candidates.
+ */
+struct HyperparameterSpace
+{
+    // Hidden Layer sizes, the output Layer is sized from the Dataset
+    std::vector<std::vector<size_t>> aaHiddenLayerSizes = {{5, 5}};
+    std::vector<ActivationFunctionType> aActivationFunctionTypes = {ActivationFunctionType::HyperbolicTangent};
+    std::vector<real> arLearningRates = {0.1};
+    std::vector<real> arMomentums = {0.01};
+};
+
+struct HyperparameterSearchParameters
+{
+    SearchStrategy eStrategy = SearchStrategy::Random;
+
+    // Random and successive halving only
+    size_t numberOfTrials = 16;
+
+    // Training budget of a trial in epochs
+    unsigned int uiMaxEpochs = 100;
+
+    // Epochs between two early termination decisions (Grid and Random),
+    // first rung budget (SuccessiveHalving and Hyperband)
+    unsigned int uiMinEpochs = 5;
+    unsigned int uiReductionFactor = 3;
+
+    real rCrossValidationEvaluationPercent = 0.8;
+    size_t batchSize = 1;
+
+    // Trials trained concurrently, 0 uses the number of hardware threads
+    size_t numberOfThreads = 0;
+
+    // Sampling of the trials and initial weights of their networks,
+    // the same seed gives the same trials and rankings
+    unsigned int uiSeed = 0;
+};
+
+struct HyperparameterTrial
+{
+    std::vector<size_t> aHiddenLayerSizes;
+    PerceptronParameters perceptronParameters;
+
+    real rError = 0.0;
+    unsigned int uiEpochs = 0;
+    // True if training was stopped before uiMaxEpochs
+    bool bTerminated = false;
+
+    // Key of the initial weights, uiSeed mixed with the trial (and bracket) index
+    uint64_t seed = 0;
+
+    MultilayerPerceptronParameters multilayerPerceptronParameters(size_t numberOfInputs, size_t numberOfOutputs) const;
+};
+
+/*
+ * Hyperparameter and topology search.
+ * Trials are trained concurrently on a ThreadPool, all of them
+ * reading the same Dataset. The Dataset is not scaled by the
+ * search, normalise or standardise it beforehand.
+ * With Grid and Random strategies, a trial is terminated when its
+ * error after some epochs is worse than the median error of the
+ * other trials after the same epochs (median stopping rule).
+ */
+class HyperparameterSearch
+{
+public:
+    HyperparameterSearch(const HyperparameterSearchParameters &parameters);
+
+    // Every trial, best first
+    std::vector<HyperparameterTrial> run(const HyperparameterSpace &space, const Dataset &dataset);
+
+private:
+    SearchStrategy m_eStrategy;
+    size_t m_numberOfTrials;
+    unsigned int m_uiMaxEpochs;
+    unsigned int m_uiMinEpochs;
+    unsigned int m_uiReductionFactor;
+    real m_rCrossValidationEvaluationPercent;
+    size_t m_batchSize;
+    size_t m_numberOfThreads;
+    unsigned int m_uiSeed;
+
+private:
+    std::vector<HyperparameterTrial> gridTrials(const HyperparameterSpace &space) const;
+    std::vector<HyperparameterTrial> randomTrials(const HyperparameterSpace &space, size_t numberOfTrials, unsigned int uiSeed) const;
+
+    void runMedianStopping(std::vector<HyperparameterTrial> &aTrials, const Dataset &dataset) const;
+    void runSuccessiveHalving(std::vector<HyperparameterTrial> &aTrials, unsigned int uiMinEpochs, const Dataset &dataset) const;
+
+    void trainTrial(HyperparameterTrial &trial, MultilayerPerceptron &multilayerPerceptron,
+        unsigned int uiEpochs, const Dataset &dataset) const;
+};
+
+#endif // HYPERPARAMETER_SEARCH_H
@@ -2,29 +2,335 @@
 #define LAYER_H
 
 #include "neural/perceptron.h"
+#include "neural/random.h"
+#include "neural/span.h"
+
+#include <cstdint>
+#include <iosfwd>
+
+enum class WeightInitialisation
+{
+    // Matched to the activation function: He for ReLU,
+    // Xavier uniform for hyperbolic tangent, LeCun for linear
+    Automatic,
+    // Uniform in +-sqrt(6 / (fan in + 1)), the historical rule
+    Uniform,
+    // Glorot & Bengio, variance 2 / (fan in + fan out)
+    XavierUniform,
+    XavierNormal,
+    // Normal, variance 2 / fan in
+    He,
+    // Normal, variance 1 / fan in
+    LeCun,
+    // Orthonormal rows (or columns) scaled by the activation gain
+    Orthogonal
+};
+
+enum class LayerType
+{
+    // Matrix product with every input
+    FullyConnected,
+    // 2D convolution of images, one filter per output channel
+    Convolution,
+    // Maximum or mean of each window, channel by channel
+    MaxPooling,
+    AveragePooling,
+    // Ends a run of image Layers, images are already stored as rows
+    Flatten,
+    // Cell stepped over the timesteps of sequences
+    Recurrent
+};
+
+enum class RecurrentCell
+{
+    // h = f(W x + U h' + b), f is the activation function of the Layer
+    Elman,
+    // Gated recurrent unit, reset gate applied after the recurrent product
+    GatedRecurrentUnit,
+    // Long short-term memory, forget gate biases start at 1
+    LongShortTermMemory
+};
+
+/*
+ * Images going through convolution and pooling Layers are
+ * stored as one row of height x width x channels values per
+ * sample, channel fastest (HWC)
+ */
+struct ImageShape
+{
+    size_t height = 0;
+    size_t width = 0;
+    size_t channels = 0;
+
+    INLINE size_t size() const{return height * width * channels;}
+};
+
+/*
+ * Convolution and pooling Layers, layerSize is ignored.
+ * inputShape is taken from the previous Layer when it is
+ * a convolution or pooling one. Pooling keeps the channels,
+ * ignores the activation function and has no padding.
+ */
+struct ConvolutionParameters
+{
+    ImageShape inputShape;
+    size_t outputChannels = 0;
+    // Square kernel or pooling window
+    size_t kernelSize = 3;
+    size_t stride = 1;
+    // Zeros around the input images
+    size_t padding = 0;
+};
+
+/*
+ * Recurrent Layers, layerSize is the size of the hidden state.
+ * Input rows hold sequenceLength timesteps of numberOfInputs /
+ * sequenceLength values each, oldest first (0 takes the length
+ * of the previous recurrent Layer). Outputs are the hidden
+ * states of every timestep with bReturnSequences, of the last
+ * one otherwise. Gated cells use sigmoid gates and hyperbolic
+ * tangents, the activation function only applies to Elman cells.
+ * Biases are learnt (rBias is ignored), no dropout.
+ */
+struct RecurrentParameters
+{
+    RecurrentCell eRecurrentCell = RecurrentCell::Elman;
+    size_t sequenceLength = 0;
+    bool bReturnSequences = false;
+    // Truncated backpropagation through time, see Layer::setBackpropagationSteps
+    size_t backpropagationSteps = 0;
+};
 
 struct LayerParameters
 {
     size_t layerSize;
     PerceptronParameters perceptronParameters;
+
+    // Probability to drop each output while training,
+    // ignored on the output Layer
+    real rDropoutRate = 0.0;
+
+    WeightInitialisation eWeightInitialisation = WeightInitialisation::Automatic;
+
+    LayerType eLayerType = LayerType::FullyConnected;
+
+    // Read for the matching LayerType only
+    ConvolutionParameters convolution;
+    RecurrentParameters recurrent;
+
+    // Key of the weights and dropout streams, unset takes the stream
+    // of the network split by Layer index (e_uiSeed++ for a lone Layer)
+    uint64_t seed = RandomStream::s_unsetSeed;
 };
 
+/*
+ * Fully connected layer.
+ * Weights of all the Perceptrons are stored in one
+ * contiguous row-major buffer (one row per Perceptron),
+ * so that a batch of samples is processed with
+ * matrix products. Batches are row-major too
+ * (one row per sample).
+ * Convolution, pooling and flatten Layers (see LayerType)
+ * share the same batched interface on HWC image rows.
+ * Recurrent Layers take the input projections of every
+ * timestep of the batch in one matrix product, and only
+ * step the recurrent product in time. Their activations
+ * buffer keeps the cell states of every timestep for
+ * backpropagation through time (see activationsSize).
+ */
 class Layer
 {
 public:
+    // Random numbers come from a stream keyed by parameters.seed
     Layer(const size_t &previousLayerSize, const LayerParameters &parameters);
+    Layer(const size_t &previousLayerSize, const LayerParameters &parameters, const RandomStream &randomStream);
 
     void evaluate(const LayerInputs &aInputs, LayerOutputs &aOutputs) const;
 
-    void train(const LayerInputs &aInputs, const LayerOutputs &aTargetOutputs, LayerErrors &aErrors);
-    void train(const LayerInputs &aInputs, const LayerErrors &aNextLayerErrors, LayerErrors &aErrors);
+    /*
+     * Batched passes
+     * forward writes weighted sums in pActivations and
+     * activated values in pOutputs (can be the same buffer).
+     * backward takes dE/dOutputs in pDeltas, turns them into
+     * dE/dActivations, writes dE/dInputs in pInputDeltas (if not null)
+     * and computes the gradient applied by update.
+     * With a dropout rate, training passes give forward a
+     * pDropoutMask buffer, filled with the inverted dropout
+     * scales (0 or 1 / (1 - rate)) drawn for step, and
+     * fused with the activation. backward applies the same
+     * mask to the deltas. Inference passes no mask.
+     * update fuses L1/L2 weight decay with the momentum step.
+     */
+    void forward(const real *pInputs, size_t batchSize, real *pActivations, real *pOutputs,
+        real *pDropoutMask = nullptr, uint64_t step = 0) const;
+    void backward(const real *pInputs, const real *pActivations, real *pDeltas, real *pInputDeltas, size_t batchSize,
+        const real *pDropoutMask = nullptr);
+    void update();
 
-    INLINE size_t size() const{return m_aPerceptrons.size();}
+    /*
+     * Hogwild! step on one sample: backward pass and
+     * rank one update applied directly to the shared weights.
+     * Concurrent calls race on the weights and momentum on
+     * purpose: no lock nor atomic is taken, a thread may read
+     * weights being written by another one and an update may
+     * be lost, which stochastic gradient descent tolerates.
+     * Only the weights of non-zero inputs are touched, so that
+     * threads working on sparse samples rarely collide.
+     * Other Layer types compute the gradient of the sample into
+     * a buffer of the calling thread, then apply it in place
+     * the same way (the shared gradient buffer is not used).
+     * Aligned real loads/stores are not torn on the supported
+     * targets (x86-64, ARM64).
+     * Dropout is not applied in this mode.
+     */
+    void trainAsynchronous(const real *pInputs, const real *pActivations, real *pDeltas, real *pInputDeltas);
+
+    INLINE LayerType layerType() const{return m_eLayerType;}
+    INLINE size_t size() const{return m_size;}
+    INLINE size_t numberOfInputs() const{return m_numberOfInputs;}
     INLINE ActivationFunctionType activationFunctionType() const{return m_eActivationFunctionType;}
+    INLINE real learningRate() const{return m_rLearningRate;}
+    INLINE real bias() const{return m_rBias;}
+    INLINE real dropoutRate() const{return m_rDropoutRate;}
+
+    // Values per sample of the activations buffer of forward and backward
+    INLINE size_t activationsSize() const{return m_eLayerType == LayerType::Recurrent ? m_recurrent.sequenceLength * stateSize() : m_size;}
+
+    // Convolution or pooling Layer
+    INLINE bool spatial() const{return m_eLayerType != LayerType::FullyConnected && m_eLayerType != LayerType::Flatten;}
+    INLINE const ImageShape &inputShape() const{return m_convolution.inputShape;}
+    INLINE const ImageShape &outputShape() const{return m_convolution.outputShape;}
+    INLINE size_t kernelSize() const{return m_convolution.kernelSize;}
+    INLINE size_t stride() const{return m_convolution.stride;}
+    INLINE size_t padding() const{return m_convolution.padding;}
+
+    INLINE RecurrentCell recurrentCell() const{return m_recurrent.eRecurrentCell;}
+    INLINE size_t sequenceLength() const{return m_recurrent.sequenceLength;}
+    INLINE size_t hiddenSize() const{return m_recurrent.hiddenSize;}
+    INLINE bool returnSequences() const{return m_recurrent.bReturnSequences;}
+    INLINE size_t backpropagationSteps() const{return m_recurrent.backpropagationSteps;}
+
+    /*
+     * Truncated backpropagation through time: dE/dh is not carried
+     * across blocks of backpropagationSteps timesteps, counted from
+     * the end of the sequence. Without bReturnSequences only the
+     * last block is backpropagated. 0 covers the whole sequence.
+     */
+    void setBackpropagationSteps(size_t backpropagationSteps);
+
+    real gradientSquaredNorm() const;
+
+    /*
+     * Magnitude pruning: weights with an absolute value
+     * below rThreshold are set to zero and stay zero in
+     * later training. When few enough weights are left,
+     * forward switches to a CSR copy of the weights.
+     */
+    void prune(real rThreshold);
+    INLINE bool pruned() const{return m_arPruningMask.empty() == false;}
+    INLINE bool sparse() const{return m_aSparseRowOffsets.empty() == false;}
+    real density() const;
+
+    /*
+     * Views of the weights and of the momentum state (saved
+     * derivatives of the last update), one row per Perceptron.
+     * The bias is a constant of the Layer, see bias().
+     */
+    INLINE const LayerWeights &weights() const{return m_aWeights;}
+    INLINE Span<const real> weightValues() const{return m_aWeights;}
+    INLINE Span<const real> savedDerivatives() const{return m_arSavedDerivatives;}
+
+    // Copy weights().size() values, pruned weights stay zero
+    void setWeights(const real *pWeights);
+    void setSavedDerivatives(const real *pSavedDerivatives);
+
+    void write(std::ostream &stream) const;
+    bool read(std::istream &stream);
 
 private:
+    LayerType m_eLayerType;
     ActivationFunctionType m_eActivationFunctionType;
-    std::vector<Perceptron> m_aPerceptrons;
+    ActivationFunctionPtr m_pfActivationFunctionPtr = nullptr;
+    ActivationDerivativePtr m_pfActivationDerivativePtr = nullptr;
+
+    size_t m_numberOfInputs;
+    size_t m_size;
+
+    // Convolution and pooling Layers only, see layer_convolution.cpp
+    struct ConvolutionState
+    {
+        ImageShape inputShape;
+        ImageShape outputShape;
+        size_t kernelSize = 0;
+        size_t stride = 0;
+        size_t padding = 0;
+    } m_convolution;
+
+    // Recurrent Layers only, see layer_recurrent.cpp
+    struct RecurrentState
+    {
+        RecurrentCell eRecurrentCell = RecurrentCell::Elman;
+        size_t sequenceLength = 0;
+        size_t hiddenSize = 0;
+        bool bReturnSequences = false;
+        size_t backpropagationSteps = 0;
+    } m_recurrent;
+
+    // size() x numberOfInputs(), or for a convolution
+    // kernel y x kernel x x input channels x output channels,
+    // or for a recurrent Layer one row per gate unit
+    // (gates x hidden size) of input weights, recurrent
+    // weights and bias, empty for pooling and flatten Layers
+    LayerWeights m_aWeights;
+    std::vector<real> m_arGradients;
+    std::vector<real> m_arSavedDerivatives;
+
+    real m_rLearningRate;
+    real m_rBias;
+    real m_rMomentum;
+    real m_rL1;
+    real m_rL2;
+
+    real m_rDropoutRate;
+    // Key of the dropout streams, split per training step
+    uint64_t m_dropoutSeed = 0;
+
+    // 1 for kept weights, 0 for pruned ones, empty if not pruned
+    std::vector<real> m_arPruningMask;
+
+    // CSR copy of the kept weights, empty if dense
+    std::vector<real> m_arSparseValues;
+    std::vector<uint32_t> m_aSparseColumns;
+    std::vector<uint32_t> m_aSparseRowOffsets;
+
+private:
+    void activate(real *pActivations, real *pOutputs, size_t count, real *pDropoutMask, uint64_t step) const;
+
+    // backward with the gradient written to pGradients (weights().size() values)
+    void backward(const real *pInputs, const real *pActivations, real *pDeltas, real *pInputDeltas, size_t batchSize,
+        const real *pDropoutMask, real *pGradients);
+
+    // Type-specific setup of the constructor, return the number of weights
+    size_t initializeConvolution(const ConvolutionParameters &parameters);
+    size_t initializeRecurrent(const RecurrentParameters &parameters);
+
+    void convolutionForward(const real *pInputs, size_t batchSize, real *pActivations) const;
+    void convolutionBackward(const real *pInputs, const real *pDeltas, real *pInputDeltas, size_t batchSize, real *pGradients);
+    void poolingForward(const real *pInputs, size_t batchSize, real *pOutputs) const;
+    void poolingBackward(const real *pInputs, const real *pDeltas, real *pInputDeltas, size_t batchSize) const;
+    void recurrentForward(const real *pInputs, size_t batchSize, real *pStates, real *pOutputs) const;
+    void recurrentBackward(const real *pInputs, const real *pStates, const real *pDeltas, real *pInputDeltas, size_t batchSize,
+        real *pGradients);
+
+    // Recurrent Layers: gates per hidden unit, and values per
+    // sample and timestep of the activations buffer
+    INLINE size_t numberOfGates() const{return m_recurrent.eRecurrentCell == RecurrentCell::Elman ? 1 : (m_recurrent.eRecurrentCell == RecurrentCell::GatedRecurrentUnit ? 3 : 4);}
+    INLINE size_t stateSize() const{return (m_recurrent.eRecurrentCell == RecurrentCell::Elman ? 2 : (m_recurrent.eRecurrentCell == RecurrentCell::GatedRecurrentUnit ? 5 : 6)) * m_recurrent.hiddenSize;}
+
+    void initializeRandomWeights(WeightInitialisation eWeightInitialisation, RandomStream randomStream);
+    void orthogonaliseWeights(size_t numberOfRows, size_t numberOfColumns);
+    void buildSparseWeights();
+    void updateSparseWeights();
 };
 
 #endif // LAYER_H
@@ -0,0 +1,57 @@
+#ifndef LOSS_FUNCTION_H
+#define LOSS_FUNCTION_H
+
+#include "neural/defines.h"
+
+#include <cstddef>
+
+enum class LossFunctionType
+{
+    // 1/2 (y - t)^2 per output
+    MeanSquaredError,
+    // |y - t| per output
+    MeanAbsoluteError,
+    // Squared below rHuberDelta, absolute above
+    Huber,
+    /*
+     * Cross-entropy fused with the output activation: the output
+     * Layer must be Linear, its outputs (logits) go through a
+     * softmax over the sample (targets are a distribution, one-hot
+     * for classes) or a sigmoid per output (independent binary targets)
+     */
+    SoftmaxCrossEntropy,
+    SigmoidCrossEntropy
+};
+
+/*
+ * Loss of row-major batches of outputs (one row per sample),
+ * computed over the whole batch in one pass.
+ * The gradient of a fused cross-entropy is taken with respect
+ * to the logits, p - t, so that the Jacobian of the softmax
+ * is never formed.
+ */
+class LossFunction
+{
+public:
+    LossFunction(LossFunctionType eLossFunctionType = LossFunctionType::MeanSquaredError, real rHuberDelta = 1.0);
+
+    INLINE LossFunctionType type() const{return m_eLossFunctionType;}
+    INLINE bool fused() const{return m_eLossFunctionType == LossFunctionType::SoftmaxCrossEntropy || m_eLossFunctionType == LossFunctionType::SigmoidCrossEntropy;}
+
+    // Logits to probabilities in place, nothing if not fused
+    void transform(real *pOutputs, size_t batchSize, size_t numberOfOutputs) const;
+
+    /*
+     * Sum of the sample losses of the (transformed) outputs.
+     * If pDeltas is not null, it receives the derivatives
+     * of the loss with respect to the outputs (logits if fused).
+     */
+    real evaluate(const real *pOutputs, const real *pTargetOutputs, size_t batchSize, size_t numberOfOutputs,
+        real *pDeltas = nullptr) const;
+
+private:
+    LossFunctionType m_eLossFunctionType;
+    real m_rHuberDelta;
+};
+
+#endif // LOSS_FUNCTION_H
@@ -2,11 +2,57 @@
 #define MULTILAYER_PERCEPTRON_H
 
 #include "neural/layer.h"
+#include "neural/loss_function.h"
+
+class Profiler;
+class Telemetry;
 
 struct MultilayerPerceptronParameters
 {
     size_t numberOfInputs;
     std::vector<LayerParameters> aLayerParameters;
+
+    // Gradient checkpointing: keep the outputs of every
+    // checkpointInterval-th Layer only, and recompute the others
+    // during backpropagation. 0 or 1 keeps every Layer.
+    size_t checkpointInterval = 0;
+
+    // Loss minimised by train (and measured by the Trainer),
+    // a fused cross-entropy needs a Linear output Layer
+    LossFunctionType eLossFunctionType = LossFunctionType::MeanSquaredError;
+    real rHuberDelta = 1.0;
+
+    // Key of the random streams of the Layers (split by
+    // Layer index), unset takes e_uiSeed++ (not thread-safe)
+    uint64_t seed = RandomStream::s_unsetSeed;
+};
+
+/*
+ * Buffers of the forward and backward passes, in batchSize x Layer size blocks.
+ * Layers are grouped in segments of checkpointInterval Layers.
+ * Only the outputs of the last Layer of each segment are kept
+ * for the whole pass, the other buffers are shared by the Layers
+ * at the same position in different segments.
+ * Concurrent passes need one workspace per thread, and a workspace
+ * is only laid out again when the batch size changes, so it must
+ * not be shared by networks of different shapes.
+ */
+struct MultilayerPerceptronWorkspace
+{
+    size_t checkpointInterval = 0;
+    // Samples the buffers are laid out for, 0 before the first pass
+    size_t batchSize = 0;
+
+    // One per Layer, empty except at the end of the segments
+    std::vector<LayerOutputs> aCheckpoints;
+
+    // One per Layer of a segment
+    std::vector<LayerOutputs> aActivations;
+    std::vector<LayerOutputs> aOutputs;
+    std::vector<LayerOutputs> aDropoutMasks;
+
+    // Current and previous Layer
+    std::vector<LayerOutputs> aDeltas;
 };
 
 class MultilayerPerceptron
@@ -15,15 +61,97 @@ public:
     MultilayerPerceptron(const MultilayerPerceptronParameters &parameters);
 
     const LayerOutputs &evaluate(const LayerInputs &aInputs);
-    void train(const LayerInputs &aInputs, const LayerOutputs &aTargetOuputs);
+    real train(const LayerInputs &aInputs, const LayerOutputs &aTargetOuputs);
+
+    /*
+     * Batched versions, inputs, targets and returned
+     * outputs are row-major (one row per sample).
+     * train does one gradient step on the mean gradient
+     * of the batch and returns the sum of the sample losses.
+     * Outputs of a fused cross-entropy are probabilities.
+     */
+    const LayerOutputs &evaluate(const real *pInputs, size_t batchSize);
+    real train(const real *pInputs, const real *pTargetOutputs, size_t batchSize);
+
+    // Thread-safe evaluation on a caller provided workspace
+    const LayerOutputs &evaluate(const real *pInputs, size_t batchSize, MultilayerPerceptronWorkspace &workspace) const;
+
+    /*
+     * Hogwild! step on one sample: gradients are applied
+     * to the shared weights as soon as they are computed,
+     * without any lock. Meant to be called concurrently,
+     * each thread with its own workspace (see Layer::trainAsynchronous).
+     */
+    real trainAsynchronous(const real *pInputs, const real *pTargetOutputs, MultilayerPerceptronWorkspace &workspace);
+
+    const Layer &layer(const size_t &i) const;
+    Layer &layer(const size_t &i);
+    INLINE size_t numberOfLayers() const{return m_aLayers.size();}
 
-    Layer layer(const size_t &i) const;
+    /*
+     * All the weights as one flat buffer, Layer after Layer
+     * (row-major, see Layer::weights), followed by the saved
+     * derivatives of every Layer in the same order if
+     * bOptimizerState. Nothing is allocated, the buffer
+     * must hold numberOfParameters values.
+     */
+    size_t numberOfParameters(bool bOptimizerState = false) const;
+    void exportParameters(Span<real> arParameters, bool bOptimizerState = false) const;
+    void importParameters(Span<const real> arParameters, bool bOptimizerState = false);
+
+    real gradientSquaredNorm() const;
+    INLINE real learningRate() const{return m_aLayers.front().learningRate();}
+    INLINE size_t numberOfInputs() const{return m_numberOfInputs;}
+    INLINE size_t numberOfOutputs() const{return m_aLayers.back().size();}
+    INLINE const LossFunction &lossFunction() const{return m_lossFunction;}
+
+    // Binary state of every Layer
+    void write(std::ostream &stream) const;
+    bool read(std::istream &stream);
+
+    INLINE void setTelemetry(Telemetry *pTelemetry){m_pTelemetry = pTelemetry;}
+
+    // Per Layer profile of train and evaluate (not of the thread-safe overloads)
+    INLINE void setProfiler(Profiler *pProfiler){m_pProfiler = pProfiler;}
+
+    // Truncation of every recurrent Layer, see Layer::setBackpropagationSteps
+    void setBackpropagationSteps(size_t backpropagationSteps);
+
+    // Takes effect on the next pass, see MultilayerPerceptronParameters
+    void setCheckpointInterval(size_t checkpointInterval);
+    INLINE size_t checkpointInterval() const{return m_checkpointInterval;}
+
+    // Largest size of the internal workspace since construction
+    INLINE size_t peakWorkspaceBytes() const{return m_peakWorkspaceBytes;}
+    static size_t workspaceBytes(const MultilayerPerceptronWorkspace &workspace);
 
 private:
     std::vector<Layer> m_aLayers;
-    std::vector<LayerInputs> m_aOutputs;
-    std::vector<LayerErrors> m_aErrors;
     size_t m_numberOfInputs;
+    LossFunction m_lossFunction;
+
+    MultilayerPerceptronWorkspace m_workspace;
+    size_t m_checkpointInterval;
+    size_t m_peakWorkspaceBytes = 0;
+
+    // Number of train steps, counter of the dropout masks
+    uint64_t m_trainingStep = 0;
+
+    Telemetry *m_pTelemetry = nullptr;
+    Profiler *m_pProfiler = nullptr;
+
+private:
+    void resizeWorkspace(MultilayerPerceptronWorkspace &workspace, size_t batchSize) const;
+    void forward(const real *pInputs, size_t batchSize, size_t begin, size_t end,
+        MultilayerPerceptronWorkspace &workspace, bool bDropout, uint64_t step, Profiler *pProfiler = nullptr) const;
+    real outputDeltas(const real *pTargetOutputs, size_t batchSize, MultilayerPerceptronWorkspace &workspace) const;
+
+    // Buffers of Layer i in a workspace
+    bool checkpointed(const MultilayerPerceptronWorkspace &workspace, size_t i) const;
+    real *activations(MultilayerPerceptronWorkspace &workspace, size_t i) const;
+    real *outputs(MultilayerPerceptronWorkspace &workspace, size_t i) const;
+    real *deltas(MultilayerPerceptronWorkspace &workspace, size_t i) const;
+    real *dropoutMask(MultilayerPerceptronWorkspace &workspace, size_t i) const;
 };
 
 #endif // MULTILAYER_PERCEPTRON_H
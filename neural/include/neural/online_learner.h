@@ -0,0 +1,109 @@
+#ifndef ONLINE_LEARNER_H
+#define ONLINE_LEARNER_H
+
+#include "neural/multilayer_perceptron.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+struct OnlineLearningParameters
+{
+    // Samples per gradient step
+    size_t batchSize = 32;
+
+    // Longest time a sample waits for others to fill its batch
+    std::chrono::milliseconds maxWaitTime = std::chrono::milliseconds(100);
+
+    // Gradient steps between two publications of the weights
+    size_t publicationInterval = 1;
+
+    // Oldest samples are dropped beyond this many waiting ones
+    size_t maxPendingSamples = 4096;
+};
+
+/*
+ * Keeps a deployed Multilayer Perceptron learning from a stream
+ * of labelled samples.
+ * A background thread applies mini-batch steps to a private
+ * shadow copy and regularly publishes a snapshot of it (RCU):
+ * readers take a reference on the current snapshot with an
+ * atomic load and evaluate it without any lock, a snapshot
+ * is only reused for a later publication once no reader
+ * holds it anymore.
+ * Samples must be scaled like the ones the network was trained on.
+ */
+class OnlineLearner
+{
+public:
+    OnlineLearner(const MultilayerPerceptron &multilayerPerceptron, const OnlineLearningParameters &parameters);
+
+    // Samples not learnt yet are dropped, call flush first to keep them
+    ~OnlineLearner();
+
+    OnlineLearner(const OnlineLearner &) = delete;
+    OnlineLearner &operator=(const OnlineLearner &) = delete;
+
+    // Thread-safe, never waits for a gradient step
+    void addSample(const LayerInputs &aInputs, const LayerOutputs &aOutputs);
+
+    // Learn every sample added so far and publish the result
+    void flush();
+
+    // Current published snapshot, kept alive as long as it is referenced
+    std::shared_ptr<const MultilayerPerceptron> model() const;
+
+    // Thread-safe evaluation on the current snapshot
+    const LayerOutputs &evaluate(const real *pInputs, size_t batchSize, MultilayerPerceptronWorkspace &workspace) const;
+
+    // Counters since construction
+    size_t numberOfUpdates() const;
+    size_t numberOfPublications() const;
+    size_t numberOfDroppedSamples() const;
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    struct Sample
+    {
+        LayerInputs aInputs;
+        LayerOutputs aOutputs;
+        Clock::time_point addTime;
+    };
+
+    size_t m_batchSize;
+    std::chrono::milliseconds m_maxWaitTime;
+    size_t m_publicationInterval;
+    size_t m_maxPendingSamples;
+
+    // Accessed with the atomic shared_ptr functions only
+    std::shared_ptr<MultilayerPerceptron> m_pPublished;
+
+    std::thread m_thread;
+    mutable std::mutex m_mutex;
+    std::condition_variable m_condition;
+    std::condition_variable m_flushCondition;
+
+    std::deque<Sample> m_aSamples;
+    size_t m_numberOfUpdates = 0;
+    size_t m_numberOfPublications = 0;
+    size_t m_numberOfDroppedSamples = 0;
+    bool m_bFlush = false;
+    bool m_bStop = false;
+
+    // Used by the learning thread only
+    MultilayerPerceptron m_shadow;
+    std::shared_ptr<MultilayerPerceptron> m_pRetired;
+    size_t m_updatesSincePublication = 0;
+    std::vector<real> m_arBatchInputs;
+    std::vector<real> m_arBatchOutputs;
+
+private:
+    void run();
+    void publish();
+};
+
+#endif // ONLINE_LEARNER_H
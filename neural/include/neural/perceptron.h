@@ -10,6 +10,10 @@ struct PerceptronParameters
     real rLearningRate;
     real rBias;
     real rMomentum;
+
+    // Weight decay, added to the derivatives of the weights
+    real rL1 = 0.0;
+    real rL2 = 0.0;
 };
 
 class Perceptron
@@ -0,0 +1,125 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include "neural/layer.h"
+#include "neural/telemetry.h"
+
+#include <ostream>
+
+/*
+ * Attainable rates of the machine, over the whole global ThreadPool
+ */
+struct MachinePeaks
+{
+    real rFlopsPerSecond = 0.0;
+    real rBytesPerSecond = 0.0;
+};
+
+/*
+ * Work of one Layer call: floating point operations
+ * and bytes read or written in memory (each buffer counted once)
+ */
+struct LayerCost
+{
+    real rFlops = 0.0;
+    real rBytes = 0.0;
+};
+
+/*
+ * Totals of one Layer, per phase (Forward, Backward, Update)
+ */
+struct LayerProfile
+{
+    LayerType eLayerType = LayerType::FullyConnected;
+    size_t numberOfInputs = 0;
+    size_t size = 0;
+
+    size_t aCalls[static_cast<size_t>(TrainingPhase::Count)] = {};
+    real arTimes[static_cast<size_t>(TrainingPhase::Count)] = {};
+    LayerCost aCosts[static_cast<size_t>(TrainingPhase::Count)] = {};
+};
+
+/*
+ * Opt-in per Layer profile of the passes of a MultilayerPerceptron
+ * (see MultilayerPerceptron::setProfiler and Trainer::setProfiler):
+ * wall time of every forward, backward and update call, with its
+ * FLOPs and bytes from a cost model of the Layer.
+ * The report places each Layer on the roofline of the machine:
+ * a Layer whose arithmetic intensity (FLOPs per byte) is below
+ * the ridge point (peak FLOP/s over peak bytes/s) is bound by
+ * the memory bandwidth, otherwise by the compute.
+ * Hogwild! steps and evaluations on caller provided workspaces
+ * are not profiled, a Profiler is not thread-safe.
+ */
+class Profiler
+{
+public:
+    Profiler(const MachinePeaks &peaks = measurePeaks());
+
+    /*
+     * Micro-probes, about a second: compute peak from a large gemm,
+     * bandwidth peak from a triad on buffers larger than the caches
+     */
+    static MachinePeaks measurePeaks();
+
+    // bInputDeltas: errors are sent to a previous Layer (backward)
+    static LayerCost cost(const Layer &layer, TrainingPhase ePhase, size_t batchSize, bool bInputDeltas);
+
+    void add(size_t i, const Layer &layer, TrainingPhase ePhase, size_t batchSize, bool bInputDeltas, real rSeconds);
+    void reset();
+
+    INLINE const std::vector<LayerProfile> &layers() const{return m_aLayers;}
+    INLINE const MachinePeaks &peaks() const{return m_peaks;}
+
+    // Roofline summary, one row per Layer and phase
+    void report(std::ostream &stream) const;
+
+private:
+    MachinePeaks m_peaks;
+    std::vector<LayerProfile> m_aLayers;
+};
+
+/*
+ * Adds the lifetime of the scope to Layer i of the Profiler.
+ * Does nothing if pProfiler is null.
+ */
+class ScopedLayerTimer
+{
+public:
+    INLINE ScopedLayerTimer(Profiler *pProfiler, size_t i, const Layer &layer, TrainingPhase ePhase, size_t batchSize, bool bInputDeltas) :
+        m_pProfiler(pProfiler),
+        m_i(i),
+        m_layer(layer),
+        m_ePhase(ePhase),
+        m_batchSize(batchSize),
+        m_bInputDeltas(bInputDeltas)
+    {
+        if(m_pProfiler != nullptr)
+        {
+            m_start = std::chrono::steady_clock::now();
+        }
+    }
+
+    INLINE ~ScopedLayerTimer()
+    {
+        if(m_pProfiler != nullptr)
+        {
+            const std::chrono::duration<real> elapsed = std::chrono::steady_clock::now() - m_start;
+            m_pProfiler->add(m_i, m_layer, m_ePhase, m_batchSize, m_bInputDeltas, elapsed.count());
+        }
+    }
+
+    ScopedLayerTimer(const ScopedLayerTimer &) = delete;
+    ScopedLayerTimer &operator=(const ScopedLayerTimer &) = delete;
+
+private:
+    Profiler *m_pProfiler;
+    size_t m_i;
+    const Layer &m_layer;
+    TrainingPhase m_ePhase;
+    size_t m_batchSize;
+    bool m_bInputDeltas;
+    std::chrono::steady_clock::time_point m_start;
+};
+
+#endif // PROFILER_H
@@ -0,0 +1,59 @@
+#ifndef PRUNING_H
+#define PRUNING_H
+
+#include "neural/defines.h"
+
+class MultilayerPerceptron;
+class Dataset;
+class Trainer;
+
+enum class PruningScope
+{
+    // One threshold for the weights of all the Layers
+    Global,
+    // Each Layer loses the same fraction of its weights
+    PerLayer
+};
+
+struct PruningParameters
+{
+    PruningScope eScope = PruningScope::Global;
+
+    // Fraction of the weights to remove
+    real rSparsity = 0.5;
+
+    // Absolute magnitude threshold, used instead of rSparsity if >= 0
+    real rThreshold = -1.0;
+};
+
+/*
+ * Magnitude pruning of a trained Multilayer Perceptron.
+ * Pruned weights stay zero when training again, so the
+ * network can be fine-tuned with a Trainer afterwards.
+ * Layers sparse enough are evaluated from a CSR copy
+ * of their weights (see Layer::prune).
+ */
+class Pruner
+{
+public:
+    Pruner(const PruningParameters &parameters);
+
+    void prune(MultilayerPerceptron &multilayerPerceptron) const;
+
+    /*
+     * Prune then fine-tune. The dataset is scaled again by
+     * the Trainer, so it should use ScalingMethod::None if the
+     * dataset was already scaled by the first training.
+     */
+    void prune(MultilayerPerceptron &multilayerPerceptron, Dataset &dataset, Trainer &trainer) const;
+
+private:
+    PruningScope m_eScope;
+    real m_rSparsity;
+    real m_rThreshold;
+
+private:
+    real magnitudeThreshold(const std::vector<real> &arMagnitudes) const;
+};
+
+#endif // PRUNING_H
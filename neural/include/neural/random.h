@@ -0,0 +1,65 @@
+#ifndef RANDOM_H
+#define RANDOM_H
+
+#include "neural/defines.h"
+
+#include <cstddef>
+#include <cstdint>
+
+/*
+ * Counter-based random numbers (Philox4x32-10).
+ * The n-th value of a stream only depends on its key and n,
+ * so values can be drawn in any order, by any number of
+ * threads, and always give the same results.
+ * split derives independent child streams (per Layer,
+ * per thread, per epoch...) from a parent key.
+ */
+class RandomStream
+{
+public:
+    // Seed fields of the parameter structs left to this value take e_uiSeed++
+    static const uint64_t s_unsetSeed = ~0ULL;
+
+    RandomStream(uint64_t key = 0);
+
+    RandomStream split(uint64_t id) const;
+
+    // Next raw 64 bits value
+    uint64_t next();
+
+    // Uniform in [0, 1) and [rLowerBound, rUpperBound)
+    real uniform();
+    real uniform(real rLowerBound, real rUpperBound);
+
+    // Uniform in [0, count)
+    size_t uniformIndex(size_t count);
+
+    // Standard normal (Box-Muller), uses two values
+    real normal();
+
+    /*
+     * Bulk generation of the next count values. Large
+     * fills are split over the global ThreadPool, results
+     * do not depend on the number of threads.
+     * fillNormal uses count values rounded up to an even number.
+     */
+    void fillUniform(real *pValues, size_t count, real rLowerBound = 0.0, real rUpperBound = 1.0);
+    void fillNormal(real *pValues, size_t count, real rMean = 0.0, real rStandardDeviation = 1.0);
+
+    INLINE uint64_t key() const{return m_key;}
+    INLINE uint64_t position() const{return m_position;}
+    INLINE void seek(uint64_t position){m_position = position;}
+
+private:
+    uint64_t m_key;
+    uint64_t m_position = 0;
+
+    // Last generated group of Philox blocks
+    uint64_t m_cachedGroup = ~0ULL;
+    uint64_t m_aCachedValues[32];
+
+private:
+    void generate(uint64_t position, size_t count, uint64_t *pValues) const;
+};
+
+#endif // RANDOM_H
@@ -0,0 +1,44 @@
+#ifndef REPLICAS_H
+#define REPLICAS_H
+
+#include "neural/multilayer_perceptron.h"
+
+#include <memory>
+
+class ThreadPool;
+
+/*
+ * One read-only copy of a Multilayer Perceptron per NUMA node,
+ * for inference. Each copy is made by a pool thread pinned to
+ * its node, so that its weights are placed in local memory.
+ * Nodes without a pool thread get a copy made by the caller.
+ */
+class MultilayerPerceptronReplicas
+{
+public:
+    MultilayerPerceptronReplicas(const MultilayerPerceptron &multilayerPerceptron, ThreadPool &threadPool);
+
+    // Copy new weights into every replica, in place
+    void update(const MultilayerPerceptron &multilayerPerceptron);
+
+    INLINE size_t size() const{return m_apReplicas.size();}
+    INLINE const MultilayerPerceptron &replica(size_t node) const{return *m_apReplicas[node];}
+
+    // Replica of the node the calling thread runs on
+    const MultilayerPerceptron &local() const;
+
+    // Thread-safe evaluation on the local replica
+    const LayerOutputs &evaluate(const real *pInputs, size_t batchSize, MultilayerPerceptronWorkspace &workspace) const;
+
+private:
+    ThreadPool &m_threadPool;
+    std::vector<std::unique_ptr<MultilayerPerceptron>> m_apReplicas;
+
+    // First pinned thread of each node, 0 if none
+    std::vector<size_t> m_aNodeThreads;
+
+private:
+    void copy(const MultilayerPerceptron &multilayerPerceptron);
+};
+
+#endif // REPLICAS_H
@@ -0,0 +1,78 @@
+#ifndef SPAN_H
+#define SPAN_H
+
+#include "neural/defines.h"
+
+#include <cstddef>
+#include <iterator>
+#include <type_traits>
+
+/*
+ * Non-owning view of size() values, stride() apart in memory
+ * (1 for contiguous values, data() is then a plain array).
+ * The viewed buffer must outlive the Span.
+ */
+template<typename T>
+class Span
+{
+public:
+    /*
+     * Keeps the index of its value, the pointer is only formed
+     * on dereference: stepping a strided pointer past the last
+     * value would leave the buffer (undefined behaviour)
+     */
+    class Iterator
+    {
+    public:
+        Iterator(T *pData, size_t index, size_t stride) : m_pData(pData), m_index(index), m_stride(stride){}
+
+        INLINE T &operator*() const{return m_pData[m_index * m_stride];}
+        INLINE Iterator &operator++(){++m_index; return *this;}
+        INLINE bool operator==(const Iterator &other) const{return m_index == other.m_index;}
+        INLINE bool operator!=(const Iterator &other) const{return m_index != other.m_index;}
+
+        using iterator_category = std::forward_iterator_tag;
+        using value_type = typename std::remove_const<T>::type;
+        using difference_type = std::ptrdiff_t;
+        using pointer = T *;
+        using reference = T &;
+
+    private:
+        T *m_pData;
+        size_t m_index;
+        size_t m_stride;
+    };
+
+    Span() = default;
+    Span(T *pData, size_t size, size_t stride = 1) : m_pData(pData), m_size(size), m_stride(stride){}
+
+    // Whole vector, const or not
+    template<typename U, typename = typename std::enable_if<std::is_convertible<U *, T *>::value>::type>
+    Span(std::vector<U> &aValues) : m_pData(aValues.data()), m_size(aValues.size()){}
+    template<typename U, typename = typename std::enable_if<std::is_convertible<const U *, T *>::value>::type>
+    Span(const std::vector<U> &aValues) : m_pData(aValues.data()), m_size(aValues.size()){}
+
+    INLINE T &operator[](size_t i) const{return m_pData[i * m_stride];}
+
+    INLINE T *data() const{return m_pData;}
+    INLINE size_t size() const{return m_size;}
+    INLINE size_t stride() const{return m_stride;}
+    INLINE bool empty() const{return m_size == 0;}
+    INLINE bool contiguous() const{return m_stride == 1;}
+
+    INLINE Iterator begin() const{return Iterator(m_pData, 0, m_stride);}
+    INLINE Iterator end() const{return Iterator(m_pData, m_size, m_stride);}
+
+    // Copy of the values, for APIs taking vectors
+    INLINE std::vector<typename std::remove_const<T>::type> vector() const
+    {
+        return std::vector<typename std::remove_const<T>::type>(begin(), end());
+    }
+
+private:
+    T *m_pData = nullptr;
+    size_t m_size = 0;
+    size_t m_stride = 1;
+};
+
+#endif // SPAN_H
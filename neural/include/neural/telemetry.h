@@ -0,0 +1,157 @@
+#ifndef TELEMETRY_H
+#define TELEMETRY_H
+
+#include "neural/defines.h"
+
+#include <chrono>
+#include <fstream>
+#include <functional>
+#include <memory>
+#include <string>
+
+enum class TrainingPhase
+{
+    Forward,
+    Backward,
+    Update,
+    Validation,
+    Count
+};
+
+const char *trainingPhaseName(TrainingPhase ePhase);
+
+struct EpochMetrics
+{
+    unsigned long epoch = 0;
+    size_t numberOfSamples = 0;
+
+    real rTrainingError = 0.0;
+    real rValidationError = 0.0;
+    real rLearningRate = 0.0;
+    real rGradientNorm = 0.0;
+
+    // Seconds
+    real rEpochTime = 0.0;
+    real rSamplesPerSecond = 0.0;
+    real arPhaseTimes[static_cast<size_t>(TrainingPhase::Count)] = {};
+};
+
+using EpochCallback = std::function<void(const EpochMetrics &)>;
+
+/*
+ * Destination of the per-epoch metrics
+ */
+class TelemetrySink
+{
+public:
+    virtual ~TelemetrySink();
+
+    virtual void write(const EpochMetrics &metrics) = 0;
+};
+
+class CsvTelemetrySink : public TelemetrySink
+{
+public:
+    CsvTelemetrySink(const std::string &strPath);
+
+    void write(const EpochMetrics &metrics) override;
+
+private:
+    std::ofstream m_file;
+};
+
+/*
+ * One JSON object per line (JSON Lines),
+ * so that the file can be tailed while training
+ */
+class JsonTelemetrySink : public TelemetrySink
+{
+public:
+    JsonTelemetrySink(const std::string &strPath);
+
+    void write(const EpochMetrics &metrics) override;
+
+private:
+    std::ofstream m_file;
+};
+
+struct TelemetryParameters
+{
+    bool bPhaseTimers = true;
+    bool bGradientNorms = true;
+};
+
+/*
+ * Collects the metrics of a training run.
+ * Trainer and MultilayerPerceptron only hold a pointer
+ * to it: when no Telemetry is attached, the only cost
+ * left in the hot path is a null pointer check.
+ */
+class Telemetry
+{
+public:
+    Telemetry(const TelemetryParameters &parameters = TelemetryParameters());
+
+    void addCallback(const EpochCallback &callback);
+    void addSink(std::unique_ptr<TelemetrySink> pSink);
+
+    void beginEpoch(unsigned long epoch);
+    void endEpoch(EpochMetrics &metrics);
+
+    INLINE void addPhaseTime(TrainingPhase ePhase, real rSeconds){m_arPhaseTimes[static_cast<size_t>(ePhase)] += rSeconds;}
+    INLINE void addGradientSquaredNorm(real rSquaredNorm){m_rGradientSquaredNormSum += rSquaredNorm; ++m_gradientNormCount;}
+
+    INLINE bool phaseTimersEnabled() const{return m_bPhaseTimers;}
+    INLINE bool gradientNormsEnabled() const{return m_bGradientNorms;}
+
+private:
+    bool m_bPhaseTimers;
+    bool m_bGradientNorms;
+
+    std::vector<EpochCallback> m_aCallbacks;
+    std::vector<std::unique_ptr<TelemetrySink>> m_aSinks;
+
+    // Current epoch accumulators
+    unsigned long m_epoch = 0;
+    std::chrono::steady_clock::time_point m_epochStart;
+    real m_arPhaseTimes[static_cast<size_t>(TrainingPhase::Count)] = {};
+    real m_rGradientSquaredNormSum = 0.0;
+    size_t m_gradientNormCount = 0;
+};
+
+/*
+ * Adds the lifetime of the scope to a phase of the Telemetry.
+ * Does nothing if pTelemetry is null or phase timers are disabled.
+ */
+class ScopedTimer
+{
+public:
+    INLINE ScopedTimer(Telemetry *pTelemetry, TrainingPhase ePhase) :
+        m_pTelemetry((pTelemetry != nullptr && pTelemetry->phaseTimersEnabled() == true) ? pTelemetry : nullptr),
+        m_ePhase(ePhase)
+    {
+        if(m_pTelemetry != nullptr)
+        {
+            m_start = std::chrono::steady_clock::now();
+        }
+    }
+
+    INLINE ~ScopedTimer()
+    {
+        if(m_pTelemetry != nullptr)
+        {
+            const std::chrono::duration<real> elapsed = std::chrono::steady_clock::now() - m_start;
+            m_pTelemetry->addPhaseTime(m_ePhase, elapsed.count());
+        }
+    }
+
+    ScopedTimer(const ScopedTimer &) = delete;
+    ScopedTimer &operator=(const ScopedTimer &) = delete;
+
+private:
+    Telemetry *m_pTelemetry;
+    TrainingPhase m_ePhase;
+    std::chrono::steady_clock::time_point m_start;
+};
+
+#endif // TELEMETRY_H
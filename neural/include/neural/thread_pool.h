@@ -0,0 +1,86 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include "neural/defines.h"
+#include "neural/topology.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+/*
+ * Fixed set of worker threads running
+ * parallel loops. The calling thread takes
+ * part in the loop, so a pool of size N
+ * owns N - 1 threads.
+ * A parallelFor issued while the pool is
+ * already busy (nested or concurrent call)
+ * runs serially on the calling thread.
+ * Given a Topology, worker threads are pinned
+ * to CPUs spread over the NUMA nodes in turn.
+ * The calling thread is never pinned.
+ */
+class ThreadPool
+{
+public:
+    // 0 uses the number of hardware threads
+    ThreadPool(size_t numberOfThreads = 0);
+    ThreadPool(size_t numberOfThreads, const Topology &topology);
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool &) = delete;
+    ThreadPool &operator=(const ThreadPool &) = delete;
+
+    // Call function(i) for every i in [0, count), return when all are done
+    void parallelFor(size_t count, const std::function<void(size_t)> &function);
+
+    /*
+     * Call function(thread) once on every thread of the pool,
+     * 0 being the calling thread. Buffers a thread allocates and
+     * writes first are placed on its node (first-touch policy).
+     * On a busy pool, every call runs on the calling thread.
+     */
+    void forEachThread(const std::function<void(size_t)> &function);
+
+    INLINE size_t size() const{return m_aThreads.size() + 1;}
+
+    INLINE bool pinned() const{return m_bPinned;}
+    INLINE const Topology &topology() const{return m_topology;}
+
+    // NUMA node of a thread, the calling thread (0) is on its current node
+    size_t nodeOfThread(size_t thread) const;
+
+    // Pool shared by the library kernels
+    static ThreadPool &global();
+
+private:
+    std::vector<std::thread> m_aThreads;
+
+    Topology m_topology;
+    bool m_bPinned = false;
+    // Node of each thread, the calling thread first
+    std::vector<size_t> m_aThreadNodes;
+
+    std::mutex m_jobMutex;
+    std::mutex m_mutex;
+    std::condition_variable m_condition;
+    std::condition_variable m_doneCondition;
+
+    const std::function<void(size_t)> *m_pFunction = nullptr;
+    bool m_bEachThread = false;
+    size_t m_count = 0;
+    std::atomic<size_t> m_nextIndex;
+    size_t m_pendingWorkers = 0;
+    unsigned long m_generation = 0;
+    bool m_bStop = false;
+
+private:
+    void start(size_t numberOfThreads, const std::vector<size_t> &aCpus);
+    void dispatch(size_t count, const std::function<void(size_t)> &function, bool bEachThread);
+    void run(size_t thread);
+    void runTasks();
+};
+
+#endif // THREAD_POOL_H
@@ -0,0 +1,58 @@
+#ifndef TOPOLOGY_H
+#define TOPOLOGY_H
+
+#include "neural/defines.h"
+
+#include <cstddef>
+#include <string>
+
+/*
+ * NUMA nodes of the machine and their CPUs.
+ * Detected with libnuma when the library is built with it,
+ * from /sys/devices/system/node otherwise, and a single
+ * node holding every CPU when neither is available.
+ */
+class Topology
+{
+public:
+    // Single node with numberOfCpus CPUs
+    Topology(size_t numberOfCpus = 1);
+
+    static Topology detect();
+
+    // Nodes of a sysfs node directory ("/sys/devices/system/node"),
+    // a single node holding every CPU if it has none
+    static Topology fromSysfs(const std::string &strNodeDirectory);
+
+    /*
+     * Fake topology for tests, nodes separated by ';', each
+     * node a list of CPUs and CPU ranges: "0-3;4-7" or "0,2;1,3"
+     * Returns a single node topology if the description is invalid.
+     */
+    static Topology fromString(const std::string &strDescription);
+
+    /*
+     * Topology of the machine, detected once.
+     * The NEURAL_TOPOLOGY environment variable overrides
+     * the detection with a fake topology (see fromString).
+     */
+    static const Topology &system();
+
+    INLINE size_t numberOfNodes() const{return m_aaNodeCpus.size();}
+    INLINE const std::vector<size_t> &cpus(size_t node) const{return m_aaNodeCpus[node];}
+    size_t numberOfCpus() const;
+
+    // Node of a CPU, 0 if unknown
+    size_t nodeOfCpu(size_t cpu) const;
+
+    // Node of the CPU the calling thread runs on
+    size_t currentNode() const;
+
+private:
+    std::vector<std::vector<size_t>> m_aaNodeCpus;
+
+private:
+    static bool parseCpuList(const std::string &strCpuList, std::vector<size_t> &aCpus);
+};
+
+#endif // TOPOLOGY_H
@@ -3,8 +3,16 @@
 
 #include "neural/defines.h"
 
+#include <cstdint>
+#include <string>
+
 class MultilayerPerceptron;
 class Dataset;
+class ParameterAverager;
+class Profiler;
+class Telemetry;
+class ThreadPool;
+struct MultilayerPerceptronWorkspace;
 
 enum class ScalingMethod
 {
@@ -13,6 +21,15 @@ enum class ScalingMethod
     Standardisation
 };
 
+enum class TrainingMode
+{
+    // Gradient steps applied one batch after another
+    Synchronous,
+    // Lock-free asynchronous steps from several threads (Hogwild!),
+    // one sample per step, batchSize, dropout and phase timers are ignored
+    Hogwild
+};
+
 struct TrainingParameters
 {
     int iMaxIterations = -1;
@@ -20,6 +37,32 @@ struct TrainingParameters
     real rTrainingRateThreshold = -1.0;
     real rCrossValidationEvaluationPercent = 1.0;
     ScalingMethod eScalingMethod = ScalingMethod::Normalisation;
+
+    // Samples per gradient step, 1 is stochastic gradient descent
+    size_t batchSize = 1;
+
+    // Truncated backpropagation through time in the recurrent Layers,
+    // timesteps per block (see Layer::setBackpropagationSteps),
+    // 0 keeps the truncation of the Layers
+    size_t backpropagationSteps = 0;
+
+    // Visit training samples in a new random order each epoch,
+    // the order of an epoch only depends on shuffleSeed and its index
+    bool bShuffle = false;
+    uint64_t shuffleSeed = 0;
+
+    TrainingMode eTrainingMode = TrainingMode::Synchronous;
+    // Threads of the Hogwild mode, 0 uses the global ThreadPool
+    // unless bPinThreads is set (one thread per CPU then)
+    size_t numberOfThreads = 0;
+    // Pin the Hogwild threads over the NUMA nodes of Topology::system()
+    bool bPinThreads = false;
+
+    // Checkpoint every uiCheckpointInterval iterations (0 disables), with a
+    // ParameterAverager the first worker checkpoints and resumes for all of them
+    std::string strCheckpointPath;
+    unsigned int uiCheckpointInterval = 0;
+    bool bResume = false;
 };
 
 class Trainer
@@ -29,6 +72,28 @@ public:
 
     void train(MultilayerPerceptron &multilayerPerceptron, Dataset &dataset);
 
+    // Train on an already scaled Dataset, eScalingMethod is ignored
+    void train(MultilayerPerceptron &multilayerPerceptron, const Dataset &dataset);
+
+    // Evaluation error at the end of the last training
+    INLINE real error() const{return m_rError;}
+
+    // Not owned, must outlive the calls to train
+    INLINE void setTelemetry(Telemetry *pTelemetry){m_pTelemetry = pTelemetry;}
+
+    // Not owned, profiles the batched steps and the validation passes
+    INLINE void setProfiler(Profiler *pProfiler){m_pProfiler = pProfiler;}
+
+    /*
+     * Not owned, connected, one per worker process: each worker
+     * trains on its shard of the training samples (of the shuffled
+     * order if bShuffle, with the same shuffleSeed everywhere),
+     * weights are averaged while training and synchronised at the
+     * end of every epoch. Every worker must be given the same
+     * Dataset and parameters.
+     */
+    INLINE void setParameterAverager(ParameterAverager *pParameterAverager){m_pParameterAverager = pParameterAverager;}
+
 private:
     int m_iMaxIterations;
     real m_rErrorThreshold;
@@ -36,7 +101,43 @@ private:
     real m_rCrossValidationEvaluationPercent;
     ScalingMethod m_eScalingMethod;
 
+    std::string m_strCheckpointPath;
+    unsigned int m_uiCheckpointInterval;
+    bool m_bResume;
+    size_t m_batchSize;
+    size_t m_backpropagationSteps;
+    bool m_bShuffle;
+    uint64_t m_shuffleSeed;
+    TrainingMode m_eTrainingMode;
+    size_t m_numberOfThreads;
+    bool m_bPinThreads;
+
     bool m_bVerbose;
+
+    real m_rError = 0.0;
+
+    Telemetry *m_pTelemetry = nullptr;
+    Profiler *m_pProfiler = nullptr;
+    ParameterAverager *m_pParameterAverager = nullptr;
+
+    // Current batch, rows of the Dataset or of the copies below
+    const real *m_pBatchInputs = nullptr;
+    const real *m_pBatchOutputs = nullptr;
+
+    // Contiguous copy of the current batch, when gathered
+    std::vector<real> m_arBatchInputs;
+    std::vector<real> m_arBatchOutputs;
+
+    // Training samples order of the current epoch, empty if not shuffled
+    std::vector<size_t> m_aSampleOrder;
+
+private:
+    real evaluationError(MultilayerPerceptron &multilayerPerceptron, const Dataset &dataset, size_t begin, size_t end);
+    INLINE size_t sampleIndex(size_t i) const{return i < m_aSampleOrder.size() ? m_aSampleOrder[i] : i;}
+    void shuffleSamples(size_t numberOfSamples, uint64_t epoch);
+    size_t gatherBatch(const Dataset &dataset, size_t begin, size_t end);
+    real trainAsynchronous(MultilayerPerceptron &multilayerPerceptron, const Dataset &dataset, size_t begin, size_t end,
+        ThreadPool &threadPool, std::vector<MultilayerPerceptronWorkspace> &aWorkspaces);
 };
 
 #endif // TRAINER_H
@@ -0,0 +1,120 @@
+#include "neural/batching_executor.h"
+
+#include "neural/assert.h"
+
+#include <algorithm>
+
+BatchingExecutor::BatchingExecutor(const MultilayerPerceptron &multilayerPerceptron, const BatchingParameters &parameters) :
+    m_multilayerPerceptron(multilayerPerceptron),
+    m_maxBatchSize(parameters.maxBatchSize > 0 ? parameters.maxBatchSize : 1),
+    m_maxWaitTime(parameters.maxWaitTime)
+{
+    m_aBatch.reserve(m_maxBatchSize);
+    m_arBatchInputs.resize(m_maxBatchSize * m_multilayerPerceptron.numberOfInputs());
+
+    m_thread = std::thread(&BatchingExecutor::run, this);
+}
+
+BatchingExecutor::~BatchingExecutor()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_bStop = true;
+    }
+    m_condition.notify_all();
+    m_thread.join();
+}
+
+std::future<LayerOutputs> BatchingExecutor::submit(LayerInputs aInputs)
+{
+    ASSERT(aInputs.size() == m_multilayerPerceptron.numberOfInputs());
+
+    Request request;
+    request.aInputs = std::move(aInputs);
+    request.submitTime = Clock::now();
+    std::future<LayerOutputs> future = request.promise.get_future();
+
+    bool bNotify;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_aRequests.push_back(std::move(request));
+        ++m_numberOfRequests;
+
+        // The dispatcher only waits for the first
+        // request of a batch and for a full batch
+        bNotify = m_aRequests.size() == 1 || m_aRequests.size() == m_maxBatchSize;
+    }
+
+    if(bNotify == true)
+    {
+        m_condition.notify_one();
+    }
+
+    return future;
+}
+
+size_t BatchingExecutor::numberOfRequests() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_numberOfRequests;
+}
+
+size_t BatchingExecutor::numberOfBatches() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_numberOfBatches;
+}
+
+/*
+ * Dispatcher loop: wait for a first request, then
+ * for the batch to fill up or the oldest request
+ * to reach its deadline
+ */
+void BatchingExecutor::run()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while(true)
+    {
+        m_condition.wait(lock, [this]{return m_aRequests.empty() == false || m_bStop == true;});
+        if(m_aRequests.empty() == true)
+        {
+            break;
+        }
+
+        const Clock::time_point deadline = m_aRequests.front().submitTime + m_maxWaitTime;
+        m_condition.wait_until(lock, deadline, [this]{return m_aRequests.size() >= m_maxBatchSize || m_bStop == true;});
+
+        const size_t batchSize = std::min(m_aRequests.size(), m_maxBatchSize);
+        for(size_t i = 0; i < batchSize; ++i)
+        {
+            m_aBatch.push_back(std::move(m_aRequests.front()));
+            m_aRequests.pop_front();
+        }
+        ++m_numberOfBatches;
+
+        lock.unlock();
+        evaluateBatch();
+        lock.lock();
+    }
+}
+
+void BatchingExecutor::evaluateBatch()
+{
+    const size_t numberOfInputs = m_multilayerPerceptron.numberOfInputs();
+    const size_t numberOfOutputs = m_multilayerPerceptron.numberOfOutputs();
+    const size_t batchSize = m_aBatch.size();
+
+    for(size_t i = 0; i < batchSize; ++i)
+    {
+        std::copy(m_aBatch[i].aInputs.begin(), m_aBatch[i].aInputs.end(), m_arBatchInputs.begin() + i * numberOfInputs);
+    }
+
+    const LayerOutputs &arOutputs = m_multilayerPerceptron.evaluate(m_arBatchInputs.data(), batchSize, m_workspace);
+
+    for(size_t i = 0; i < batchSize; ++i)
+    {
+        m_aBatch[i].promise.set_value(LayerOutputs(arOutputs.begin() + i * numberOfOutputs, arOutputs.begin() + (i + 1) * numberOfOutputs));
+    }
+
+    m_aBatch.clear();
+}
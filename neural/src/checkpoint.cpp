@@ -0,0 +1,149 @@
+#include "neural/checkpoint.h"
+
+#include "neural/multilayer_perceptron.h"
+#include "serialisation.h"
+
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+
+namespace
+{
+    const uint32_t s_uiMagic = 0x4B434E4E; // "NNCK"
+    const uint32_t s_uiVersion = 7;
+}
+
+Checkpointer::Checkpointer(const std::string &strPath) :
+    m_strPath(strPath)
+{
+    m_thread = std::thread(&Checkpointer::run, this);
+}
+
+Checkpointer::~Checkpointer()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_bStop = true;
+    }
+    m_condition.notify_all();
+    m_thread.join();
+}
+
+/*
+ * Snapshot network and state into memory,
+ * the writer thread puts it on disk
+ */
+void Checkpointer::save(const MultilayerPerceptron &multilayerPerceptron, const TrainingState &state)
+{
+    std::ostringstream snapshot(std::ios::binary);
+    Serialisation::write(snapshot, s_uiMagic);
+    Serialisation::write(snapshot, s_uiVersion);
+    Serialisation::write(snapshot, static_cast<uint64_t>(state.iterationsIndex));
+    Serialisation::write(snapshot, state.rError);
+    Serialisation::write(snapshot, state.rPreviousError);
+    Serialisation::write(snapshot, state.rTrainingRate);
+    multilayerPerceptron.write(snapshot);
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_strPendingSnapshot = snapshot.str();
+        m_bPending = true;
+    }
+    m_condition.notify_all();
+}
+
+void Checkpointer::flush()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_condition.wait(lock, [this]{return m_bPending == false && m_bWriting == false;});
+}
+
+bool Checkpointer::failed() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_bFailed;
+}
+
+bool Checkpointer::load(const std::string &strPath, MultilayerPerceptron &multilayerPerceptron, TrainingState &state)
+{
+    std::ifstream loadFile(strPath, std::ios::binary);
+    if(loadFile.is_open() == false)
+    {
+        return false;
+    }
+
+    uint32_t uiMagic = 0;
+    uint32_t uiVersion = 0;
+    uint64_t iterationsIndex = 0;
+    TrainingState loadedState;
+    if(Serialisation::read(loadFile, uiMagic) == false || uiMagic != s_uiMagic ||
+        Serialisation::read(loadFile, uiVersion) == false || uiVersion != s_uiVersion ||
+        Serialisation::read(loadFile, iterationsIndex) == false ||
+        Serialisation::read(loadFile, loadedState.rError) == false ||
+        Serialisation::read(loadFile, loadedState.rPreviousError) == false ||
+        Serialisation::read(loadFile, loadedState.rTrainingRate) == false)
+    {
+        return false;
+    }
+    loadedState.iterationsIndex = static_cast<unsigned long>(iterationsIndex);
+
+    // Read into a copy so that a truncated file leaves the network untouched
+    MultilayerPerceptron loadedMultilayerPerceptron = multilayerPerceptron;
+    if(loadedMultilayerPerceptron.read(loadFile) == false)
+    {
+        return false;
+    }
+
+    multilayerPerceptron = loadedMultilayerPerceptron;
+    state = loadedState;
+
+    return true;
+}
+
+void Checkpointer::run()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while(true)
+    {
+        m_condition.wait(lock, [this]{return m_bPending == true || m_bStop == true;});
+
+        if(m_bPending == true)
+        {
+            std::string strSnapshot;
+            strSnapshot.swap(m_strPendingSnapshot);
+            m_bPending = false;
+            m_bWriting = true;
+
+            lock.unlock();
+            const bool bWritten = writeSnapshot(strSnapshot);
+            lock.lock();
+
+            m_bWriting = false;
+            m_bFailed = m_bFailed || bWritten == false;
+            m_condition.notify_all();
+        }
+        else if(m_bStop == true)
+        {
+            break;
+        }
+    }
+}
+
+bool Checkpointer::writeSnapshot(const std::string &strSnapshot) const
+{
+    const std::string strTemporaryPath = m_strPath + ".tmp";
+
+    std::ofstream saveFile(strTemporaryPath, std::ios::binary | std::ios::trunc);
+    if(saveFile.is_open() == false)
+    {
+        return false;
+    }
+    saveFile.write(strSnapshot.data(), static_cast<std::streamsize>(strSnapshot.size()));
+    saveFile.close();
+    if(saveFile.fail() == true)
+    {
+        return false;
+    }
+
+    return std::rename(strTemporaryPath.c_str(), m_strPath.c_str()) == 0;
+}
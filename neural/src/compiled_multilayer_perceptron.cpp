@@ -0,0 +1,291 @@
+#include "neural/compiled_multilayer_perceptron.h"
+
+#include "neural/thread_pool.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace
+{
+#if defined(__GNUC__) || defined(__clang__)
+    // Generic vector matching the SIMD registers of the target
+    #if defined(__AVX512F__)
+        typedef real Vector __attribute__((vector_size(64)));
+    #elif defined(__AVX__)
+        typedef real Vector __attribute__((vector_size(32)));
+    #else
+        typedef real Vector __attribute__((vector_size(16)));
+    #endif
+    const size_t s_vectorSize = sizeof(Vector) / sizeof(real);
+#else
+    const size_t s_vectorSize = 4;
+#endif
+
+    // Samples of a group, two vectors
+    const size_t s_lanes = 2 * s_vectorSize;
+
+    // Groups of samples per parallel task
+    const size_t s_groupsPerTask = 64;
+
+#if defined(__GNUC__) || defined(__clang__)
+    INLINE void activate(ActivationFunctionType eActivationFunctionType, Vector &values)
+    {
+        switch(eActivationFunctionType)
+        {
+        case ActivationFunctionType::RectifiedLinearUnits:
+            for(size_t l = 0; l < s_vectorSize; ++l)
+            {
+                values[l] = values[l] > 0.0 ? values[l] : 0.0;
+            }
+            break;
+        case ActivationFunctionType::HyperbolicTangent:
+            for(size_t l = 0; l < s_vectorSize; ++l)
+            {
+                values[l] = tanh(values[l]);
+            }
+            break;
+        default:
+            break;
+        }
+    }
+#else
+    INLINE void activate(ActivationFunctionType eActivationFunctionType, real *pValues)
+    {
+        const ActivationFunctionPtr pfActivationFunctionPtr = activationFunctionFromType(eActivationFunctionType);
+        for(size_t l = 0; l < s_lanes; ++l)
+        {
+            pValues[l] = pfActivationFunctionPtr(pValues[l]);
+        }
+    }
+#endif
+}
+
+const size_t CompiledMultilayerPerceptron::s_maxFusedWidth;
+
+CompiledMultilayerPerceptron::CompiledMultilayerPerceptron(const MultilayerPerceptron &multilayerPerceptron) :
+    m_lossFunction(multilayerPerceptron.lossFunction())
+{
+    for(size_t i = 0; i < multilayerPerceptron.numberOfLayers(); ++i)
+    {
+        m_aLayers.push_back(multilayerPerceptron.layer(i));
+    }
+
+    // Group consecutive narrow fully connected Layers, inputs included
+    for(size_t i = 0; i < m_aLayers.size();)
+    {
+        size_t end = i;
+        while(end < m_aLayers.size() && m_aLayers[end].layerType() == LayerType::FullyConnected &&
+            m_aLayers[end].size() <= s_maxFusedWidth && m_aLayers[end].numberOfInputs() <= s_maxFusedWidth)
+        {
+            ++end;
+        }
+
+        if(end > i)
+        {
+            m_aStages.push_back({i, end, true});
+            i = end;
+        }
+        else
+        {
+            m_aStages.push_back({i, i + 1, false});
+            ++i;
+        }
+    }
+}
+
+void CompiledMultilayerPerceptron::evaluate(const real *pInputs, size_t batchSize, real *pOutputs) const
+{
+    // Outputs of the previous stage
+    std::vector<real> arStageInputs;
+    std::vector<real> arStageOutputs;
+
+    for(size_t s = 0; s < m_aStages.size(); ++s)
+    {
+        const Stage &stage = m_aStages[s];
+        const real *pStageInputs = (s == 0) ? pInputs : arStageInputs.data();
+
+        real *pStageOutputs = pOutputs;
+        if(s + 1 < m_aStages.size())
+        {
+            arStageOutputs.resize(batchSize * m_aLayers[stage.end - 1].size());
+            pStageOutputs = arStageOutputs.data();
+        }
+
+        // A batch smaller than one group would mostly compute padding
+        if(stage.bFused == true && batchSize >= s_lanes)
+        {
+            evaluateFused(stage, pStageInputs, batchSize, pStageOutputs);
+        }
+        else
+        {
+            evaluateLayers(stage, pStageInputs, batchSize, pStageOutputs);
+        }
+
+        std::swap(arStageInputs, arStageOutputs);
+    }
+
+    m_lossFunction.transform(pOutputs, batchSize, numberOfOutputs());
+}
+
+/*
+ * Layer by Layer forward pass, through the GEMM path
+ */
+void CompiledMultilayerPerceptron::evaluateLayers(const Stage &stage, const real *pInputs, size_t batchSize, real *pOutputs) const
+{
+    std::vector<real> arLayerInputs;
+    std::vector<real> arLayerOutputs;
+
+    for(size_t k = stage.begin; k < stage.end; ++k)
+    {
+        const real *pLayerInputs = (k == stage.begin) ? pInputs : arLayerInputs.data();
+
+        real *pLayerOutputs = pOutputs;
+        if(k + 1 < stage.end)
+        {
+            arLayerOutputs.resize(batchSize * m_aLayers[k].size());
+            pLayerOutputs = arLayerOutputs.data();
+        }
+
+        m_aLayers[k].forward(pLayerInputs, batchSize, pLayerOutputs, pLayerOutputs);
+        std::swap(arLayerInputs, arLayerOutputs);
+    }
+}
+
+/*
+ * Groups of s_lanes samples, split over the ThreadPool for large batches
+ */
+void CompiledMultilayerPerceptron::evaluateFused(const Stage &stage, const real *pInputs, size_t batchSize, real *pOutputs) const
+{
+    const size_t numberOfInputs = m_aLayers[stage.begin].numberOfInputs();
+    const size_t numberOfOutputs = m_aLayers[stage.end - 1].size();
+    const size_t numberOfGroups = (batchSize + s_lanes - 1) / s_lanes;
+    const size_t numberOfTasks = (numberOfGroups + s_groupsPerTask - 1) / s_groupsPerTask;
+
+    const auto evaluateTask = [&](size_t task)
+    {
+        const size_t end = std::min((task + 1) * s_groupsPerTask * s_lanes, batchSize);
+        for(size_t i = task * s_groupsPerTask * s_lanes; i < end; i += s_lanes)
+        {
+            evaluateGroup(stage, pInputs + i * numberOfInputs, std::min(s_lanes, end - i), pOutputs + i * numberOfOutputs);
+        }
+    };
+
+    if(numberOfTasks > 1)
+    {
+        ThreadPool::global().parallelFor(numberOfTasks, evaluateTask);
+    }
+    else
+    {
+        evaluateTask(0);
+    }
+}
+
+/*
+ * Fused forward pass of up to s_lanes samples through the
+ * Layers of the stage, values are stored [neuron][sample]
+ */
+void CompiledMultilayerPerceptron::evaluateGroup(const Stage &stage, const real *pInputs, size_t numberOfSamples, real *pOutputs) const
+{
+    const size_t numberOfInputs = m_aLayers[stage.begin].numberOfInputs();
+    const size_t numberOfOutputs = m_aLayers[stage.end - 1].size();
+
+#if defined(__GNUC__) || defined(__clang__)
+    Vector aaValues[2][s_maxFusedWidth][2];
+
+    // Transpose the inputs, missing samples are zero
+    for(size_t j = 0; j < numberOfInputs; ++j)
+    {
+        for(size_t l = 0; l < s_lanes; ++l)
+        {
+            aaValues[0][j][l / s_vectorSize][l % s_vectorSize] = l < numberOfSamples ? pInputs[l * numberOfInputs + j] : 0.0;
+        }
+    }
+
+    size_t current = 0;
+    for(size_t k = stage.begin; k < stage.end; ++k)
+    {
+        const Layer &layer = m_aLayers[k];
+        const Vector bias = Vector{} + layer.bias();
+
+        for(size_t i = 0; i < layer.size(); ++i)
+        {
+            const real *pRowWeights = layer.weights().data() + i * layer.numberOfInputs();
+
+            Vector sum0 = bias;
+            Vector sum1 = bias;
+            for(size_t j = 0; j < layer.numberOfInputs(); ++j)
+            {
+                const Vector weight = Vector{} + pRowWeights[j];
+                sum0 += weight * aaValues[current][j][0];
+                sum1 += weight * aaValues[current][j][1];
+            }
+
+            activate(layer.activationFunctionType(), sum0);
+            activate(layer.activationFunctionType(), sum1);
+            aaValues[1 - current][i][0] = sum0;
+            aaValues[1 - current][i][1] = sum1;
+        }
+
+        current = 1 - current;
+    }
+
+    // Back to one row per sample
+    for(size_t l = 0; l < numberOfSamples; ++l)
+    {
+        for(size_t i = 0; i < numberOfOutputs; ++i)
+        {
+            pOutputs[l * numberOfOutputs + i] = aaValues[current][i][l / s_vectorSize][l % s_vectorSize];
+        }
+    }
+#else
+    real aaValues[2][s_maxFusedWidth][s_lanes];
+
+    for(size_t j = 0; j < numberOfInputs; ++j)
+    {
+        for(size_t l = 0; l < s_lanes; ++l)
+        {
+            aaValues[0][j][l] = l < numberOfSamples ? pInputs[l * numberOfInputs + j] : 0.0;
+        }
+    }
+
+    size_t current = 0;
+    for(size_t k = stage.begin; k < stage.end; ++k)
+    {
+        const Layer &layer = m_aLayers[k];
+
+        for(size_t i = 0; i < layer.size(); ++i)
+        {
+            const real *pRowWeights = layer.weights().data() + i * layer.numberOfInputs();
+
+            real arSums[s_lanes];
+            for(size_t l = 0; l < s_lanes; ++l)
+            {
+                arSums[l] = layer.bias();
+            }
+            for(size_t j = 0; j < layer.numberOfInputs(); ++j)
+            {
+                for(size_t l = 0; l < s_lanes; ++l)
+                {
+                    arSums[l] += pRowWeights[j] * aaValues[current][j][l];
+                }
+            }
+
+            activate(layer.activationFunctionType(), arSums);
+            for(size_t l = 0; l < s_lanes; ++l)
+            {
+                aaValues[1 - current][i][l] = arSums[l];
+            }
+        }
+
+        current = 1 - current;
+    }
+
+    for(size_t l = 0; l < numberOfSamples; ++l)
+    {
+        for(size_t i = 0; i < numberOfOutputs; ++i)
+        {
+            pOutputs[l * numberOfOutputs + i] = aaValues[current][i][l];
+        }
+    }
+#endif
+}
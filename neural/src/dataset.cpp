@@ -1,20 +1,109 @@
 #include "neural/dataset.h"
 
 #include "neural/assert.h"
+#include "serialisation.h"
 
+#include <algorithm>
 #include <fstream>
+#include <cmath>
+#include <utility>
+
+namespace
+{
+    const uint32_t s_uiMagic = 0x53444E4E; // "NNDS"
+    const uint32_t s_uiVersion = 2;
+
+    // Number of samples, patched when the writer is closed
+    const std::streamoff s_numberOfSamplesOffset = 3 * sizeof(uint32_t) + 2 * sizeof(uint64_t);
+
+    /*
+     * Copy rows of the same size into a row-major buffer,
+     * rows of pReleasedRows (aRows itself) are released once copied
+     */
+    void packRows(const std::vector<std::vector<real>> &aRows, std::vector<real> &arValues, size_t &count,
+        std::vector<std::vector<real>> *pReleasedRows = nullptr)
+    {
+        count = aRows.empty() == false ? aRows[0].size() : 0;
+        arValues.resize(aRows.size() * count);
+
+        for(size_t i = 0; i < aRows.size(); ++i)
+        {
+            ASSERT(aRows[i].size() == count);
+            std::copy(aRows[i].begin(), aRows[i].end(), arValues.begin() + i * count);
+
+            if(pReleasedRows != nullptr)
+            {
+                std::vector<real>().swap((*pReleasedRows)[i]);
+            }
+        }
+    }
+
+    // Transpose a rows x columns row-major matrix
+    std::vector<real> transpose(const std::vector<real> &arValues, size_t rows, size_t columns)
+    {
+        std::vector<real> arTransposed(arValues.size());
+        for(size_t i = 0; i < rows; ++i)
+        {
+            for(size_t j = 0; j < columns; ++j)
+            {
+                arTransposed[j * rows + i] = arValues[i * columns + j];
+            }
+        }
+        return arTransposed;
+    }
+}
 
 Dataset::Dataset()
 {
 }
 
-Dataset::Dataset(const std::vector<LayerInputs> &aInputs, const std::vector<LayerOutputs> &aOutputs, const DatasetParameters &parameters)
+Dataset::Dataset(const std::vector<LayerInputs> &aInputs, const std::vector<LayerOutputs> &aOutputs, const DatasetParameters &parameters) :
+    m_size(aInputs.size())
+{
+    ASSERT(aInputs.size() == aOutputs.size());
+
+    packRows(aInputs, m_arInputs, m_numberOfInputs);
+    packRows(aOutputs, m_arOutputs, m_numberOfOutputs);
+
+    setParameters(parameters);
+}
+
+Dataset::Dataset(std::vector<LayerInputs> &&aInputs, std::vector<LayerOutputs> &&aOutputs, const DatasetParameters &parameters) :
+    m_size(aInputs.size())
 {
     ASSERT(aInputs.size() == aOutputs.size());
 
-    m_aInputs = aInputs;
-    m_aOutputs = aOutputs;
+    packRows(aInputs, m_arInputs, m_numberOfInputs, &aInputs);
+    packRows(aOutputs, m_arOutputs, m_numberOfOutputs, &aOutputs);
+    aInputs.clear();
+    aOutputs.clear();
+
+    setParameters(parameters);
+}
+
+Dataset::Dataset(size_t numberOfInputs, size_t numberOfOutputs, std::vector<real> &&arInputs, std::vector<real> &&arOutputs,
+    const DatasetParameters &parameters, DatasetLayout eLayout) :
+    m_eLayout(eLayout),
+    m_numberOfInputs(numberOfInputs),
+    m_numberOfOutputs(numberOfOutputs),
+    m_size(numberOfInputs > 0 ? arInputs.size() / numberOfInputs : 0),
+    m_arInputs(std::move(arInputs)),
+    m_arOutputs(std::move(arOutputs))
+{
+    ASSERT(m_arInputs.size() == m_size * m_numberOfInputs && m_arOutputs.size() == m_size * m_numberOfOutputs);
+
+    setParameters(parameters);
+}
+
+Dataset::Dataset(size_t numberOfInputs, size_t numberOfOutputs, Span<const real> arInputs, Span<const real> arOutputs,
+    const DatasetParameters &parameters, DatasetLayout eLayout) :
+    Dataset(numberOfInputs, numberOfOutputs, arInputs.vector(), arOutputs.vector(), parameters, eLayout)
+{
+
+}
 
+void Dataset::setParameters(const DatasetParameters &parameters)
+{
     if(parameters.filled() == true)
     {
         m_inputsMin = parameters.inputsMin;
@@ -33,6 +122,27 @@ Dataset::Dataset(const std::vector<LayerInputs> &aInputs, const std::vector<Laye
     }
 }
 
+void Dataset::setLayout(DatasetLayout eLayout)
+{
+    if(eLayout == m_eLayout)
+    {
+        return;
+    }
+
+    if(eLayout == DatasetLayout::ColumnMajor)
+    {
+        m_arInputs = transpose(m_arInputs, m_size, m_numberOfInputs);
+        m_arOutputs = transpose(m_arOutputs, m_size, m_numberOfOutputs);
+    }
+    else
+    {
+        m_arInputs = transpose(m_arInputs, m_numberOfInputs, m_size);
+        m_arOutputs = transpose(m_arOutputs, m_numberOfOutputs, m_size);
+    }
+
+    m_eLayout = eLayout;
+}
+
 void Dataset::normalise()
 {
     ASSERT(size() > 0);
@@ -42,8 +152,8 @@ void Dataset::normalise()
     real rOutputsMin = 0.0;
     real rOutputsMax = 1.0;
 
-    const size_t inputSize = m_aInputs[0].size();
-    const size_t outputSize = m_aOutputs[0].size();
+    const size_t inputSize = m_numberOfInputs;
+    const size_t outputSize = m_numberOfOutputs;
 
     // Precompute normalization data
     LayerOutputs aDenormalizedInputsDiff(inputSize);
@@ -65,39 +175,53 @@ void Dataset::normalise()
     {
         for(size_t j = 0; j < inputSize; ++j)
         {
-            m_aInputs[i][j] = (m_aInputs[i][j] - m_inputsMin[j]) * aDenormalizedInputsDiff[j] * aNormalizedInputsDiff + rInputsMin;
+            real &rValue = m_arInputs[index(i, j, inputSize)];
+            rValue = (rValue - m_inputsMin[j]) * aDenormalizedInputsDiff[j] * aNormalizedInputsDiff + rInputsMin;
         }
         for(size_t j = 0; j < outputSize; ++j)
         {
-            m_aOutputs[i][j] = (m_aOutputs[i][j] - m_outputsMin[j]) * aDenormalizedOutputsDiff[j] * aNormalizedOutputsDiff + rOutputsMin;
+            real &rValue = m_arOutputs[index(i, j, outputSize)];
+            rValue = (rValue - m_outputsMin[j]) * aDenormalizedOutputsDiff[j] * aNormalizedOutputsDiff + rOutputsMin;
         }
     }
 }
 
 void Dataset::standardise()
 {
-    const size_t inputSize = m_aInputs[0].size();
-    const size_t outputSize = m_aOutputs[0].size();
+    const size_t inputSize = m_numberOfInputs;
+    const size_t outputSize = m_numberOfOutputs;
 
     for(size_t i = 0; i < size(); ++i)
     {
         for(size_t j = 0; j < inputSize; ++j)
         {
-            m_aInputs[i][j] = (m_aInputs[i][j] - m_inputsMean[j]) / m_inputsStandardDeviation[j];
+            real &rValue = m_arInputs[index(i, j, inputSize)];
+            rValue = (rValue - m_inputsMean[j]) / m_inputsStandardDeviation[j];
         }
         for(size_t j = 0; j < outputSize; ++j)
         {
-            m_aOutputs[i][j] = (m_aOutputs[i][j] - m_outputsMean[j]) / m_outputsStandardDeviation[j];
+            real &rValue = m_arOutputs[index(i, j, outputSize)];
+            rValue = (rValue - m_outputsMean[j]) / m_outputsStandardDeviation[j];
         }
     }
 }
 
 void Dataset::addData(const LayerInputs &aInputs, const LayerOutputs &aOutputs)
 {
-    ASSERT(m_aInputs.size() == 0 || (m_aInputs[0].size() == aInputs.size() && m_aOutputs[0].size() == aOutputs.size()));
+    ASSERT(m_eLayout == DatasetLayout::RowMajor);
+    ASSERT(size() == 0 || (m_numberOfInputs == aInputs.size() && m_numberOfOutputs == aOutputs.size()));
 
-    m_aInputs.push_back(aInputs);
-    m_aOutputs.push_back(aOutputs);
+    if(size() == 0)
+    {
+        m_numberOfInputs = aInputs.size();
+        m_numberOfOutputs = aOutputs.size();
+        m_inputsMin = m_inputsMax = aInputs;
+        m_outputsMin = m_outputsMax = aOutputs;
+    }
+
+    m_arInputs.insert(m_arInputs.end(), aInputs.begin(), aInputs.end());
+    m_arOutputs.insert(m_arOutputs.end(), aOutputs.begin(), aOutputs.end());
+    ++m_size;
 
     // Update min/max
     for(size_t i = 0; i < aInputs.size(); ++i)
@@ -124,10 +248,16 @@ void Dataset::addData(const LayerInputs &aInputs, const LayerOutputs &aOutputs)
     }
 }
 
+/*
+ * Text format: number of inputs and outputs, then the
+ * values of each sample, a truncated last sample is dropped
+ */
 void Dataset::loadFile(const std::string &strDatasetPath)
 {
-    m_aInputs.clear();
-    m_aOutputs.clear();
+    m_eLayout = DatasetLayout::RowMajor;
+    m_arInputs.clear();
+    m_arOutputs.clear();
+    m_size = 0;
 
     std::ifstream loadFile;
     loadFile.open(strDatasetPath);
@@ -137,34 +267,28 @@ void Dataset::loadFile(const std::string &strDatasetPath)
         size_t inputsSize, outputsSize;
         if(loadFile >> inputsSize >> outputsSize)
         {
-            bool bLoadingFinished = true;
-            while(bLoadingFinished == true)
+            m_numberOfInputs = inputsSize;
+            m_numberOfOutputs = outputsSize;
+
+            LayerInputs sample(inputsSize + outputsSize);
+            bool bLoadingFinished = false;
+            while(bLoadingFinished == false)
             {
-                LayerInputs inputs(inputsSize);
-                for(size_t i = 0; i < inputsSize; ++i)
+                for(size_t i = 0; i < sample.size(); ++i)
                 {
-                    real rValue;
-                    if(!(loadFile >> rValue))
+                    if(!(loadFile >> sample[i]))
                     {
-                        bLoadingFinished = false;
+                        bLoadingFinished = true;
                         break;
                     }
-                    inputs.push_back(rValue);
                 }
-                m_aInputs.push_back(inputs);
 
-                LayerOutputs outputs(outputsSize);
-                for(size_t i = 0; i < outputsSize; ++i)
+                if(bLoadingFinished == false)
                 {
-                    real rValue;
-                    if(!(loadFile >> rValue))
-                    {
-                        bLoadingFinished = false;
-                        break;
-                    }
-                    outputs.push_back(rValue);
+                    m_arInputs.insert(m_arInputs.end(), sample.begin(), sample.begin() + inputsSize);
+                    m_arOutputs.insert(m_arOutputs.end(), sample.begin() + inputsSize, sample.end());
+                    ++m_size;
                 }
-                m_aOutputs.push_back(outputs);
             }
         }
         loadFile.close();
@@ -175,52 +299,134 @@ void Dataset::loadFile(const std::string &strDatasetPath)
 
 void Dataset::writeFile(const std::string &strDatasetPath) const
 {
-    if(m_aInputs.size() > 0 || m_aOutputs.size() > 0)
+    if(size() > 0)
     {
         std::ofstream saveFile;
         saveFile.open(strDatasetPath);
 
         if(saveFile.is_open() == true)
         {
-            size_t    inputsSize = (m_aInputs.size() > 0) ? m_aInputs[0].size() : 0,
-                    outputsSize = (m_aOutputs.size() > 0) ? m_aOutputs[0].size() : 0;
-            saveFile << inputsSize << outputsSize;
+            saveFile.precision(17);
+            saveFile << m_numberOfInputs << ' ' << m_numberOfOutputs << '\n';
 
-            size_t maxIndex = (inputsSize > outputsSize) ? inputsSize : outputsSize;
-            for(size_t i = 0; i < maxIndex; ++i)
+            for(size_t i = 0; i < size(); ++i)
             {
-                if(m_aInputs.size() > i)
+                for(const real rValue : inputs(i))
                 {
-                    for(size_t j = 0; j < inputsSize; ++j)
-                    {
-                        saveFile << m_aInputs[i][j];
-                    }
+                    saveFile << rValue << ' ';
                 }
-                if(m_aOutputs.size() > i)
+                for(const real rValue : outputs(i))
                 {
-                    for(size_t j = 0; j < outputsSize; ++j)
-                    {
-                        saveFile << m_aOutputs[i][j];
-                    }
+                    saveFile << rValue << ' ';
                 }
+                saveFile << '\n';
             }
         }
         saveFile.close();
     }
 }
 
+bool Dataset::loadBinaryFile(const std::string &strDatasetPath)
+{
+    m_eLayout = DatasetLayout::RowMajor;
+    m_arInputs.clear();
+    m_arOutputs.clear();
+    m_size = 0;
+
+    std::ifstream loadFile(strDatasetPath, std::ios::binary);
+
+    uint32_t uiMagic = 0;
+    uint32_t uiVersion = 0;
+    uint32_t uiRealSize = 0;
+    uint64_t numberOfInputs = 0;
+    uint64_t numberOfOutputs = 0;
+    uint64_t numberOfSamples = 0;
+    if(Serialisation::read(loadFile, uiMagic) == false || uiMagic != s_uiMagic ||
+        Serialisation::read(loadFile, uiVersion) == false || uiVersion != s_uiVersion ||
+        Serialisation::read(loadFile, uiRealSize) == false || uiRealSize != sizeof(real) ||
+        Serialisation::read(loadFile, numberOfInputs) == false ||
+        Serialisation::read(loadFile, numberOfOutputs) == false ||
+        Serialisation::read(loadFile, numberOfSamples) == false)
+    {
+        return false;
+    }
+
+    // The samples announced by the header must be in the file
+    // (a corrupt header must not trigger a huge allocation)
+    const std::streamoff dataOffset = loadFile.tellg();
+    loadFile.seekg(0, std::ios::end);
+    const uint64_t dataBytes = static_cast<uint64_t>(loadFile.tellg() - dataOffset);
+    loadFile.seekg(dataOffset);
+    if(numberOfInputs == 0 || numberOfInputs > dataBytes || numberOfOutputs > dataBytes ||
+        numberOfSamples > dataBytes / ((numberOfInputs + numberOfOutputs) * sizeof(real)))
+    {
+        return false;
+    }
+
+    m_numberOfInputs = numberOfInputs;
+    m_numberOfOutputs = numberOfOutputs;
+    m_arInputs.resize(numberOfSamples * numberOfInputs);
+    m_arOutputs.resize(numberOfSamples * numberOfOutputs);
+
+    for(size_t i = 0; i < numberOfSamples; ++i)
+    {
+        if(loadFile.read(reinterpret_cast<char *>(m_arInputs.data() + i * numberOfInputs), static_cast<std::streamsize>(numberOfInputs * sizeof(real))).fail() == true ||
+            loadFile.read(reinterpret_cast<char *>(m_arOutputs.data() + i * numberOfOutputs), static_cast<std::streamsize>(numberOfOutputs * sizeof(real))).fail() == true)
+        {
+            m_arInputs.clear();
+            m_arOutputs.clear();
+            return false;
+        }
+    }
+
+    m_size = numberOfSamples;
+    computeStatistics();
+
+    return true;
+}
+
+bool Dataset::writeBinaryFile(const std::string &strDatasetPath) const
+{
+    DatasetWriter writer(strDatasetPath, m_numberOfInputs, m_numberOfOutputs);
+
+    if(m_eLayout == DatasetLayout::RowMajor)
+    {
+        if(writer.write(m_arInputs.data(), m_arOutputs.data(), size()) == false)
+        {
+            return false;
+        }
+    }
+    else
+    {
+        for(size_t i = 0; i < size(); ++i)
+        {
+            if(writer.write(inputs(i).vector().data(), outputs(i).vector().data(), 1) == false)
+            {
+                return false;
+            }
+        }
+    }
+
+    return writer.close();
+}
+
 void Dataset::computeStatistics()
 {
-    m_inputsMin = m_aInputs[0];
+    if(size() == 0)
+    {
+        return;
+    }
+
+    const size_t inputSize = m_numberOfInputs;
+    const size_t outputSize = m_numberOfOutputs;
+
+    m_inputsMin = inputs(0).vector();
     m_inputsMax = m_inputsMin;
-    m_outputsMin = m_aOutputs[0];
+    m_outputsMin = outputs(0).vector();
     m_outputsMax = m_outputsMin;
 
-    const size_t inputSize = m_aInputs[0].size();
-    const size_t outputSize = m_aOutputs[0].size();
-
-    m_inputsMean = m_aInputs[0];
-    m_outputsMean = m_aOutputs[0];
+    m_inputsMean = m_inputsMin;
+    m_outputsMean = m_outputsMin;
     m_inputsStandardDeviation = LayerInputs(inputSize, 0.0);
     m_outputsStandardDeviation = LayerInputs(outputSize, 0.0);
 
@@ -230,31 +436,33 @@ void Dataset::computeStatistics()
         // Inputs
         for(size_t j = 0; j < inputSize; ++j)
         {
-            if(m_aInputs[i][j] < m_inputsMin[j])
+            const real rValue = m_arInputs[index(i, j, inputSize)];
+            if(rValue < m_inputsMin[j])
             {
-                m_inputsMin[j] = m_aInputs[i][j];
+                m_inputsMin[j] = rValue;
             }
-            else if(m_aInputs[i][j] > m_inputsMax[j])
+            else if(rValue > m_inputsMax[j])
             {
-                m_inputsMax[j] = m_aInputs[i][j];
+                m_inputsMax[j] = rValue;
             }
 
-            m_inputsMean[j] += m_aInputs[i][j];
+            m_inputsMean[j] += rValue;
         }
 
         // Outputs
         for(size_t j = 0; j < outputSize; ++j)
         {
-            if(m_aOutputs[i][j] < m_outputsMin[j])
+            const real rValue = m_arOutputs[index(i, j, outputSize)];
+            if(rValue < m_outputsMin[j])
             {
-                m_outputsMin[j] = m_aOutputs[i][j];
+                m_outputsMin[j] = rValue;
             }
-            else if(m_aOutputs[i][j] > m_outputsMax[j])
+            else if(rValue > m_outputsMax[j])
             {
-                m_outputsMax[j] = m_aOutputs[i][j];
+                m_outputsMax[j] = rValue;
             }
 
-            m_outputsMean[j] += m_aOutputs[i][j];
+            m_outputsMean[j] += rValue;
         }
     }
 
@@ -272,13 +480,13 @@ void Dataset::computeStatistics()
     {
         for(size_t j = 0; j < inputSize; ++j)
         {
-            real rDeviation = m_aInputs[i][j] - m_inputsMean[j];
+            real rDeviation = m_arInputs[index(i, j, inputSize)] - m_inputsMean[j];
             m_inputsStandardDeviation[j] += rDeviation * rDeviation;
         }
 
         for(size_t j = 0; j < outputSize; ++j)
         {
-            real rDeviation = m_aOutputs[i][j] - m_outputsMean[j];
+            real rDeviation = m_arOutputs[index(i, j, outputSize)] - m_outputsMean[j];
             m_outputsStandardDeviation[j] += rDeviation * rDeviation;
         }
     }
@@ -293,3 +501,48 @@ void Dataset::computeStatistics()
         m_outputsStandardDeviation[j] = sqrt(m_outputsStandardDeviation[j] / size());
     }
 }
+
+DatasetWriter::DatasetWriter(const std::string &strDatasetPath, size_t numberOfInputs, size_t numberOfOutputs) :
+    m_file(strDatasetPath, std::ios::binary | std::ios::trunc),
+    m_numberOfInputs(numberOfInputs),
+    m_numberOfOutputs(numberOfOutputs)
+{
+    Serialisation::write(m_file, s_uiMagic);
+    Serialisation::write(m_file, s_uiVersion);
+    Serialisation::write(m_file, static_cast<uint32_t>(sizeof(real)));
+    Serialisation::write(m_file, static_cast<uint64_t>(m_numberOfInputs));
+    Serialisation::write(m_file, static_cast<uint64_t>(m_numberOfOutputs));
+    Serialisation::write(m_file, static_cast<uint64_t>(0));
+}
+
+DatasetWriter::~DatasetWriter()
+{
+    if(m_file.is_open() == true)
+    {
+        close();
+    }
+}
+
+bool DatasetWriter::write(const real *pInputs, const real *pOutputs, size_t numberOfSamples)
+{
+    for(size_t i = 0; i < numberOfSamples; ++i)
+    {
+        m_file.write(reinterpret_cast<const char *>(pInputs + i * m_numberOfInputs), static_cast<std::streamsize>(m_numberOfInputs * sizeof(real)));
+        m_file.write(reinterpret_cast<const char *>(pOutputs + i * m_numberOfOutputs), static_cast<std::streamsize>(m_numberOfOutputs * sizeof(real)));
+    }
+
+    m_numberOfSamples += numberOfSamples;
+
+    return m_file.good();
+}
+
+bool DatasetWriter::close()
+{
+    m_file.seekp(s_numberOfSamplesOffset);
+    Serialisation::write(m_file, static_cast<uint64_t>(m_numberOfSamples));
+
+    const bool bGood = m_file.good();
+    m_file.close();
+
+    return bGood && m_file.good();
+}
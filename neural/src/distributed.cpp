@@ -0,0 +1,661 @@
+#include "neural/distributed.h"
+
+#include "neural/assert.h"
+#include "neural/multilayer_perceptron.h"
+
+#include <algorithm>
+
+#ifdef __linux__
+    #include <arpa/inet.h>
+    #include <cerrno>
+    #include <cstring>
+    #include <fcntl.h>
+    #include <netinet/in.h>
+    #include <netinet/tcp.h>
+    #include <poll.h>
+    #include <sys/socket.h>
+    #include <sys/un.h>
+    #include <unistd.h>
+#endif
+
+namespace
+{
+    // Between two connection attempts to a worker not listening yet
+    const std::chrono::milliseconds s_retryDelay(10);
+
+#ifdef __linux__
+    bool sendAll(int socket, const void *pData, size_t bytes)
+    {
+        const char *pBytes = static_cast<const char *>(pData);
+        while(bytes > 0)
+        {
+            const ssize_t sent = ::send(socket, pBytes, bytes, MSG_NOSIGNAL);
+            if(sent < 0 && errno == EINTR)
+            {
+                continue;
+            }
+            if(sent <= 0)
+            {
+                return false;
+            }
+            pBytes += sent;
+            bytes -= static_cast<size_t>(sent);
+        }
+        return true;
+    }
+
+    bool receiveAll(int socket, void *pData, size_t bytes)
+    {
+        char *pBytes = static_cast<char *>(pData);
+        while(bytes > 0)
+        {
+            const ssize_t received = ::recv(socket, pBytes, bytes, 0);
+            if(received < 0 && errno == EINTR)
+            {
+                continue;
+            }
+            if(received <= 0)
+            {
+                return false;
+            }
+            pBytes += received;
+            bytes -= static_cast<size_t>(received);
+        }
+        return true;
+    }
+
+    // Non-blocking, without Nagle delays on TCP
+    void configureSocket(int socket, DistributedTransport eTransport)
+    {
+        if(eTransport == DistributedTransport::Tcp)
+        {
+            const int noDelay = 1;
+            setsockopt(socket, IPPROTO_TCP, TCP_NODELAY, &noDelay, sizeof(noDelay));
+        }
+        fcntl(socket, F_SETFL, fcntl(socket, F_GETFL, 0) | O_NONBLOCK);
+    }
+#endif
+}
+
+RingAllReduce::RingAllReduce(const DistributedParameters &parameters) :
+    m_rank(parameters.rank),
+    m_numberOfWorkers(std::max<size_t>(parameters.numberOfWorkers, 1)),
+    m_eTransport(parameters.eTransport),
+    m_strHost(parameters.strHost),
+    m_basePort(parameters.basePort),
+    m_strSocketPath(parameters.strSocketPath),
+    m_timeout(parameters.timeout)
+{
+    ASSERT(m_rank < m_numberOfWorkers);
+}
+
+RingAllReduce::~RingAllReduce()
+{
+    close();
+}
+
+/*
+ * Listen, connect to the next worker (retried until it listens),
+ * then accept the previous one. Each connection starts with the
+ * rank of the connecting worker, so that misconfigured rings fail
+ * here rather than in a reduction.
+ */
+bool RingAllReduce::connect()
+{
+    if(m_numberOfWorkers <= 1)
+    {
+        return true;
+    }
+
+#ifdef __linux__
+    const size_t next = (m_rank + 1) % m_numberOfWorkers;
+    const size_t previous = (m_rank + m_numberOfWorkers - 1) % m_numberOfWorkers;
+    const std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now() + m_timeout;
+
+    m_listenSocket = listen();
+    if(m_listenSocket < 0)
+    {
+        return false;
+    }
+
+    while((m_nextSocket = connectTo(next)) < 0)
+    {
+        if(std::chrono::steady_clock::now() > deadline)
+        {
+            close();
+            return false;
+        }
+        std::this_thread::sleep_for(s_retryDelay);
+    }
+
+    const uint64_t rank = m_rank;
+    if(sendAll(m_nextSocket, &rank, sizeof(rank)) == false)
+    {
+        close();
+        return false;
+    }
+
+    const std::chrono::milliseconds remaining = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now());
+    pollfd listenPoll = {m_listenSocket, POLLIN, 0};
+    uint64_t previousRank = 0;
+    if(poll(&listenPoll, 1, static_cast<int>(std::max<int64_t>(remaining.count(), 0))) <= 0 ||
+        (m_previousSocket = accept(m_listenSocket, nullptr, nullptr)) < 0 ||
+        receiveAll(m_previousSocket, &previousRank, sizeof(previousRank)) == false || previousRank != previous)
+    {
+        close();
+        return false;
+    }
+
+    // The ring is complete, nobody else may connect
+    ::close(m_listenSocket);
+    m_listenSocket = -1;
+    if(m_eTransport == DistributedTransport::UnixDomain)
+    {
+        unlink((m_strSocketPath + "." + std::to_string(m_rank)).c_str());
+    }
+
+    configureSocket(m_nextSocket, m_eTransport);
+    configureSocket(m_previousSocket, m_eTransport);
+
+    return true;
+#else
+    return false;
+#endif
+}
+
+void RingAllReduce::close()
+{
+#ifdef __linux__
+    if(m_listenSocket >= 0)
+    {
+        ::close(m_listenSocket);
+        if(m_eTransport == DistributedTransport::UnixDomain)
+        {
+            unlink((m_strSocketPath + "." + std::to_string(m_rank)).c_str());
+        }
+    }
+    if(m_nextSocket >= 0)
+    {
+        ::close(m_nextSocket);
+    }
+    if(m_previousSocket >= 0)
+    {
+        ::close(m_previousSocket);
+    }
+#endif
+    m_listenSocket = -1;
+    m_nextSocket = -1;
+    m_previousSocket = -1;
+}
+
+/*
+ * Chunk c of the buffer is [c n / N, (c + 1) n / N).
+ * Reduce-scatter step s: send chunk r - s, add the received
+ * chunk r - s - 1, worker r then holds the sum of chunk r + 1.
+ * All-gather step s: send chunk r + 1 - s, receive chunk r - s.
+ */
+bool RingAllReduce::allReduce(Span<real> arValues)
+{
+    ASSERT(arValues.contiguous() == true);
+
+    const size_t numberOfWorkers = m_numberOfWorkers;
+    if(numberOfWorkers <= 1)
+    {
+        return true;
+    }
+    if(m_nextSocket < 0 || m_previousSocket < 0)
+    {
+        return false;
+    }
+
+    real *pValues = arValues.data();
+    const size_t count = arValues.size();
+    const auto chunkBegin = [&](size_t chunk){return chunk * count / numberOfWorkers;};
+    const auto chunkSize = [&](size_t chunk){return chunkBegin(chunk + 1) - chunkBegin(chunk);};
+
+    m_arReceived.resize(count / numberOfWorkers + 1);
+
+    for(size_t s = 0; s + 1 < numberOfWorkers; ++s)
+    {
+        const size_t sendChunk = (m_rank + numberOfWorkers - s) % numberOfWorkers;
+        const size_t receiveChunk = (m_rank + numberOfWorkers - s - 1) % numberOfWorkers;
+
+        if(exchange(pValues + chunkBegin(sendChunk), chunkSize(sendChunk), m_arReceived.data(), chunkSize(receiveChunk)) == false)
+        {
+            return false;
+        }
+
+        real *pChunk = pValues + chunkBegin(receiveChunk);
+        for(size_t i = 0; i < chunkSize(receiveChunk); ++i)
+        {
+            pChunk[i] += m_arReceived[i];
+        }
+    }
+
+    for(size_t s = 0; s + 1 < numberOfWorkers; ++s)
+    {
+        const size_t sendChunk = (m_rank + 1 + numberOfWorkers - s) % numberOfWorkers;
+        const size_t receiveChunk = (m_rank + numberOfWorkers - s) % numberOfWorkers;
+
+        if(exchange(pValues + chunkBegin(sendChunk), chunkSize(sendChunk), pValues + chunkBegin(receiveChunk), chunkSize(receiveChunk)) == false)
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+int RingAllReduce::listen() const
+{
+#ifdef __linux__
+    int listenSocket = -1;
+
+    if(m_eTransport == DistributedTransport::Tcp)
+    {
+        sockaddr_in address = {};
+        address.sin_family = AF_INET;
+        address.sin_port = htons(static_cast<uint16_t>(m_basePort + m_rank));
+        if(inet_pton(AF_INET, m_strHost.c_str(), &address.sin_addr) != 1 ||
+            (listenSocket = socket(AF_INET, SOCK_STREAM, 0)) < 0)
+        {
+            return -1;
+        }
+
+        const int reuseAddress = 1;
+        setsockopt(listenSocket, SOL_SOCKET, SO_REUSEADDR, &reuseAddress, sizeof(reuseAddress));
+
+        if(bind(listenSocket, reinterpret_cast<const sockaddr *>(&address), sizeof(address)) < 0)
+        {
+            ::close(listenSocket);
+            return -1;
+        }
+    }
+    else
+    {
+        const std::string strPath = m_strSocketPath + "." + std::to_string(m_rank);
+        sockaddr_un address = {};
+        address.sun_family = AF_UNIX;
+        if(strPath.size() >= sizeof(address.sun_path) || (listenSocket = socket(AF_UNIX, SOCK_STREAM, 0)) < 0)
+        {
+            return -1;
+        }
+        std::strcpy(address.sun_path, strPath.c_str());
+
+        // Left over by a previous run
+        unlink(strPath.c_str());
+
+        if(bind(listenSocket, reinterpret_cast<const sockaddr *>(&address), sizeof(address)) < 0)
+        {
+            ::close(listenSocket);
+            return -1;
+        }
+    }
+
+    if(::listen(listenSocket, 1) < 0)
+    {
+        ::close(listenSocket);
+        return -1;
+    }
+
+    return listenSocket;
+#else
+    return -1;
+#endif
+}
+
+int RingAllReduce::connectTo(size_t rank) const
+{
+#ifdef __linux__
+    int connectedSocket = -1;
+    int result = -1;
+
+    if(m_eTransport == DistributedTransport::Tcp)
+    {
+        sockaddr_in address = {};
+        address.sin_family = AF_INET;
+        address.sin_port = htons(static_cast<uint16_t>(m_basePort + rank));
+        if(inet_pton(AF_INET, m_strHost.c_str(), &address.sin_addr) != 1 ||
+            (connectedSocket = socket(AF_INET, SOCK_STREAM, 0)) < 0)
+        {
+            return -1;
+        }
+        result = ::connect(connectedSocket, reinterpret_cast<const sockaddr *>(&address), sizeof(address));
+    }
+    else
+    {
+        const std::string strPath = m_strSocketPath + "." + std::to_string(rank);
+        sockaddr_un address = {};
+        address.sun_family = AF_UNIX;
+        if(strPath.size() >= sizeof(address.sun_path) || (connectedSocket = socket(AF_UNIX, SOCK_STREAM, 0)) < 0)
+        {
+            return -1;
+        }
+        std::strcpy(address.sun_path, strPath.c_str());
+        result = ::connect(connectedSocket, reinterpret_cast<const sockaddr *>(&address), sizeof(address));
+    }
+
+    if(result < 0)
+    {
+        ::close(connectedSocket);
+        return -1;
+    }
+
+    return connectedSocket;
+#else
+    (void)rank;
+    return -1;
+#endif
+}
+
+/*
+ * Send sendCount values to the next worker while receiving
+ * receiveCount values from the previous one
+ */
+bool RingAllReduce::exchange(const real *pSend, size_t sendCount, real *pReceive, size_t receiveCount)
+{
+#ifdef __linux__
+    const char *pSendBytes = reinterpret_cast<const char *>(pSend);
+    char *pReceiveBytes = reinterpret_cast<char *>(pReceive);
+    const size_t sendBytes = sendCount * sizeof(real);
+    const size_t receiveBytes = receiveCount * sizeof(real);
+    size_t sent = 0;
+    size_t received = 0;
+
+    while(sent < sendBytes || received < receiveBytes)
+    {
+        pollfd aPolls[2];
+        nfds_t numberOfPolls = 0;
+        if(sent < sendBytes)
+        {
+            aPolls[numberOfPolls++] = {m_nextSocket, POLLOUT, 0};
+        }
+        if(received < receiveBytes)
+        {
+            aPolls[numberOfPolls++] = {m_previousSocket, POLLIN, 0};
+        }
+
+        const int ready = poll(aPolls, numberOfPolls, static_cast<int>(m_timeout.count()));
+        if(ready < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if(ready <= 0)
+        {
+            return false;
+        }
+
+        for(nfds_t i = 0; i < numberOfPolls; ++i)
+        {
+            if(aPolls[i].revents == 0)
+            {
+                continue;
+            }
+
+            if(aPolls[i].fd == m_nextSocket)
+            {
+                const ssize_t bytes = ::send(m_nextSocket, pSendBytes + sent, sendBytes - sent, MSG_NOSIGNAL);
+                if(bytes < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+                {
+                    return false;
+                }
+                sent += bytes > 0 ? static_cast<size_t>(bytes) : 0;
+            }
+            else
+            {
+                const ssize_t bytes = ::recv(m_previousSocket, pReceiveBytes + received, receiveBytes - received, 0);
+                if(bytes == 0 || (bytes < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR))
+                {
+                    return false;
+                }
+                received += bytes > 0 ? static_cast<size_t>(bytes) : 0;
+            }
+        }
+    }
+
+    return true;
+#else
+    (void)pSend;
+    (void)sendCount;
+    (void)pReceive;
+    (void)receiveCount;
+    return false;
+#endif
+}
+
+ParameterAverager::ParameterAverager(const DistributedParameters &parameters) :
+    m_ring(parameters),
+    m_averagingInterval(std::max<size_t>(parameters.averagingInterval, 1))
+{
+    // Until connected
+    m_bFailed = numberOfWorkers() > 1;
+}
+
+ParameterAverager::~ParameterAverager()
+{
+    if(m_thread.joinable() == true)
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_bStop = true;
+        }
+        m_condition.notify_all();
+        m_thread.join();
+    }
+}
+
+bool ParameterAverager::connect()
+{
+    if(m_ring.connect() == false)
+    {
+        return false;
+    }
+
+    if(numberOfWorkers() > 1 && m_thread.joinable() == false)
+    {
+        m_thread = std::thread(&ParameterAverager::run, this);
+    }
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_bFailed = false;
+
+    return true;
+}
+
+void ParameterAverager::shard(size_t count, size_t &begin, size_t &end) const
+{
+    begin = rank() * count / numberOfWorkers();
+    end = (rank() + 1) * count / numberOfWorkers();
+}
+
+bool ParameterAverager::broadcast(MultilayerPerceptron &multilayerPerceptron)
+{
+    std::vector<real> arValues;
+    return broadcast(multilayerPerceptron, arValues);
+}
+
+/*
+ * Sum of the weights of worker 0 and of zeros,
+ * the values are sent after the weights
+ */
+bool ParameterAverager::broadcast(MultilayerPerceptron &multilayerPerceptron, std::vector<real> &arValues)
+{
+    if(numberOfWorkers() <= 1)
+    {
+        return true;
+    }
+
+    if(m_bInFlight == true)
+    {
+        waitReduction();
+    }
+
+    if(failed() == true)
+    {
+        return false;
+    }
+
+    const size_t numberOfParameters = multilayerPerceptron.numberOfParameters();
+    m_arReduced.resize(numberOfParameters + arValues.size());
+    if(rank() == 0)
+    {
+        multilayerPerceptron.exportParameters(Span<real>(m_arReduced.data(), numberOfParameters));
+        std::copy(arValues.begin(), arValues.end(), m_arReduced.begin() + numberOfParameters);
+    }
+    else
+    {
+        std::fill(m_arReduced.begin(), m_arReduced.end(), 0.0);
+    }
+
+    startReduction();
+    if(waitReduction() == false)
+    {
+        return false;
+    }
+
+    multilayerPerceptron.importParameters(Span<const real>(m_arReduced.data(), numberOfParameters));
+    std::copy(m_arReduced.begin() + numberOfParameters, m_arReduced.end(), arValues.begin());
+    m_step = 0;
+
+    return true;
+}
+
+/*
+ * Every averagingInterval steps: apply the average reduced
+ * since the previous averaging, then reduce a new snapshot
+ */
+void ParameterAverager::step(MultilayerPerceptron &multilayerPerceptron)
+{
+    if(numberOfWorkers() <= 1 || ++m_step < m_averagingInterval)
+    {
+        return;
+    }
+    m_step = 0;
+
+    if(m_bInFlight == true && waitReduction() == true)
+    {
+        applyReduction(multilayerPerceptron);
+    }
+
+    if(failed() == true)
+    {
+        return;
+    }
+
+    m_arSnapshot.resize(multilayerPerceptron.numberOfParameters());
+    multilayerPerceptron.exportParameters(m_arSnapshot);
+    m_arReduced = m_arSnapshot;
+
+    startReduction();
+}
+
+/*
+ * Average of the current weights, the pending
+ * reduction (if any) is applied first
+ */
+bool ParameterAverager::synchronise(MultilayerPerceptron &multilayerPerceptron)
+{
+    if(numberOfWorkers() <= 1)
+    {
+        return true;
+    }
+
+    if(m_bInFlight == true && waitReduction() == true)
+    {
+        applyReduction(multilayerPerceptron);
+    }
+    m_step = 0;
+
+    if(failed() == true)
+    {
+        return false;
+    }
+
+    m_arReduced.resize(multilayerPerceptron.numberOfParameters());
+    multilayerPerceptron.exportParameters(m_arReduced);
+
+    startReduction();
+    if(waitReduction() == false)
+    {
+        return false;
+    }
+
+    const real rScale = 1.0 / static_cast<real>(numberOfWorkers());
+    for(size_t i = 0; i < m_arReduced.size(); ++i)
+    {
+        m_arReduced[i] *= rScale;
+    }
+    multilayerPerceptron.importParameters(m_arReduced);
+
+    return true;
+}
+
+bool ParameterAverager::failed() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_bFailed;
+}
+
+void ParameterAverager::run()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while(true)
+    {
+        m_condition.wait(lock, [this]{return m_bPending == true || m_bStop == true;});
+
+        if(m_bPending == true)
+        {
+            m_bPending = false;
+            m_bReducing = true;
+
+            lock.unlock();
+            const bool bReduced = m_ring.allReduce(m_arReduced);
+            lock.lock();
+
+            m_bReducing = false;
+            m_bFailed = m_bFailed || bReduced == false;
+            m_condition.notify_all();
+        }
+        else if(m_bStop == true)
+        {
+            break;
+        }
+    }
+}
+
+// m_arReduced belongs to the communication thread until waitReduction returns
+void ParameterAverager::startReduction()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_bPending = true;
+    }
+    m_condition.notify_all();
+    m_bInFlight = true;
+}
+
+bool ParameterAverager::waitReduction()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_condition.wait(lock, [this]{return m_bPending == false && m_bReducing == false;});
+    m_bInFlight = false;
+
+    return m_bFailed == false;
+}
+
+/*
+ * w = mean + (w - snapshot): the steps made since the
+ * snapshot are kept on top of the average
+ */
+void ParameterAverager::applyReduction(MultilayerPerceptron &multilayerPerceptron)
+{
+    const real rScale = 1.0 / static_cast<real>(numberOfWorkers());
+
+    m_arCurrent.resize(m_arSnapshot.size());
+    multilayerPerceptron.exportParameters(m_arCurrent);
+    for(size_t i = 0; i < m_arCurrent.size(); ++i)
+    {
+        m_arCurrent[i] += m_arReduced[i] * rScale - m_arSnapshot[i];
+    }
+    multilayerPerceptron.importParameters(m_arCurrent);
+}
@@ -0,0 +1,195 @@
+#include "neural/ensemble.h"
+
+#include "neural/assert.h"
+#include "neural/dataset.h"
+#include "neural/gemm.h"
+#include "neural/thread_pool.h"
+#include "neural/trainer.h"
+
+#include <algorithm>
+#include <string>
+
+Ensemble::Ensemble(std::vector<MultilayerPerceptron> aModels, const EnsembleParameters &parameters) :
+    m_aModels(std::move(aModels)),
+    m_eAggregation(parameters.eAggregation),
+    m_arWeights(parameters.arWeights),
+    m_arErrors(m_aModels.size(), 0.0),
+    m_aaModelOutputs(m_aModels.size()),
+    m_aarActivations(m_aModels.size()),
+    m_aarLayerInputs(m_aModels.size())
+{
+    ASSERT(m_aModels.empty() == false);
+    ASSERT(m_eAggregation != EnsembleAggregation::WeightedMean || m_arWeights.size() == m_aModels.size());
+
+    for(size_t k = 0; k < m_aModels.size(); ++k)
+    {
+        ASSERT(m_aModels[k].numberOfInputs() == numberOfInputs() && m_aModels[k].numberOfOutputs() == numberOfOutputs());
+    }
+
+    update();
+}
+
+const LayerOutputs &Ensemble::evaluate(const real *pInputs, size_t batchSize)
+{
+    if(m_bStacked == true)
+    {
+        // Weighted sums of all the first Layers: Z = X * W^T
+        const size_t stackedSize = m_aStackedOffsets.back();
+        m_arStackedActivations.resize(batchSize * stackedSize);
+
+        gemm(Transpose::No, Transpose::Yes, batchSize, stackedSize, numberOfInputs(),
+            1.0, pInputs, numberOfInputs(),
+            m_arStackedWeights.data(), numberOfInputs(),
+            0.0, m_arStackedActivations.data(), stackedSize);
+    }
+
+    ThreadPool::global().parallelFor(m_aModels.size(), [&](size_t k)
+    {
+        evaluateModel(k, pInputs, batchSize);
+    });
+
+    aggregate(batchSize);
+
+    return m_arOutputs;
+}
+
+void Ensemble::train(const TrainingParameters &parameters, const Dataset &dataset)
+{
+    ThreadPool::global().parallelFor(m_aModels.size(), [&](size_t k)
+    {
+        TrainingParameters modelParameters = parameters;
+        modelParameters.shuffleSeed = parameters.shuffleSeed + k;
+        if(parameters.strCheckpointPath.empty() == false)
+        {
+            modelParameters.strCheckpointPath = parameters.strCheckpointPath + "." + std::to_string(k);
+        }
+
+        Trainer trainer(modelParameters);
+        trainer.train(m_aModels[k], dataset);
+        m_arErrors[k] = trainer.error();
+    });
+
+    update();
+}
+
+/*
+ * Models are stacked if all their first Layers are fully connected
+ */
+void Ensemble::update()
+{
+    m_bStacked = true;
+    for(size_t k = 0; k < m_aModels.size(); ++k)
+    {
+        m_bStacked = m_bStacked && m_aModels[k].layer(0).layerType() == LayerType::FullyConnected;
+    }
+
+    m_arStackedWeights.clear();
+    m_aStackedOffsets.assign(1, 0);
+
+    if(m_bStacked == false)
+    {
+        return;
+    }
+
+    for(size_t k = 0; k < m_aModels.size(); ++k)
+    {
+        const LayerWeights &aWeights = m_aModels[k].layer(0).weights();
+        m_arStackedWeights.insert(m_arStackedWeights.end(), aWeights.begin(), aWeights.end());
+        m_aStackedOffsets.push_back(m_aStackedOffsets.back() + m_aModels[k].layer(0).size());
+    }
+}
+
+/*
+ * Outputs of model k, its first Layer taken from
+ * the stacked weighted sums if any
+ */
+void Ensemble::evaluateModel(size_t k, const real *pInputs, size_t batchSize)
+{
+    MultilayerPerceptron &model = m_aModels[k];
+    LayerOutputs &aOutputs = m_aaModelOutputs[k];
+    std::vector<real> &arActivations = m_aarActivations[k];
+    std::vector<real> &arLayerInputs = m_aarLayerInputs[k];
+
+    size_t begin = 0;
+    if(m_bStacked == true)
+    {
+        // Bias and activation of the columns of model k
+        const Layer &layer = model.layer(0);
+        const ActivationFunctionPtr pfActivationFunctionPtr = activationFunctionFromType(layer.activationFunctionType());
+        const size_t stackedSize = m_aStackedOffsets.back();
+        const size_t offset = m_aStackedOffsets[k];
+
+        aOutputs.resize(batchSize * layer.size());
+        for(size_t b = 0; b < batchSize; ++b)
+        {
+            const real *pActivations = m_arStackedActivations.data() + b * stackedSize + offset;
+            real *pOutputs = aOutputs.data() + b * layer.size();
+            for(size_t i = 0; i < layer.size(); ++i)
+            {
+                pOutputs[i] = pfActivationFunctionPtr(pActivations[i] + layer.bias());
+            }
+        }
+
+        begin = 1;
+    }
+    else
+    {
+        aOutputs.assign(pInputs, pInputs + batchSize * numberOfInputs());
+    }
+
+    for(size_t i = begin; i < model.numberOfLayers(); ++i)
+    {
+        const Layer &layer = model.layer(i);
+
+        aOutputs.swap(arLayerInputs);
+        arActivations.resize(batchSize * layer.activationsSize());
+        aOutputs.resize(batchSize * layer.size());
+        layer.forward(arLayerInputs.data(), batchSize, arActivations.data(), aOutputs.data());
+    }
+
+    model.lossFunction().transform(aOutputs.data(), batchSize, numberOfOutputs());
+}
+
+void Ensemble::aggregate(size_t batchSize)
+{
+    const size_t count = batchSize * numberOfOutputs();
+    m_arOutputs.assign(count, 0.0);
+
+    switch(m_eAggregation)
+    {
+    case EnsembleAggregation::Mean:
+    case EnsembleAggregation::WeightedMean:
+    {
+        real rTotalWeight = 0.0;
+        for(size_t k = 0; k < m_aModels.size(); ++k)
+        {
+            const real rWeight = m_eAggregation == EnsembleAggregation::Mean ? 1.0 : m_arWeights[k];
+            for(size_t i = 0; i < count; ++i)
+            {
+                m_arOutputs[i] += rWeight * m_aaModelOutputs[k][i];
+            }
+            rTotalWeight += rWeight;
+        }
+
+        for(size_t i = 0; i < count; ++i)
+        {
+            m_arOutputs[i] /= rTotalWeight;
+        }
+        break;
+    }
+    case EnsembleAggregation::Vote:
+    {
+        const real rVote = 1.0 / static_cast<real>(m_aModels.size());
+        for(size_t k = 0; k < m_aModels.size(); ++k)
+        {
+            for(size_t b = 0; b < batchSize; ++b)
+            {
+                const real *pOutputs = m_aaModelOutputs[k].data() + b * numberOfOutputs();
+                const size_t winner = static_cast<size_t>(std::max_element(pOutputs, pOutputs + numberOfOutputs()) - pOutputs);
+                m_arOutputs[b * numberOfOutputs() + winner] += rVote;
+            }
+        }
+        break;
+    }
+    }
+}
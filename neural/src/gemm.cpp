@@ -0,0 +1,386 @@
+#include "neural/gemm.h"
+
+#include "neural/assert.h"
+#include "neural/thread_pool.h"
+
+#include <algorithm>
+#include <cstring>
+
+#ifdef NEURAL_USE_BLAS
+
+/*
+ * Fortran BLAS interface, available in every
+ * implementation (reference, OpenBLAS, MKL, ...)
+ */
+extern "C"
+{
+    void sgemm_(const char *transa, const char *transb, const int *m, const int *n, const int *k,
+        const float *alpha, const float *a, const int *lda, const float *b, const int *ldb,
+        const float *beta, float *c, const int *ldc);
+    void dgemm_(const char *transa, const char *transb, const int *m, const int *n, const int *k,
+        const double *alpha, const double *a, const int *lda, const double *b, const int *ldb,
+        const double *beta, double *c, const int *ldc);
+}
+
+namespace
+{
+    INLINE void blasGemm(const char *transa, const char *transb, const int *m, const int *n, const int *k,
+        const float *alpha, const float *a, const int *lda, const float *b, const int *ldb,
+        const float *beta, float *c, const int *ldc)
+    {
+        sgemm_(transa, transb, m, n, k, alpha, a, lda, b, ldb, beta, c, ldc);
+    }
+
+    INLINE void blasGemm(const char *transa, const char *transb, const int *m, const int *n, const int *k,
+        const double *alpha, const double *a, const int *lda, const double *b, const int *ldb,
+        const double *beta, double *c, const int *ldc)
+    {
+        dgemm_(transa, transb, m, n, k, alpha, a, lda, b, ldb, beta, c, ldc);
+    }
+}
+
+#endif // NEURAL_USE_BLAS
+
+namespace
+{
+#if defined(__GNUC__) || defined(__clang__)
+    // Generic vector matching the SIMD registers of the target
+    #if defined(__AVX512F__)
+        typedef real Vector __attribute__((vector_size(64)));
+    #elif defined(__AVX__)
+        typedef real Vector __attribute__((vector_size(32)));
+    #else
+        typedef real Vector __attribute__((vector_size(16)));
+    #endif
+    const size_t s_vectorSize = sizeof(Vector) / sizeof(real);
+#else
+    const size_t s_vectorSize = 4;
+#endif
+
+    // Register tile (micro-kernel), NR spans two vectors
+    const size_t MR = 4;
+    const size_t NR = 2 * s_vectorSize;
+
+    // Cache blocks: A block MC x KC stays in L2, B micro-panel KC x NR in L1
+    const size_t MC = 64;
+    const size_t KC = 256;
+    const size_t NC = 512;
+
+    // Below this number of multiply-adds packing does not pay off
+    const size_t s_directThreshold = 32 * 32 * 32;
+
+    // Below this number of multiply-adds threads do not pay off
+    const size_t s_parallelThreshold = 128 * 128 * 128;
+
+    INLINE real element(const real *pMatrix, size_t ld, Transpose eTranspose, size_t row, size_t column)
+    {
+        return eTranspose == Transpose::No ? pMatrix[row * ld + column] : pMatrix[column * ld + row];
+    }
+
+    void scale(size_t m, size_t n, real rBeta, real *pC, size_t ldc)
+    {
+        if(rBeta == 1.0)
+        {
+            return;
+        }
+
+        for(size_t i = 0; i < m; ++i)
+        {
+            real *pRow = pC + i * ldc;
+            if(rBeta == 0.0)
+            {
+                std::fill(pRow, pRow + n, static_cast<real>(0.0));
+            }
+            else
+            {
+                for(size_t j = 0; j < n; ++j)
+                {
+                    pRow[j] *= rBeta;
+                }
+            }
+        }
+    }
+
+    /*
+     * Unblocked product for small matrices, C already scaled by beta.
+     * Loops are ordered so that the innermost one is contiguous.
+     */
+    void directGemm(Transpose eTransposeA, Transpose eTransposeB,
+        size_t m, size_t n, size_t k,
+        real rAlpha, const real *pA, size_t lda,
+        const real *pB, size_t ldb,
+        real *pC, size_t ldc)
+    {
+        if(eTransposeB == Transpose::No)
+        {
+            // Rows of C are linear combinations of rows of B
+            for(size_t i = 0; i < m; ++i)
+            {
+                real *pRow = pC + i * ldc;
+                for(size_t p = 0; p < k; ++p)
+                {
+                    const real rA = rAlpha * element(pA, lda, eTransposeA, i, p);
+                    const real *pBRow = pB + p * ldb;
+                    for(size_t j = 0; j < n; ++j)
+                    {
+                        pRow[j] += rA * pBRow[j];
+                    }
+                }
+            }
+        }
+        else if(eTransposeA == Transpose::No)
+        {
+            // Dot products of rows of A and rows of B
+            for(size_t i = 0; i < m; ++i)
+            {
+                const real *pARow = pA + i * lda;
+                for(size_t j = 0; j < n; ++j)
+                {
+                    const real *pBRow = pB + j * ldb;
+                    real rSum = 0.0;
+                    for(size_t p = 0; p < k; ++p)
+                    {
+                        rSum += pARow[p] * pBRow[p];
+                    }
+                    pC[i * ldc + j] += rAlpha * rSum;
+                }
+            }
+        }
+        else
+        {
+            for(size_t i = 0; i < m; ++i)
+            {
+                for(size_t j = 0; j < n; ++j)
+                {
+                    real rSum = 0.0;
+                    for(size_t p = 0; p < k; ++p)
+                    {
+                        rSum += pA[p * lda + i] * pB[j * ldb + p];
+                    }
+                    pC[i * ldc + j] += rAlpha * rSum;
+                }
+            }
+        }
+    }
+
+    /*
+     * Pack a mc x kc block of op(A) into MR rows micro-panels,
+     * each stored column by column, padded with zeros
+     */
+    void packA(Transpose eTranspose, const real *pA, size_t lda, size_t ic, size_t pc, size_t mc, size_t kc, real *pPacked)
+    {
+        for(size_t ir = 0; ir < mc; ir += MR)
+        {
+            for(size_t p = 0; p < kc; ++p)
+            {
+                for(size_t r = 0; r < MR; ++r)
+                {
+                    *pPacked++ = (ir + r < mc) ? element(pA, lda, eTranspose, ic + ir + r, pc + p) : static_cast<real>(0.0);
+                }
+            }
+        }
+    }
+
+    /*
+     * Pack a kc x nc block of op(B) into NR columns micro-panels,
+     * each stored row by row, padded with zeros
+     */
+    void packB(Transpose eTranspose, const real *pB, size_t ldb, size_t pc, size_t jc, size_t kc, size_t nc, real *pPacked)
+    {
+        for(size_t jr = 0; jr < nc; jr += NR)
+        {
+            const size_t nr = std::min(NR, nc - jr);
+            for(size_t p = 0; p < kc; ++p)
+            {
+                if(eTranspose == Transpose::No && nr == NR)
+                {
+                    std::memcpy(pPacked, pB + (pc + p) * ldb + jc + jr, NR * sizeof(real));
+                    pPacked += NR;
+                }
+                else
+                {
+                    for(size_t c = 0; c < NR; ++c)
+                    {
+                        *pPacked++ = (c < nr) ? element(pB, ldb, eTranspose, pc + p, jc + jr + c) : static_cast<real>(0.0);
+                    }
+                }
+            }
+        }
+    }
+
+    /*
+     * C[mr x nr] += rAlpha * A micro-panel * B micro-panel
+     * MR x NR accumulators are kept in registers for the whole kc loop
+     */
+    void microKernel(size_t kc, const real *pA, const real *pB, real rAlpha, real *pC, size_t ldc, size_t mr, size_t nr)
+    {
+#if defined(__GNUC__) || defined(__clang__)
+        Vector aAccumulators[MR][2];
+        for(size_t r = 0; r < MR; ++r)
+        {
+            aAccumulators[r][0] = Vector{};
+            aAccumulators[r][1] = Vector{};
+        }
+
+        for(size_t p = 0; p < kc; ++p)
+        {
+            Vector b0, b1;
+            std::memcpy(&b0, pB, sizeof(Vector));
+            std::memcpy(&b1, pB + s_vectorSize, sizeof(Vector));
+
+            for(size_t r = 0; r < MR; ++r)
+            {
+                const Vector a = Vector{} + pA[r];
+                aAccumulators[r][0] += a * b0;
+                aAccumulators[r][1] += a * b1;
+            }
+
+            pA += MR;
+            pB += NR;
+        }
+
+        if(mr == MR && nr == NR)
+        {
+            for(size_t r = 0; r < MR; ++r)
+            {
+                Vector c0, c1;
+                std::memcpy(&c0, pC + r * ldc, sizeof(Vector));
+                std::memcpy(&c1, pC + r * ldc + s_vectorSize, sizeof(Vector));
+                c0 += rAlpha * aAccumulators[r][0];
+                c1 += rAlpha * aAccumulators[r][1];
+                std::memcpy(pC + r * ldc, &c0, sizeof(Vector));
+                std::memcpy(pC + r * ldc + s_vectorSize, &c1, sizeof(Vector));
+            }
+            return;
+        }
+
+        real aTile[MR][NR];
+        std::memcpy(aTile, aAccumulators, sizeof(aTile));
+#else
+        real aTile[MR][NR] = {};
+
+        for(size_t p = 0; p < kc; ++p)
+        {
+            for(size_t r = 0; r < MR; ++r)
+            {
+                for(size_t c = 0; c < NR; ++c)
+                {
+                    aTile[r][c] += pA[r] * pB[c];
+                }
+            }
+
+            pA += MR;
+            pB += NR;
+        }
+#endif
+        // Edge tile
+        for(size_t r = 0; r < mr; ++r)
+        {
+            for(size_t c = 0; c < nr; ++c)
+            {
+                pC[r * ldc + c] += rAlpha * aTile[r][c];
+            }
+        }
+    }
+
+    /*
+     * One MC x NC macro tile of C, C already scaled by beta
+     */
+    void macroTile(Transpose eTransposeA, Transpose eTransposeB,
+        size_t ic, size_t jc, size_t mc, size_t nc, size_t k,
+        real rAlpha, const real *pA, size_t lda,
+        const real *pB, size_t ldb,
+        real *pC, size_t ldc)
+    {
+        // Packing buffers, one set per thread
+        thread_local std::vector<real> t_arPackedA;
+        thread_local std::vector<real> t_arPackedB;
+        t_arPackedA.resize(MC * KC);
+        t_arPackedB.resize(KC * ((NC + NR - 1) / NR) * NR);
+
+        for(size_t pc = 0; pc < k; pc += KC)
+        {
+            const size_t kc = std::min(KC, k - pc);
+
+            packB(eTransposeB, pB, ldb, pc, jc, kc, nc, t_arPackedB.data());
+            packA(eTransposeA, pA, lda, ic, pc, mc, kc, t_arPackedA.data());
+
+            for(size_t jr = 0; jr < nc; jr += NR)
+            {
+                const real *pPackedB = t_arPackedB.data() + jr * kc;
+                for(size_t ir = 0; ir < mc; ir += MR)
+                {
+                    const real *pPackedA = t_arPackedA.data() + ir * kc;
+                    microKernel(kc, pPackedA, pPackedB, rAlpha,
+                        pC + (ic + ir) * ldc + jc + jr, ldc,
+                        std::min(MR, mc - ir), std::min(NR, nc - jr));
+                }
+            }
+        }
+    }
+}
+
+void gemm(Transpose eTransposeA, Transpose eTransposeB,
+    size_t m, size_t n, size_t k,
+    real rAlpha, const real *pA, size_t lda,
+    const real *pB, size_t ldb,
+    real rBeta, real *pC, size_t ldc)
+{
+    ASSERT(ldc >= n);
+
+    if(m == 0 || n == 0)
+    {
+        return;
+    }
+
+    const size_t multiplyAdds = m * n * k;
+
+#ifdef NEURAL_USE_BLAS
+    if(multiplyAdds > s_directThreshold)
+    {
+        // Row-major C is column-major C^T = op(B)^T * op(A)^T
+        const char transa = eTransposeB == Transpose::No ? 'N' : 'T';
+        const char transb = eTransposeA == Transpose::No ? 'N' : 'T';
+        const int iM = static_cast<int>(n), iN = static_cast<int>(m), iK = static_cast<int>(k);
+        const int iLda = static_cast<int>(ldb), iLdb = static_cast<int>(lda), iLdc = static_cast<int>(ldc);
+        blasGemm(&transa, &transb, &iM, &iN, &iK, &rAlpha, pB, &iLda, pA, &iLdb, &rBeta, pC, &iLdc);
+        return;
+    }
+#endif
+
+    scale(m, n, rBeta, pC, ldc);
+
+    if(k == 0 || rAlpha == 0.0)
+    {
+        return;
+    }
+
+    if(multiplyAdds <= s_directThreshold)
+    {
+        directGemm(eTransposeA, eTransposeB, m, n, k, rAlpha, pA, lda, pB, ldb, pC, ldc);
+        return;
+    }
+
+    const size_t rowTiles = (m + MC - 1) / MC;
+    const size_t columnTiles = (n + NC - 1) / NC;
+
+    auto computeTile = [&](size_t tileIndex)
+    {
+        const size_t ic = (tileIndex / columnTiles) * MC;
+        const size_t jc = (tileIndex % columnTiles) * NC;
+        macroTile(eTransposeA, eTransposeB, ic, jc, std::min(MC, m - ic), std::min(NC, n - jc), k,
+            rAlpha, pA, lda, pB, ldb, pC, ldc);
+    };
+
+    if(multiplyAdds >= s_parallelThreshold)
+    {
+        ThreadPool::global().parallelFor(rowTiles * columnTiles, computeTile);
+    }
+    else
+    {
+        for(size_t i = 0; i < rowTiles * columnTiles; ++i)
+        {
+            computeTile(i);
+        }
+    }
+}
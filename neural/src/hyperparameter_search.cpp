@@ -0,0 +1,276 @@
+#include "neural/hyperparameter_search.h"
+
+#include "neural/assert.h"
+#include "neural/dataset.h"
+#include "neural/random.h"
+#include "neural/thread_pool.h"
+#include "neural/trainer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <mutex>
+
+MultilayerPerceptronParameters HyperparameterTrial::multilayerPerceptronParameters(size_t numberOfInputs, size_t numberOfOutputs) const
+{
+    MultilayerPerceptronParameters parameters;
+    parameters.numberOfInputs = numberOfInputs;
+
+    for(size_t i = 0; i < aHiddenLayerSizes.size(); ++i)
+    {
+        parameters.aLayerParameters.push_back({aHiddenLayerSizes[i], perceptronParameters});
+    }
+    parameters.aLayerParameters.push_back({numberOfOutputs, perceptronParameters});
+    parameters.seed = seed;
+
+    return parameters;
+}
+
+HyperparameterSearch::HyperparameterSearch(const HyperparameterSearchParameters &parameters) :
+    m_eStrategy(parameters.eStrategy),
+    m_numberOfTrials(parameters.numberOfTrials),
+    m_uiMaxEpochs(std::max(parameters.uiMaxEpochs, 1u)),
+    m_uiMinEpochs(std::max(std::min(parameters.uiMinEpochs, parameters.uiMaxEpochs), 1u)),
+    m_uiReductionFactor(std::max(parameters.uiReductionFactor, 2u)),
+    m_rCrossValidationEvaluationPercent(parameters.rCrossValidationEvaluationPercent),
+    m_batchSize(parameters.batchSize),
+    m_numberOfThreads(parameters.numberOfThreads),
+    m_uiSeed(parameters.uiSeed)
+{
+
+}
+
+std::vector<HyperparameterTrial> HyperparameterSearch::run(const HyperparameterSpace &space, const Dataset &dataset)
+{
+    ASSERT(dataset.size() > 0);
+
+    std::vector<HyperparameterTrial> aTrials;
+
+    switch(m_eStrategy)
+    {
+    case SearchStrategy::Grid:
+        aTrials = gridTrials(space);
+        runMedianStopping(aTrials, dataset);
+        break;
+    case SearchStrategy::Random:
+        aTrials = randomTrials(space, m_numberOfTrials, m_uiSeed);
+        runMedianStopping(aTrials, dataset);
+        break;
+    case SearchStrategy::SuccessiveHalving:
+        aTrials = randomTrials(space, m_numberOfTrials, m_uiSeed);
+        runSuccessiveHalving(aTrials, m_uiMinEpochs, dataset);
+        break;
+    case SearchStrategy::Hyperband:
+    {
+        // Bracket s starts eta^s trials (scaled) with budget uiMaxEpochs / eta^s
+        const real rReductionFactor = static_cast<real>(m_uiReductionFactor);
+        const unsigned int uiMaxBracket = static_cast<unsigned int>(std::floor(std::log(static_cast<real>(m_uiMaxEpochs) / static_cast<real>(m_uiMinEpochs)) / std::log(rReductionFactor) + 1e-9));
+
+        for(unsigned int s = uiMaxBracket + 1; s-- > 0;)
+        {
+            const real rScale = std::pow(rReductionFactor, static_cast<real>(s));
+            const size_t numberOfTrials = static_cast<size_t>(std::ceil(static_cast<real>(uiMaxBracket + 1) / static_cast<real>(s + 1) * rScale));
+            const unsigned int uiMinEpochs = std::max(static_cast<unsigned int>(static_cast<real>(m_uiMaxEpochs) / rScale), 1u);
+
+            std::vector<HyperparameterTrial> aBracketTrials = randomTrials(space, numberOfTrials, m_uiSeed + s);
+            runSuccessiveHalving(aBracketTrials, uiMinEpochs, dataset);
+            aTrials.insert(aTrials.end(), aBracketTrials.begin(), aBracketTrials.end());
+        }
+        break;
+    }
+    }
+
+    // Trials trained to the end first, then by error
+    std::stable_sort(aTrials.begin(), aTrials.end(), [](const HyperparameterTrial &a, const HyperparameterTrial &b)
+    {
+        if(a.bTerminated != b.bTerminated)
+        {
+            return b.bTerminated;
+        }
+        return a.rError < b.rError;
+    });
+
+    return aTrials;
+}
+
+std::vector<HyperparameterTrial> HyperparameterSearch::gridTrials(const HyperparameterSpace &space) const
+{
+    std::vector<HyperparameterTrial> aTrials;
+
+    for(size_t i = 0; i < space.aaHiddenLayerSizes.size(); ++i)
+    {
+        for(size_t j = 0; j < space.aActivationFunctionTypes.size(); ++j)
+        {
+            for(size_t k = 0; k < space.arLearningRates.size(); ++k)
+            {
+                for(size_t l = 0; l < space.arMomentums.size(); ++l)
+                {
+                    HyperparameterTrial trial;
+                    trial.aHiddenLayerSizes = space.aaHiddenLayerSizes[i];
+                    trial.perceptronParameters = {space.aActivationFunctionTypes[j], space.arLearningRates[k], 0.0, space.arMomentums[l]};
+                    trial.seed = RandomStream(m_uiSeed).split(aTrials.size()).key();
+                    aTrials.push_back(trial);
+                }
+            }
+        }
+    }
+
+    return aTrials;
+}
+
+std::vector<HyperparameterTrial> HyperparameterSearch::randomTrials(const HyperparameterSpace &space, size_t numberOfTrials, unsigned int uiSeed) const
+{
+    ASSERT(space.aaHiddenLayerSizes.empty() == false && space.aActivationFunctionTypes.empty() == false);
+    ASSERT(space.arLearningRates.empty() == false && space.arMomentums.empty() == false);
+
+    const auto learningRates = std::minmax_element(space.arLearningRates.begin(), space.arLearningRates.end());
+    const auto momentums = std::minmax_element(space.arMomentums.begin(), space.arMomentums.end());
+
+    RandomStream randomStream(uiSeed);
+    const real rLogLearningRateMin = std::log(*learningRates.first);
+    const real rLogLearningRateMax = std::log(*learningRates.second);
+
+    std::vector<HyperparameterTrial> aTrials(numberOfTrials);
+    for(size_t i = 0; i < numberOfTrials; ++i)
+    {
+        aTrials[i].aHiddenLayerSizes = space.aaHiddenLayerSizes[randomStream.uniformIndex(space.aaHiddenLayerSizes.size())];
+        aTrials[i].perceptronParameters.eActivationFunctionType = space.aActivationFunctionTypes[randomStream.uniformIndex(space.aActivationFunctionTypes.size())];
+        aTrials[i].perceptronParameters.rLearningRate = std::exp(randomStream.uniform(rLogLearningRateMin, rLogLearningRateMax));
+        aTrials[i].perceptronParameters.rBias = 0.0;
+        aTrials[i].perceptronParameters.rMomentum = randomStream.uniform(*momentums.first, *momentums.second);
+        aTrials[i].seed = RandomStream(uiSeed).split(i).key();
+    }
+
+    return aTrials;
+}
+
+/*
+ * Train every trial up to uiMaxEpochs, uiMinEpochs at a time.
+ * After each step, a trial worse than the median of the trials
+ * already at the same step is terminated. The decisions depend
+ * on the order in which trials reach each step.
+ */
+void HyperparameterSearch::runMedianStopping(std::vector<HyperparameterTrial> &aTrials, const Dataset &dataset) const
+{
+    std::vector<MultilayerPerceptron> aNetworks;
+    aNetworks.reserve(aTrials.size());
+    for(size_t i = 0; i < aTrials.size(); ++i)
+    {
+        aNetworks.emplace_back(aTrials[i].multilayerPerceptronParameters(dataset.numberOfInputs(), dataset.numberOfOutputs()));
+    }
+
+    const size_t numberOfSteps = (m_uiMaxEpochs + m_uiMinEpochs - 1) / m_uiMinEpochs;
+    std::vector<std::vector<real>> aarStepErrors(numberOfSteps);
+    std::mutex mutex;
+
+    ThreadPool threadPool(m_numberOfThreads);
+    threadPool.parallelFor(aTrials.size(), [&](size_t i)
+    {
+        for(size_t step = 0; step < numberOfSteps; ++step)
+        {
+            trainTrial(aTrials[i], aNetworks[i], std::min(m_uiMinEpochs, m_uiMaxEpochs - aTrials[i].uiEpochs), dataset);
+            if(step + 1 == numberOfSteps)
+            {
+                break;
+            }
+
+            std::lock_guard<std::mutex> lock(mutex);
+            std::vector<real> &arErrors = aarStepErrors[step];
+
+            // Wait for a few trials before stopping any
+            if(arErrors.size() >= 2)
+            {
+                std::vector<real> arSortedErrors = arErrors;
+                std::nth_element(arSortedErrors.begin(), arSortedErrors.begin() + arSortedErrors.size() / 2, arSortedErrors.end());
+
+                if(aTrials[i].rError > arSortedErrors[arSortedErrors.size() / 2])
+                {
+                    aTrials[i].bTerminated = true;
+                }
+            }
+            arErrors.push_back(aTrials[i].rError);
+
+            if(aTrials[i].bTerminated == true)
+            {
+                break;
+            }
+        }
+    });
+}
+
+/*
+ * Train every trial uiMinEpochs, keep the best 1 / eta of them,
+ * train the survivors up to eta times more epochs, and so on
+ * until uiMaxEpochs or a single trial is left
+ */
+void HyperparameterSearch::runSuccessiveHalving(std::vector<HyperparameterTrial> &aTrials, unsigned int uiMinEpochs, const Dataset &dataset) const
+{
+    std::vector<MultilayerPerceptron> aNetworks;
+    aNetworks.reserve(aTrials.size());
+    for(size_t i = 0; i < aTrials.size(); ++i)
+    {
+        aNetworks.emplace_back(aTrials[i].multilayerPerceptronParameters(dataset.numberOfInputs(), dataset.numberOfOutputs()));
+    }
+
+    std::vector<size_t> aRemainingTrials(aTrials.size());
+    for(size_t i = 0; i < aTrials.size(); ++i)
+    {
+        aRemainingTrials[i] = i;
+    }
+
+    ThreadPool threadPool(m_numberOfThreads);
+    unsigned int uiEpochs = uiMinEpochs;
+
+    while(aRemainingTrials.empty() == false)
+    {
+        uiEpochs = std::min(uiEpochs, m_uiMaxEpochs);
+
+        threadPool.parallelFor(aRemainingTrials.size(), [&](size_t i)
+        {
+            const size_t trialIndex = aRemainingTrials[i];
+            trainTrial(aTrials[trialIndex], aNetworks[trialIndex], uiEpochs - aTrials[trialIndex].uiEpochs, dataset);
+        });
+
+        if(uiEpochs >= m_uiMaxEpochs || aRemainingTrials.size() == 1)
+        {
+            break;
+        }
+
+        std::sort(aRemainingTrials.begin(), aRemainingTrials.end(), [&aTrials](size_t a, size_t b)
+        {
+            return aTrials[a].rError < aTrials[b].rError;
+        });
+
+        const size_t numberOfKeptTrials = std::max<size_t>(aRemainingTrials.size() / m_uiReductionFactor, 1);
+        for(size_t i = numberOfKeptTrials; i < aRemainingTrials.size(); ++i)
+        {
+            aTrials[aRemainingTrials[i]].bTerminated = true;
+        }
+        aRemainingTrials.resize(numberOfKeptTrials);
+
+        uiEpochs *= m_uiReductionFactor;
+    }
+}
+
+/*
+ * Continue the training of a trial for uiEpochs epochs,
+ * each call uses its own Trainer so trials run concurrently
+ */
+void HyperparameterSearch::trainTrial(HyperparameterTrial &trial, MultilayerPerceptron &multilayerPerceptron,
+    unsigned int uiEpochs, const Dataset &dataset) const
+{
+    if(uiEpochs == 0)
+    {
+        return;
+    }
+
+    TrainingParameters trainingParameters;
+    trainingParameters.iMaxIterations = static_cast<int>(uiEpochs) - 1;
+    trainingParameters.rCrossValidationEvaluationPercent = m_rCrossValidationEvaluationPercent;
+    trainingParameters.batchSize = m_batchSize;
+
+    Trainer trainer(trainingParameters);
+    trainer.train(multilayerPerceptron, dataset);
+
+    trial.rError = trainer.error();
+    trial.uiEpochs += uiEpochs;
+}
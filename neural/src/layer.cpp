@@ -1,44 +1,746 @@
 #include "neural/layer.h"
 
 #include "neural/assert.h"
+#include "neural/gemm.h"
+#include "serialisation.h"
 
-Layer::Layer(const size_t &previousLayerSize, const LayerParameters &parameters)
+#include <algorithm>
+#include <cmath>
+#include <utility>
+
+namespace
+{
+    // Below this fraction of kept weights, CSR beats the dense product
+    const real s_rSparseDensityThreshold = 0.3;
+
+    // Child streams of a Layer
+    enum RandomStreamId : uint64_t
+    {
+        WeightsStream,
+        DropoutStream
+    };
+}
+
+Layer::Layer(const size_t &previousLayerSize, const LayerParameters &parameters) :
+    Layer(previousLayerSize, parameters, RandomStream(parameters.seed != RandomStream::s_unsetSeed ? parameters.seed : e_uiSeed++))
 {
-    ASSERT(parameters.layerSize > 0);
-    
-    m_eActivationFunctionType = parameters.perceptronParameters.eActivationFunctionType;
 
-    m_aPerceptrons.reserve(parameters.layerSize);
+}
+
+Layer::Layer(const size_t &previousLayerSize, const LayerParameters &parameters, const RandomStream &randomStream) :
+    m_eLayerType(parameters.eLayerType),
+    m_eActivationFunctionType(parameters.perceptronParameters.eActivationFunctionType),
+    m_numberOfInputs(previousLayerSize),
+    m_size(parameters.layerSize),
+    m_rLearningRate(parameters.perceptronParameters.rLearningRate),
+    m_rBias(parameters.perceptronParameters.rBias),
+    m_rMomentum(parameters.perceptronParameters.rMomentum),
+    m_rL1(parameters.perceptronParameters.rL1),
+    m_rL2(parameters.perceptronParameters.rL2),
+    m_rDropoutRate(parameters.rDropoutRate)
+{
+    ASSERT(parameters.rDropoutRate >= 0.0 && parameters.rDropoutRate < 1.0);
 
-    for(size_t i = 0; i < parameters.layerSize; ++i)
+    size_t numberOfWeights = 0;
+
+    switch(m_eLayerType)
     {
-        m_aPerceptrons.push_back(Perceptron(previousLayerSize, parameters.perceptronParameters));
-        m_aPerceptrons[i].initializeRandomWeights();
+    case LayerType::FullyConnected:
+        numberOfWeights = m_size * m_numberOfInputs;
+        break;
+    case LayerType::Convolution:
+    case LayerType::MaxPooling:
+    case LayerType::AveragePooling:
+        numberOfWeights = initializeConvolution(parameters.convolution);
+        break;
+    case LayerType::Flatten:
+        m_size = m_numberOfInputs;
+        break;
+    case LayerType::Recurrent:
+        numberOfWeights = initializeRecurrent(parameters.recurrent);
+        break;
     }
+
+    // Layers without weights pass values through
+    if(numberOfWeights == 0)
+    {
+        ASSERT(m_rDropoutRate == 0.0);
+
+        m_eActivationFunctionType = ActivationFunctionType::Linear;
+        m_rBias = 0.0;
+    }
+
+    ASSERT(m_size > 0);
+
+    m_aWeights.resize(numberOfWeights);
+    m_arGradients.resize(numberOfWeights);
+    m_arSavedDerivatives.resize(numberOfWeights);
+
+    m_pfActivationFunctionPtr = activationFunctionFromType(m_eActivationFunctionType);
+    m_pfActivationDerivativePtr = activationDerivativeFromType(m_eActivationFunctionType);
+
+    if(numberOfWeights > 0)
+    {
+        initializeRandomWeights(parameters.eWeightInitialisation, randomStream.split(WeightsStream));
+    }
+
+    m_dropoutSeed = randomStream.split(DropoutStream).key();
 }
 
 void Layer::evaluate(const LayerInputs &aInputs, LayerOutputs &aOutputs) const
 {
-    ASSERT(aInputs.size() == m_aPerceptrons[0].numberOfInputs());
+    ASSERT(aInputs.size() == numberOfInputs() && aOutputs.size() == size());
+
+    forward(aInputs.data(), 1, aOutputs.data(), aOutputs.data());
+}
+
+void Layer::forward(const real *pInputs, size_t batchSize, real *pActivations, real *pOutputs,
+    real *pDropoutMask, uint64_t step) const
+{
+    switch(m_eLayerType)
+    {
+    case LayerType::FullyConnected:
+        break;
+    case LayerType::Convolution:
+        convolutionForward(pInputs, batchSize, pActivations);
+        activate(pActivations, pOutputs, batchSize * size(), pDropoutMask, step);
+        return;
+    case LayerType::MaxPooling:
+    case LayerType::AveragePooling:
+        poolingForward(pInputs, batchSize, pActivations);
+        std::copy(pActivations, pActivations + batchSize * size(), pOutputs);
+        return;
+    case LayerType::Flatten:
+        std::copy(pInputs, pInputs + batchSize * size(), pActivations);
+        std::copy(pInputs, pInputs + batchSize * size(), pOutputs);
+        return;
+    case LayerType::Recurrent:
+        if(pActivations == pOutputs)
+        {
+            // Inference into the outputs, the states go to a scratch buffer
+            thread_local std::vector<real> t_arStates;
+            t_arStates.resize(batchSize * activationsSize());
+            recurrentForward(pInputs, batchSize, t_arStates.data(), pOutputs);
+        }
+        else
+        {
+            recurrentForward(pInputs, batchSize, pActivations, pOutputs);
+        }
+        return;
+    }
+
+    if(sparse() == true)
+    {
+        // Z = X * W^T on the kept weights only
+        for(size_t b = 0; b < batchSize; ++b)
+        {
+            const real *pSampleInputs = pInputs + b * numberOfInputs();
+            real *pSampleActivations = pActivations + b * size();
+
+            for(size_t i = 0; i < size(); ++i)
+            {
+                real rZ = 0.0;
+                for(uint32_t k = m_aSparseRowOffsets[i]; k < m_aSparseRowOffsets[i + 1]; ++k)
+                {
+                    rZ += m_arSparseValues[k] * pSampleInputs[m_aSparseColumns[k]];
+                }
+                pSampleActivations[i] = rZ;
+            }
+        }
+    }
+    else
+    {
+        // Z = X * W^T
+        gemm(Transpose::No, Transpose::Yes, batchSize, size(), numberOfInputs(),
+            1.0, pInputs, numberOfInputs(),
+            m_aWeights.data(), numberOfInputs(),
+            0.0, pActivations, size());
+    }
+
+    activate(pActivations, pOutputs, batchSize * size(), pDropoutMask, step);
+}
+
+/*
+ * Bias, activation function and dropout of count weighted sums
+ */
+void Layer::activate(real *pActivations, real *pOutputs, size_t count, real *pDropoutMask, uint64_t step) const
+{
+    if(pDropoutMask == nullptr || m_rDropoutRate <= 0.0)
+    {
+        for(size_t i = 0; i < count; ++i)
+        {
+            pActivations[i] += m_rBias;
+            pOutputs[i] = m_pfActivationFunctionPtr(pActivations[i]);
+        }
+    }
+    else
+    {
+        // Inverted dropout, one uniform draw per output of the batch
+        // from the stream of this step
+        RandomStream(m_dropoutSeed).split(step).fillUniform(pDropoutMask, count);
+        const real rScale = 1.0 / (1.0 - m_rDropoutRate);
+
+        for(size_t i = 0; i < count; ++i)
+        {
+            pDropoutMask[i] = pDropoutMask[i] >= m_rDropoutRate ? rScale : 0.0;
+            pActivations[i] += m_rBias;
+            pOutputs[i] = m_pfActivationFunctionPtr(pActivations[i]) * pDropoutMask[i];
+        }
+    }
+}
+
+void Layer::backward(const real *pInputs, const real *pActivations, real *pDeltas, real *pInputDeltas, size_t batchSize,
+    const real *pDropoutMask)
+{
+    backward(pInputs, pActivations, pDeltas, pInputDeltas, batchSize, pDropoutMask, m_arGradients.data());
+}
+
+void Layer::backward(const real *pInputs, const real *pActivations, real *pDeltas, real *pInputDeltas, size_t batchSize,
+    const real *pDropoutMask, real *pGradients)
+{
+    ASSERT(batchSize > 0);
+
+    if(m_eLayerType == LayerType::Recurrent)
+    {
+        recurrentBackward(pInputs, pActivations, pDeltas, pInputDeltas, batchSize, pGradients);
+        return;
+    }
+
+    const size_t count = batchSize * size();
+    if(pDropoutMask == nullptr)
+    {
+        for(size_t i = 0; i < count; ++i)
+        {
+            pDeltas[i] *= m_pfActivationDerivativePtr(pActivations[i]);
+        }
+    }
+    else
+    {
+        for(size_t i = 0; i < count; ++i)
+        {
+            pDeltas[i] *= m_pfActivationDerivativePtr(pActivations[i]) * pDropoutMask[i];
+        }
+    }
+
+    switch(m_eLayerType)
+    {
+    case LayerType::FullyConnected:
+        break;
+    case LayerType::Convolution:
+        convolutionBackward(pInputs, pDeltas, pInputDeltas, batchSize, pGradients);
+        return;
+    case LayerType::MaxPooling:
+    case LayerType::AveragePooling:
+        if(pInputDeltas != nullptr)
+        {
+            poolingBackward(pInputs, pDeltas, pInputDeltas, batchSize);
+        }
+        return;
+    case LayerType::Flatten:
+        if(pInputDeltas != nullptr)
+        {
+            std::copy(pDeltas, pDeltas + count, pInputDeltas);
+        }
+        return;
+    case LayerType::Recurrent:
+        return;
+    }
+
+    // Error to send to previous layer (backpropagation): dE/dX = D * W
+    if(pInputDeltas != nullptr)
+    {
+        gemm(Transpose::No, Transpose::No, batchSize, numberOfInputs(), size(),
+            1.0, pDeltas, size(),
+            m_aWeights.data(), numberOfInputs(),
+            0.0, pInputDeltas, numberOfInputs());
+    }
+
+    // Mean gradient over the batch: G = D^T * X / batchSize
+    gemm(Transpose::Yes, Transpose::No, size(), numberOfInputs(), batchSize,
+        1.0 / static_cast<real>(batchSize), pDeltas, size(),
+        pInputs, numberOfInputs(),
+        0.0, pGradients, numberOfInputs());
+}
+
+/*
+ * Gradient descent step with momentum on the gradient
+ * computed by backward, L1/L2 weight decay is added
+ * to the derivatives in the same pass
+ */
+void Layer::update()
+{
+    if(pruned() == false)
+    {
+        for(size_t i = 0; i < m_aWeights.size(); ++i)
+        {
+            const real rWeight = m_aWeights[i];
+            const real rDerivative = m_arGradients[i] + m_rL2 * rWeight + m_rL1 * static_cast<real>((rWeight > 0.0) - (rWeight < 0.0));
+
+            m_aWeights[i] = rWeight - (rDerivative * m_rLearningRate + m_arSavedDerivatives[i] * m_rMomentum);
+            m_arGradients[i] = rDerivative;
+        }
+    }
+    else
+    {
+        // Masked derivatives keep pruned weights at zero
+        for(size_t i = 0; i < m_aWeights.size(); ++i)
+        {
+            const real rWeight = m_aWeights[i];
+            const real rDerivative = (m_arGradients[i] + m_rL2 * rWeight + m_rL1 * static_cast<real>((rWeight > 0.0) - (rWeight < 0.0))) * m_arPruningMask[i];
+
+            m_aWeights[i] = rWeight - (rDerivative * m_rLearningRate + m_arSavedDerivatives[i] * m_rMomentum);
+            m_arGradients[i] = rDerivative;
+        }
+
+        updateSparseWeights();
+    }
+
+    // Save derivatives
+    std::swap(m_arGradients, m_arSavedDerivatives);
+}
+
+void Layer::trainAsynchronous(const real *pInputs, const real *pActivations, real *pDeltas, real *pInputDeltas)
+{
+    if(m_eLayerType != LayerType::FullyConnected)
+    {
+        // Gradient of the sample in a buffer of the thread, never swapped
+        thread_local std::vector<real> t_arGradients;
+        t_arGradients.resize(m_aWeights.size());
+        backward(pInputs, pActivations, pDeltas, pInputDeltas, 1, nullptr, t_arGradients.data());
+
+        for(size_t i = 0; i < m_aWeights.size(); ++i)
+        {
+            if(pruned() == true && m_arPruningMask[i] == 0.0)
+            {
+                continue;
+            }
+
+            const real rWeight = m_aWeights[i];
+            const real rDerivative = t_arGradients[i] + m_rL2 * rWeight + m_rL1 * static_cast<real>((rWeight > 0.0) - (rWeight < 0.0));
+            m_aWeights[i] = rWeight - (rDerivative * m_rLearningRate + m_arSavedDerivatives[i] * m_rMomentum);
+            m_arSavedDerivatives[i] = rDerivative;
+        }
+        return;
+    }
 
     for(size_t i = 0; i < size(); ++i)
     {
-        m_aPerceptrons[i].evaluate(aInputs, aOutputs[i]);
+        pDeltas[i] *= m_pfActivationDerivativePtr(pActivations[i]);
+    }
+
+    // Error to send to previous layer (backpropagation)
+    if(pInputDeltas != nullptr)
+    {
+        gemm(Transpose::No, Transpose::No, 1, numberOfInputs(), size(),
+            1.0, pDeltas, size(),
+            m_aWeights.data(), numberOfInputs(),
+            0.0, pInputDeltas, numberOfInputs());
+    }
+
+    for(size_t i = 0; i < size(); ++i)
+    {
+        const real rDelta = pDeltas[i];
+        real *pWeights = m_aWeights.data() + i * numberOfInputs();
+        real *pSavedDerivatives = m_arSavedDerivatives.data() + i * numberOfInputs();
+
+        auto updateWeight = [&](size_t j)
+        {
+            const real rWeight = pWeights[j];
+            const real rDerivative = rDelta * pInputs[j] + m_rL2 * rWeight + m_rL1 * static_cast<real>((rWeight > 0.0) - (rWeight < 0.0));
+            pWeights[j] = rWeight - (rDerivative * m_rLearningRate + pSavedDerivatives[j] * m_rMomentum);
+            pSavedDerivatives[j] = rDerivative;
+        };
+
+        if(sparse() == true)
+        {
+            // Kept weights only, CSR copy updated along
+            for(uint32_t k = m_aSparseRowOffsets[i]; k < m_aSparseRowOffsets[i + 1]; ++k)
+            {
+                const size_t j = m_aSparseColumns[k];
+                if(pInputs[j] != 0.0)
+                {
+                    updateWeight(j);
+                    m_arSparseValues[k] = pWeights[j];
+                }
+            }
+        }
+        else
+        {
+            const real *pPruningMask = pruned() == true ? m_arPruningMask.data() + i * numberOfInputs() : nullptr;
+            for(size_t j = 0; j < numberOfInputs(); ++j)
+            {
+                if(pInputs[j] != 0.0 && (pPruningMask == nullptr || pPruningMask[j] != 0.0))
+                {
+                    updateWeight(j);
+                }
+            }
+        }
+    }
+}
+
+real Layer::gradientSquaredNorm() const
+{
+    real rSquaredNorm = 0.0;
+
+    for(size_t i = 0; i < m_arSavedDerivatives.size(); ++i)
+    {
+        rSquaredNorm += m_arSavedDerivatives[i] * m_arSavedDerivatives[i];
+    }
+
+    return rSquaredNorm;
+}
+
+void Layer::prune(real rThreshold)
+{
+    if(pruned() == false)
+    {
+        m_arPruningMask.assign(m_aWeights.size(), 1.0);
+    }
+
+    for(size_t i = 0; i < m_aWeights.size(); ++i)
+    {
+        if(fabs(m_aWeights[i]) < rThreshold)
+        {
+            m_arPruningMask[i] = 0.0;
+        }
+
+        m_aWeights[i] *= m_arPruningMask[i];
+        m_arSavedDerivatives[i] *= m_arPruningMask[i];
+    }
+
+    buildSparseWeights();
+}
+
+/*
+ * Fraction of weights left by pruning
+ */
+real Layer::density() const
+{
+    if(pruned() == false || m_arPruningMask.empty() == true)
+    {
+        return 1.0;
+    }
+
+    real rKept = 0.0;
+    for(size_t i = 0; i < m_arPruningMask.size(); ++i)
+    {
+        rKept += m_arPruningMask[i];
+    }
+
+    return rKept / static_cast<real>(m_arPruningMask.size());
+}
+
+void Layer::setWeights(const real *pWeights)
+{
+    std::copy(pWeights, pWeights + m_aWeights.size(), m_aWeights.begin());
+
+    if(pruned() == true)
+    {
+        for(size_t i = 0; i < m_aWeights.size(); ++i)
+        {
+            m_aWeights[i] *= m_arPruningMask[i];
+        }
+        updateSparseWeights();
+    }
+}
+
+void Layer::setSavedDerivatives(const real *pSavedDerivatives)
+{
+    std::copy(pSavedDerivatives, pSavedDerivatives + m_arSavedDerivatives.size(), m_arSavedDerivatives.begin());
+}
+
+void Layer::setBackpropagationSteps(size_t backpropagationSteps)
+{
+    m_recurrent.backpropagationSteps = backpropagationSteps;
+}
+
+void Layer::write(std::ostream &stream) const
+{
+    Serialisation::write(stream, static_cast<uint32_t>(m_eLayerType));
+    Serialisation::write(stream, static_cast<uint32_t>(m_eActivationFunctionType));
+    Serialisation::write(stream, static_cast<uint64_t>(size()));
+    Serialisation::write(stream, static_cast<uint64_t>(numberOfInputs()));
+    Serialisation::write(stream, static_cast<uint64_t>(m_convolution.outputShape.channels));
+    Serialisation::write(stream, static_cast<uint64_t>(m_convolution.kernelSize));
+    Serialisation::write(stream, static_cast<uint64_t>(m_convolution.stride));
+    Serialisation::write(stream, static_cast<uint64_t>(m_convolution.padding));
+    Serialisation::write(stream, static_cast<uint32_t>(m_recurrent.eRecurrentCell));
+    Serialisation::write(stream, static_cast<uint64_t>(m_recurrent.sequenceLength));
+    Serialisation::write(stream, static_cast<uint32_t>(m_recurrent.bReturnSequences));
+    Serialisation::write(stream, static_cast<uint64_t>(m_recurrent.backpropagationSteps));
+    Serialisation::write(stream, m_rLearningRate);
+    Serialisation::write(stream, m_rBias);
+    Serialisation::write(stream, m_rMomentum);
+    Serialisation::write(stream, m_rL1);
+    Serialisation::write(stream, m_rL2);
+    Serialisation::write(stream, m_rDropoutRate);
+    Serialisation::write(stream, m_dropoutSeed);
+    Serialisation::writeVector(stream, m_aWeights);
+    Serialisation::writeVector(stream, m_arSavedDerivatives);
+    Serialisation::writeResizableVector(stream, m_arPruningMask);
+}
+
+/*
+ * Layer must have the topology of the saved one
+ */
+bool Layer::read(std::istream &stream)
+{
+    uint32_t layerType = 0;
+    uint32_t activationFunctionType = 0;
+    uint64_t layerSize = 0;
+    uint64_t numberOfInputs = 0;
+    uint64_t outputChannels = 0;
+    uint64_t kernelSize = 0;
+    uint64_t stride = 0;
+    uint64_t padding = 0;
+    uint32_t recurrentCell = 0;
+    uint64_t sequenceLength = 0;
+    uint32_t returnSequences = 0;
+    uint64_t backpropagationSteps = 0;
+    if(Serialisation::read(stream, layerType) == false ||
+        Serialisation::read(stream, activationFunctionType) == false ||
+        Serialisation::read(stream, layerSize) == false ||
+        Serialisation::read(stream, numberOfInputs) == false ||
+        Serialisation::read(stream, outputChannels) == false ||
+        Serialisation::read(stream, kernelSize) == false ||
+        Serialisation::read(stream, stride) == false ||
+        Serialisation::read(stream, padding) == false ||
+        Serialisation::read(stream, recurrentCell) == false ||
+        Serialisation::read(stream, sequenceLength) == false ||
+        Serialisation::read(stream, returnSequences) == false ||
+        Serialisation::read(stream, backpropagationSteps) == false ||
+        static_cast<LayerType>(layerType) != m_eLayerType ||
+        static_cast<ActivationFunctionType>(activationFunctionType) != m_eActivationFunctionType ||
+        layerSize != size() || numberOfInputs != this->numberOfInputs() ||
+        outputChannels != m_convolution.outputShape.channels || kernelSize != m_convolution.kernelSize ||
+        stride != m_convolution.stride || padding != m_convolution.padding ||
+        static_cast<RecurrentCell>(recurrentCell) != m_recurrent.eRecurrentCell || sequenceLength != m_recurrent.sequenceLength ||
+        (returnSequences != 0) != m_recurrent.bReturnSequences)
+    {
+        return false;
+    }
+
+    m_recurrent.backpropagationSteps = static_cast<size_t>(backpropagationSteps);
+
+    if(Serialisation::read(stream, m_rLearningRate) == false ||
+        Serialisation::read(stream, m_rBias) == false ||
+        Serialisation::read(stream, m_rMomentum) == false ||
+        Serialisation::read(stream, m_rL1) == false ||
+        Serialisation::read(stream, m_rL2) == false ||
+        Serialisation::read(stream, m_rDropoutRate) == false ||
+        Serialisation::read(stream, m_dropoutSeed) == false ||
+        Serialisation::readVector(stream, m_aWeights) == false ||
+        Serialisation::readVector(stream, m_arSavedDerivatives) == false ||
+        Serialisation::readResizableVector(stream, m_arPruningMask, m_aWeights.size()) == false)
+    {
+        return false;
+    }
+
+    buildSparseWeights();
+
+    return true;
+}
+
+/*
+ * Fill the whole weight matrix in one pass
+ * (split over the ThreadPool for large Layers)
+ */
+void Layer::initializeRandomWeights(WeightInitialisation eWeightInitialisation, RandomStream randomStream)
+{
+    if(eWeightInitialisation == WeightInitialisation::Automatic)
+    {
+        // Gated cells are driven by sigmoids and hyperbolic tangents
+        switch(m_eLayerType == LayerType::Recurrent && m_recurrent.eRecurrentCell != RecurrentCell::Elman ?
+            ActivationFunctionType::HyperbolicTangent : m_eActivationFunctionType)
+        {
+        case ActivationFunctionType::RectifiedLinearUnits:
+            eWeightInitialisation = WeightInitialisation::He;
+            break;
+        case ActivationFunctionType::HyperbolicTangent:
+            eWeightInitialisation = WeightInitialisation::XavierUniform;
+            break;
+        default:
+            eWeightInitialisation = WeightInitialisation::LeCun;
+            break;
+        }
+    }
+
+    // Inputs and outputs connected to one weight
+    real rFanIn = static_cast<real>(numberOfInputs());
+    real rFanOut = static_cast<real>(size());
+    if(m_eLayerType == LayerType::Convolution)
+    {
+        rFanIn = static_cast<real>(m_convolution.kernelSize * m_convolution.kernelSize * m_convolution.inputShape.channels);
+        rFanOut = static_cast<real>(m_convolution.kernelSize * m_convolution.kernelSize * m_convolution.outputShape.channels);
+    }
+    else if(m_eLayerType == LayerType::Recurrent)
+    {
+        // Inputs and previous hidden state, per gate unit
+        rFanIn = static_cast<real>(m_numberOfInputs / m_recurrent.sequenceLength + m_recurrent.hiddenSize);
+        rFanOut = static_cast<real>(m_recurrent.hiddenSize);
+    }
+
+    switch(eWeightInitialisation)
+    {
+    case WeightInitialisation::Uniform:
+    {
+        const real epsilon = 2.4494897427831780981972840747059 / sqrt(rFanIn + 1.0);
+        randomStream.fillUniform(m_aWeights.data(), m_aWeights.size(), -epsilon, epsilon);
+        break;
+    }
+    case WeightInitialisation::XavierUniform:
+    {
+        const real epsilon = sqrt(6.0 / (rFanIn + rFanOut));
+        randomStream.fillUniform(m_aWeights.data(), m_aWeights.size(), -epsilon, epsilon);
+        break;
+    }
+    case WeightInitialisation::XavierNormal:
+        randomStream.fillNormal(m_aWeights.data(), m_aWeights.size(), 0.0, sqrt(2.0 / (rFanIn + rFanOut)));
+        break;
+    case WeightInitialisation::He:
+        randomStream.fillNormal(m_aWeights.data(), m_aWeights.size(), 0.0, sqrt(2.0 / rFanIn));
+        break;
+    case WeightInitialisation::LeCun:
+        randomStream.fillNormal(m_aWeights.data(), m_aWeights.size(), 0.0, sqrt(1.0 / rFanIn));
+        break;
+    case WeightInitialisation::Orthogonal:
+    {
+        randomStream.fillNormal(m_aWeights.data(), m_aWeights.size());
+
+        // One filter per column for a convolution
+        if(m_eLayerType == LayerType::Convolution)
+        {
+            orthogonaliseWeights(m_aWeights.size() / m_convolution.outputShape.channels, m_convolution.outputShape.channels);
+        }
+        else if(m_eLayerType == LayerType::Recurrent)
+        {
+            orthogonaliseWeights(numberOfGates() * m_recurrent.hiddenSize, m_aWeights.size() / (numberOfGates() * m_recurrent.hiddenSize));
+        }
+        else
+        {
+            orthogonaliseWeights(size(), numberOfInputs());
+        }
+
+        const real rGain = m_eActivationFunctionType == ActivationFunctionType::RectifiedLinearUnits ? sqrt(2.0) : 1.0;
+        for(size_t i = 0; i < m_aWeights.size(); ++i)
+        {
+            m_aWeights[i] *= rGain;
+        }
+        break;
+    }
+    default:
+        break;
+    }
+
+    // Recurrent biases start at 0, forget gates of LSTM cells at 1
+    // so that the cell state is kept early in training
+    if(m_eLayerType == LayerType::Recurrent)
+    {
+        const size_t rowSize = m_aWeights.size() / (numberOfGates() * m_recurrent.hiddenSize);
+        for(size_t i = 0; i < numberOfGates() * m_recurrent.hiddenSize; ++i)
+        {
+            const bool bForgetGate = m_recurrent.eRecurrentCell == RecurrentCell::LongShortTermMemory && i / m_recurrent.hiddenSize == 1;
+            m_aWeights[i * rowSize + rowSize - 1] = bForgetGate == true ? 1.0 : 0.0;
+        }
     }
 }
 
-void Layer::train(const LayerInputs &aInputs, const LayerOutputs &aTargetOutputs, LayerErrors &aErrors)
+/*
+ * Modified Gram-Schmidt on the rows of the row-major weight matrix,
+ * or on its columns if there are more rows than columns
+ */
+void Layer::orthogonaliseWeights(size_t numberOfRows, size_t numberOfColumns)
 {
+    const bool bRows = numberOfRows <= numberOfColumns;
+    const size_t numberOfVectors = bRows ? numberOfRows : numberOfColumns;
+    const size_t vectorSize = bRows ? numberOfColumns : numberOfRows;
+    const size_t vectorStride = bRows ? numberOfColumns : 1;
+    const size_t elementStride = bRows ? 1 : numberOfColumns;
+
+    real *pWeights = m_aWeights.data();
+
+    for(size_t i = 0; i < numberOfVectors; ++i)
+    {
+        real *pVector = pWeights + i * vectorStride;
+
+        for(size_t j = 0; j < i; ++j)
+        {
+            const real *pPreviousVector = pWeights + j * vectorStride;
+
+            real rDot = 0.0;
+            for(size_t k = 0; k < vectorSize; ++k)
+            {
+                rDot += pVector[k * elementStride] * pPreviousVector[k * elementStride];
+            }
+            for(size_t k = 0; k < vectorSize; ++k)
+            {
+                pVector[k * elementStride] -= rDot * pPreviousVector[k * elementStride];
+            }
+        }
+
+        real rSquaredNorm = 0.0;
+        for(size_t k = 0; k < vectorSize; ++k)
+        {
+            rSquaredNorm += pVector[k * elementStride] * pVector[k * elementStride];
+        }
+
+        const real rInverseNorm = rSquaredNorm > 0.0 ? 1.0 / sqrt(rSquaredNorm) : 0.0;
+        for(size_t k = 0; k < vectorSize; ++k)
+        {
+            pVector[k * elementStride] *= rInverseNorm;
+        }
+    }
+}
+
+/*
+ * Build the CSR copy of the kept weights
+ * if the Layer is sparse enough
+ */
+void Layer::buildSparseWeights()
+{
+    m_arSparseValues.clear();
+    m_aSparseColumns.clear();
+    m_aSparseRowOffsets.clear();
+
+    if(m_eLayerType != LayerType::FullyConnected || pruned() == false || density() >= s_rSparseDensityThreshold)
+    {
+        return;
+    }
+
+    m_aSparseRowOffsets.reserve(size() + 1);
+    m_aSparseRowOffsets.push_back(0);
     for(size_t i = 0; i < size(); ++i)
     {
-        m_aPerceptrons[i].train(aInputs, aTargetOutputs[i], aErrors[i]);
+        for(size_t j = 0; j < numberOfInputs(); ++j)
+        {
+            const size_t index = i * numberOfInputs() + j;
+            if(m_arPruningMask[index] != 0.0)
+            {
+                m_arSparseValues.push_back(m_aWeights[index]);
+                m_aSparseColumns.push_back(static_cast<uint32_t>(j));
+            }
+        }
+        m_aSparseRowOffsets.push_back(static_cast<uint32_t>(m_arSparseValues.size()));
     }
 }
 
-void Layer::train(const LayerInputs &aInputs, const LayerErrors &aNextLayerErrors, LayerErrors &aErrors)
+/*
+ * Copy the kept weights into the CSR values,
+ * the sparsity pattern does not change while training
+ */
+void Layer::updateSparseWeights()
 {
+    if(sparse() == false)
+    {
+        return;
+    }
+
     for(size_t i = 0; i < size(); ++i)
     {
-        m_aPerceptrons[i].train(aInputs, aNextLayerErrors, i, aErrors[i]);
+        const real *pWeights = m_aWeights.data() + i * numberOfInputs();
+        for(uint32_t k = m_aSparseRowOffsets[i]; k < m_aSparseRowOffsets[i + 1]; ++k)
+        {
+            m_arSparseValues[k] = pWeights[m_aSparseColumns[k]];
+        }
     }
 }
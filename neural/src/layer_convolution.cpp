@@ -0,0 +1,363 @@
+#include "neural/layer.h"
+
+#include "neural/assert.h"
+#include "neural/thread_pool.h"
+
+#include <algorithm>
+
+/*
+ * Convolution, max pooling and average pooling Layers
+ * on HWC image rows
+ */
+namespace
+{
+    // Output channels accumulated together by a convolution,
+    // the matching weights stay in cache along an output row
+    const size_t s_channelBlock = 64;
+
+    // Multiply-adds above which convolutions use the ThreadPool
+    const size_t s_parallelThreshold = 128 * 128 * 128;
+}
+
+/*
+ * Output shape from the window of parameters,
+ * returns the number of weights (0 for pooling)
+ */
+size_t Layer::initializeConvolution(const ConvolutionParameters &parameters)
+{
+    const bool bConvolution = m_eLayerType == LayerType::Convolution;
+
+    m_convolution.inputShape = parameters.inputShape;
+    m_convolution.kernelSize = parameters.kernelSize;
+    m_convolution.stride = parameters.stride;
+    m_convolution.padding = bConvolution == true ? parameters.padding : 0;
+
+    const ImageShape &inputShape = m_convolution.inputShape;
+    const size_t kernelSize = m_convolution.kernelSize;
+    const size_t stride = m_convolution.stride;
+    const size_t padding = m_convolution.padding;
+
+    ASSERT(inputShape.size() == m_numberOfInputs && kernelSize > 0 && stride > 0 &&
+        kernelSize <= inputShape.height + 2 * padding && kernelSize <= inputShape.width + 2 * padding);
+
+    ImageShape &outputShape = m_convolution.outputShape;
+    outputShape.height = (inputShape.height + 2 * padding - kernelSize) / stride + 1;
+    outputShape.width = (inputShape.width + 2 * padding - kernelSize) / stride + 1;
+    outputShape.channels = bConvolution == true ? parameters.outputChannels : inputShape.channels;
+    m_size = outputShape.size();
+
+    return bConvolution == true ? kernelSize * kernelSize * inputShape.channels * outputShape.channels : 0;
+}
+
+/*
+ * Direct convolution of HWC images, the weighted sums of one
+ * output pixel are accumulated over contiguous output channels
+ * (vectorised), by blocks of s_channelBlock channels.
+ * Output rows are split over the ThreadPool for large batches.
+ */
+void Layer::convolutionForward(const real *pInputs, size_t batchSize, real *pActivations) const
+{
+    const size_t inputChannels = m_convolution.inputShape.channels;
+    const size_t outputChannels = m_convolution.outputShape.channels;
+    const size_t rowSize = m_convolution.outputShape.width * outputChannels;
+
+    const auto computeRow = [&](size_t row)
+    {
+        const size_t b = row / m_convolution.outputShape.height;
+        const size_t y = row % m_convolution.outputShape.height;
+        const real *pSampleInputs = pInputs + b * numberOfInputs();
+        real *pRowActivations = pActivations + b * size() + y * rowSize;
+
+        std::fill(pRowActivations, pRowActivations + rowSize, 0.0);
+
+        for(size_t channelBegin = 0; channelBegin < outputChannels; channelBegin += s_channelBlock)
+        {
+            const size_t channelEnd = std::min(channelBegin + s_channelBlock, outputChannels);
+
+            for(size_t x = 0; x < m_convolution.outputShape.width; ++x)
+            {
+                real *pPixelActivations = pRowActivations + x * outputChannels;
+
+                for(size_t ky = 0; ky < m_convolution.kernelSize; ++ky)
+                {
+                    // Rows of the padding are zeros
+                    const size_t inputY = y * m_convolution.stride + ky;
+                    if(inputY < m_convolution.padding || inputY - m_convolution.padding >= m_convolution.inputShape.height)
+                    {
+                        continue;
+                    }
+
+                    for(size_t kx = 0; kx < m_convolution.kernelSize; ++kx)
+                    {
+                        const size_t inputX = x * m_convolution.stride + kx;
+                        if(inputX < m_convolution.padding || inputX - m_convolution.padding >= m_convolution.inputShape.width)
+                        {
+                            continue;
+                        }
+
+                        const real *pPixelInputs = pSampleInputs + ((inputY - m_convolution.padding) * m_convolution.inputShape.width + inputX - m_convolution.padding) * inputChannels;
+                        const real *pKernelWeights = m_aWeights.data() + (ky * m_convolution.kernelSize + kx) * inputChannels * outputChannels;
+
+                        for(size_t c = 0; c < inputChannels; ++c)
+                        {
+                            const real rInput = pPixelInputs[c];
+                            const real *pFilterWeights = pKernelWeights + c * outputChannels;
+                            for(size_t o = channelBegin; o < channelEnd; ++o)
+                            {
+                                pPixelActivations[o] += rInput * pFilterWeights[o];
+                            }
+                        }
+                    }
+                }
+            }
+        }
+    };
+
+    const size_t numberOfRows = batchSize * m_convolution.outputShape.height;
+    if(batchSize * size() * m_convolution.kernelSize * m_convolution.kernelSize * inputChannels >= s_parallelThreshold)
+    {
+        ThreadPool::global().parallelFor(numberOfRows, computeRow);
+    }
+    else
+    {
+        for(size_t row = 0; row < numberOfRows; ++row)
+        {
+            computeRow(row);
+        }
+    }
+}
+
+/*
+ * dE/dInputs is computed sample by sample and the mean
+ * gradient kernel position by kernel position, so that
+ * parallel tasks never write to the same values
+ */
+void Layer::convolutionBackward(const real *pInputs, const real *pDeltas, real *pInputDeltas, size_t batchSize, real *pGradients)
+{
+    const size_t inputChannels = m_convolution.inputShape.channels;
+    const size_t outputChannels = m_convolution.outputShape.channels;
+    const bool bParallel = batchSize * size() * m_convolution.kernelSize * m_convolution.kernelSize * inputChannels >= s_parallelThreshold;
+
+    // Calls function(inputOffset, deltaOffset) for every input pixel
+    // connected to kernel position (ky, kx) in sample b
+    const auto forEachPixel = [&](size_t b, size_t ky, size_t kx, const std::function<void(size_t, size_t)> &function)
+    {
+        for(size_t y = 0; y < m_convolution.outputShape.height; ++y)
+        {
+            const size_t inputY = y * m_convolution.stride + ky;
+            if(inputY < m_convolution.padding || inputY - m_convolution.padding >= m_convolution.inputShape.height)
+            {
+                continue;
+            }
+
+            for(size_t x = 0; x < m_convolution.outputShape.width; ++x)
+            {
+                const size_t inputX = x * m_convolution.stride + kx;
+                if(inputX < m_convolution.padding || inputX - m_convolution.padding >= m_convolution.inputShape.width)
+                {
+                    continue;
+                }
+
+                function(b * numberOfInputs() + ((inputY - m_convolution.padding) * m_convolution.inputShape.width + inputX - m_convolution.padding) * inputChannels,
+                    b * size() + (y * m_convolution.outputShape.width + x) * outputChannels);
+            }
+        }
+    };
+
+    const auto parallelFor = [bParallel](size_t count, const std::function<void(size_t)> &function)
+    {
+        if(bParallel == true)
+        {
+            ThreadPool::global().parallelFor(count, function);
+        }
+        else
+        {
+            for(size_t i = 0; i < count; ++i)
+            {
+                function(i);
+            }
+        }
+    };
+
+    // Error to send to previous layer (backpropagation): dE/dX = sum of D * W over the kernel
+    if(pInputDeltas != nullptr)
+    {
+        parallelFor(batchSize, [&](size_t b)
+        {
+            std::fill(pInputDeltas + b * numberOfInputs(), pInputDeltas + (b + 1) * numberOfInputs(), 0.0);
+
+            for(size_t ky = 0; ky < m_convolution.kernelSize; ++ky)
+            {
+                for(size_t kx = 0; kx < m_convolution.kernelSize; ++kx)
+                {
+                    const real *pKernelWeights = m_aWeights.data() + (ky * m_convolution.kernelSize + kx) * inputChannels * outputChannels;
+
+                    forEachPixel(b, ky, kx, [&](size_t inputOffset, size_t deltaOffset)
+                    {
+                        const real *pPixelDeltas = pDeltas + deltaOffset;
+                        for(size_t c = 0; c < inputChannels; ++c)
+                        {
+                            const real *pFilterWeights = pKernelWeights + c * outputChannels;
+
+                            real rSum = 0.0;
+                            for(size_t o = 0; o < outputChannels; ++o)
+                            {
+                                rSum += pFilterWeights[o] * pPixelDeltas[o];
+                            }
+                            pInputDeltas[inputOffset + c] += rSum;
+                        }
+                    });
+                }
+            }
+        });
+    }
+
+    // Mean gradient over the batch: G = sum of X * D^T / batchSize
+    const real rScale = 1.0 / static_cast<real>(batchSize);
+    parallelFor(m_convolution.kernelSize * m_convolution.kernelSize, [&](size_t k)
+    {
+        real *pKernelGradients = pGradients + k * inputChannels * outputChannels;
+        std::fill(pKernelGradients, pKernelGradients + inputChannels * outputChannels, 0.0);
+
+        for(size_t b = 0; b < batchSize; ++b)
+        {
+            forEachPixel(b, k / m_convolution.kernelSize, k % m_convolution.kernelSize, [&](size_t inputOffset, size_t deltaOffset)
+            {
+                const real *pPixelDeltas = pDeltas + deltaOffset;
+                for(size_t c = 0; c < inputChannels; ++c)
+                {
+                    const real rInput = pInputs[inputOffset + c];
+                    if(rInput == 0.0)
+                    {
+                        continue;
+                    }
+
+                    real *pFilterGradients = pKernelGradients + c * outputChannels;
+                    for(size_t o = 0; o < outputChannels; ++o)
+                    {
+                        pFilterGradients[o] += rInput * pPixelDeltas[o];
+                    }
+                }
+            });
+        }
+
+        for(size_t i = 0; i < inputChannels * outputChannels; ++i)
+        {
+            pKernelGradients[i] *= rScale;
+        }
+    });
+}
+
+/*
+ * Maximum or mean of each window, contiguous channels
+ * of a pixel are handled together
+ */
+void Layer::poolingForward(const real *pInputs, size_t batchSize, real *pOutputs) const
+{
+    const size_t channels = m_convolution.outputShape.channels;
+    const bool bMaximum = m_eLayerType == LayerType::MaxPooling;
+    const real rScale = 1.0 / static_cast<real>(m_convolution.kernelSize * m_convolution.kernelSize);
+
+    for(size_t b = 0; b < batchSize; ++b)
+    {
+        const real *pSampleInputs = pInputs + b * numberOfInputs();
+
+        for(size_t y = 0; y < m_convolution.outputShape.height; ++y)
+        {
+            for(size_t x = 0; x < m_convolution.outputShape.width; ++x)
+            {
+                real *pPixelOutputs = pOutputs + b * size() + (y * m_convolution.outputShape.width + x) * channels;
+
+                for(size_t ky = 0; ky < m_convolution.kernelSize; ++ky)
+                {
+                    for(size_t kx = 0; kx < m_convolution.kernelSize; ++kx)
+                    {
+                        const real *pPixelInputs = pSampleInputs + ((y * m_convolution.stride + ky) * m_convolution.inputShape.width + x * m_convolution.stride + kx) * channels;
+
+                        if(ky == 0 && kx == 0)
+                        {
+                            std::copy(pPixelInputs, pPixelInputs + channels, pPixelOutputs);
+                        }
+                        else if(bMaximum == true)
+                        {
+                            for(size_t c = 0; c < channels; ++c)
+                            {
+                                pPixelOutputs[c] = std::max(pPixelOutputs[c], pPixelInputs[c]);
+                            }
+                        }
+                        else
+                        {
+                            for(size_t c = 0; c < channels; ++c)
+                            {
+                                pPixelOutputs[c] += pPixelInputs[c];
+                            }
+                        }
+                    }
+                }
+
+                if(bMaximum == false)
+                {
+                    for(size_t c = 0; c < channels; ++c)
+                    {
+                        pPixelOutputs[c] *= rScale;
+                    }
+                }
+            }
+        }
+    }
+}
+
+/*
+ * Max pooling sends each delta to the first maximum
+ * of its window (found again from the inputs),
+ * average pooling shares it over the window
+ */
+void Layer::poolingBackward(const real *pInputs, const real *pDeltas, real *pInputDeltas, size_t batchSize) const
+{
+    const size_t channels = m_convolution.outputShape.channels;
+    const real rScale = 1.0 / static_cast<real>(m_convolution.kernelSize * m_convolution.kernelSize);
+
+    std::fill(pInputDeltas, pInputDeltas + batchSize * numberOfInputs(), 0.0);
+
+    for(size_t b = 0; b < batchSize; ++b)
+    {
+        for(size_t y = 0; y < m_convolution.outputShape.height; ++y)
+        {
+            for(size_t x = 0; x < m_convolution.outputShape.width; ++x)
+            {
+                const real *pPixelDeltas = pDeltas + b * size() + (y * m_convolution.outputShape.width + x) * channels;
+                const size_t windowOffset = b * numberOfInputs() + (y * m_convolution.stride * m_convolution.inputShape.width + x * m_convolution.stride) * channels;
+
+                for(size_t c = 0; c < channels; ++c)
+                {
+                    if(m_eLayerType == LayerType::MaxPooling)
+                    {
+                        size_t maximumOffset = windowOffset + c;
+                        for(size_t ky = 0; ky < m_convolution.kernelSize; ++ky)
+                        {
+                            for(size_t kx = 0; kx < m_convolution.kernelSize; ++kx)
+                            {
+                                const size_t offset = windowOffset + (ky * m_convolution.inputShape.width + kx) * channels + c;
+                                if(pInputs[offset] > pInputs[maximumOffset])
+                                {
+                                    maximumOffset = offset;
+                                }
+                            }
+                        }
+                        pInputDeltas[maximumOffset] += pPixelDeltas[c];
+                    }
+                    else
+                    {
+                        for(size_t ky = 0; ky < m_convolution.kernelSize; ++ky)
+                        {
+                            for(size_t kx = 0; kx < m_convolution.kernelSize; ++kx)
+                            {
+                                pInputDeltas[windowOffset + (ky * m_convolution.inputShape.width + kx) * channels + c] += pPixelDeltas[c] * rScale;
+                            }
+                        }
+                    }
+                }
+            }
+        }
+    }
+}
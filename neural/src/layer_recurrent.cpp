@@ -0,0 +1,358 @@
+#include "neural/layer.h"
+
+#include "neural/assert.h"
+#include "neural/gemm.h"
+
+#include <algorithm>
+#include <cmath>
+
+/*
+ * Recurrent Layers: Elman, GRU and LSTM cells stepped
+ * over the timesteps of sequences
+ */
+namespace
+{
+    INLINE real sigmoid(real rValue)
+    {
+        return 1.0 / (1.0 + exp(-rValue));
+    }
+}
+
+/*
+ * Cell and sequence from parameters, the hidden state
+ * has the size of the Layer, returns the number of weights
+ */
+size_t Layer::initializeRecurrent(const RecurrentParameters &parameters)
+{
+    m_recurrent.eRecurrentCell = parameters.eRecurrentCell;
+    m_recurrent.sequenceLength = parameters.sequenceLength;
+    m_recurrent.hiddenSize = m_size;
+    m_recurrent.bReturnSequences = parameters.bReturnSequences;
+    m_recurrent.backpropagationSteps = parameters.backpropagationSteps;
+
+    const size_t sequenceLength = m_recurrent.sequenceLength;
+    const size_t hiddenSize = m_recurrent.hiddenSize;
+
+    ASSERT(sequenceLength > 0 && m_numberOfInputs % sequenceLength == 0 && m_rDropoutRate == 0.0);
+
+    // Gates and candidates have fixed activations, biases are weights
+    if(m_recurrent.eRecurrentCell != RecurrentCell::Elman)
+    {
+        m_eActivationFunctionType = ActivationFunctionType::HyperbolicTangent;
+    }
+    m_rBias = 0.0;
+
+    m_size = m_recurrent.bReturnSequences == true ? sequenceLength * hiddenSize : hiddenSize;
+
+    return numberOfGates() * hiddenSize * (m_numberOfInputs / sequenceLength + hiddenSize + 1);
+}
+
+/*
+ * States of timestep t of sample b in row b x sequence length + t
+ * of the activations buffer (gates after their activation):
+ * Elman: weighted sums, h
+ * GRU: reset r, update z, candidate n, U_n h', h
+ * LSTM: input i, forget f, candidate g, output o, cell c, h
+ * The input projections of the whole batch are one matrix
+ * product written straight into the gate slots, only the
+ * recurrent products (one per timestep) are stepped in time.
+ */
+void Layer::recurrentForward(const real *pInputs, size_t batchSize, real *pStates, real *pOutputs) const
+{
+    const size_t hiddenSize = m_recurrent.hiddenSize;
+    const size_t inputSize = numberOfInputs() / m_recurrent.sequenceLength;
+    const size_t gateSize = numberOfGates() * hiddenSize;
+    const size_t rowSize = inputSize + hiddenSize + 1;
+    const size_t state = stateSize();
+    const size_t sampleStride = m_recurrent.sequenceLength * state;
+
+    const real *pWeights = m_aWeights.data();
+    const real *pRecurrentWeights = pWeights + inputSize;
+    const real *pBiases = pWeights + inputSize + hiddenSize;
+
+    // A = X * W^T for every timestep
+    gemm(Transpose::No, Transpose::Yes, batchSize * m_recurrent.sequenceLength, gateSize, inputSize,
+        1.0, pInputs, inputSize,
+        pWeights, rowSize,
+        0.0, pStates, state);
+
+    for(size_t t = 0; t < m_recurrent.sequenceLength; ++t)
+    {
+        real *pStep = pStates + t * state;
+
+        // A += H' * U^T, the previous hidden states end the previous rows
+        if(t > 0)
+        {
+            const real *pPreviousHidden = pStep - hiddenSize;
+            if(m_recurrent.eRecurrentCell == RecurrentCell::GatedRecurrentUnit)
+            {
+                // Reset gate applied to U_n h' afterwards
+                gemm(Transpose::No, Transpose::Yes, batchSize, 2 * hiddenSize, hiddenSize,
+                    1.0, pPreviousHidden, sampleStride,
+                    pRecurrentWeights, rowSize,
+                    1.0, pStep, sampleStride);
+                gemm(Transpose::No, Transpose::Yes, batchSize, hiddenSize, hiddenSize,
+                    1.0, pPreviousHidden, sampleStride,
+                    pRecurrentWeights + 2 * hiddenSize * rowSize, rowSize,
+                    0.0, pStep + 3 * hiddenSize, sampleStride);
+            }
+            else
+            {
+                gemm(Transpose::No, Transpose::Yes, batchSize, gateSize, hiddenSize,
+                    1.0, pPreviousHidden, sampleStride,
+                    pRecurrentWeights, rowSize,
+                    1.0, pStep, sampleStride);
+            }
+        }
+
+        for(size_t b = 0; b < batchSize; ++b)
+        {
+            real *pState = pStep + b * sampleStride;
+            real *pHidden = pState + state - hiddenSize;
+            const real *pPreviousState = pState - state;
+
+            switch(m_recurrent.eRecurrentCell)
+            {
+            case RecurrentCell::Elman:
+                for(size_t j = 0; j < hiddenSize; ++j)
+                {
+                    pState[j] += pBiases[j * rowSize];
+                    pHidden[j] = m_pfActivationFunctionPtr(pState[j]);
+                }
+                break;
+            case RecurrentCell::GatedRecurrentUnit:
+                for(size_t j = 0; j < hiddenSize; ++j)
+                {
+                    const real rReset = sigmoid(pState[j] + pBiases[j * rowSize]);
+                    const real rUpdate = sigmoid(pState[hiddenSize + j] + pBiases[(hiddenSize + j) * rowSize]);
+                    const real rRecurrentCandidate = t > 0 ? pState[3 * hiddenSize + j] : 0.0;
+                    const real rCandidate = tanh(pState[2 * hiddenSize + j] + pBiases[(2 * hiddenSize + j) * rowSize] + rReset * rRecurrentCandidate);
+                    const real rPreviousHidden = t > 0 ? pPreviousState[state - hiddenSize + j] : 0.0;
+
+                    pState[j] = rReset;
+                    pState[hiddenSize + j] = rUpdate;
+                    pState[2 * hiddenSize + j] = rCandidate;
+                    pState[3 * hiddenSize + j] = rRecurrentCandidate;
+                    pHidden[j] = (1.0 - rUpdate) * rCandidate + rUpdate * rPreviousHidden;
+                }
+                break;
+            case RecurrentCell::LongShortTermMemory:
+                for(size_t j = 0; j < hiddenSize; ++j)
+                {
+                    const real rInput = sigmoid(pState[j] + pBiases[j * rowSize]);
+                    const real rForget = sigmoid(pState[hiddenSize + j] + pBiases[(hiddenSize + j) * rowSize]);
+                    const real rCandidate = tanh(pState[2 * hiddenSize + j] + pBiases[(2 * hiddenSize + j) * rowSize]);
+                    const real rOutput = sigmoid(pState[3 * hiddenSize + j] + pBiases[(3 * hiddenSize + j) * rowSize]);
+                    const real rPreviousCell = t > 0 ? pPreviousState[4 * hiddenSize + j] : 0.0;
+                    const real rCell = rForget * rPreviousCell + rInput * rCandidate;
+
+                    pState[j] = rInput;
+                    pState[hiddenSize + j] = rForget;
+                    pState[2 * hiddenSize + j] = rCandidate;
+                    pState[3 * hiddenSize + j] = rOutput;
+                    pState[4 * hiddenSize + j] = rCell;
+                    pHidden[j] = rOutput * tanh(rCell);
+                }
+                break;
+            }
+
+            if(m_recurrent.bReturnSequences == true || t + 1 == m_recurrent.sequenceLength)
+            {
+                std::copy(pHidden, pHidden + hiddenSize, pOutputs + b * size() + (m_recurrent.bReturnSequences == true ? t * hiddenSize : 0));
+            }
+        }
+    }
+}
+
+/*
+ * Backpropagation through time: dE/dh goes from the last
+ * timestep to the first through one matrix product per
+ * timestep. The deltas of the gate pre-activations of every
+ * timestep are kept, so that the gradients and dE/dInputs
+ * are matrix products over the whole batch of sequences.
+ */
+void Layer::recurrentBackward(const real *pInputs, const real *pStates, const real *pDeltas, real *pInputDeltas, size_t batchSize,
+    real *pGradients)
+{
+    const bool bGatedRecurrentUnit = m_recurrent.eRecurrentCell == RecurrentCell::GatedRecurrentUnit;
+    const size_t hiddenSize = m_recurrent.hiddenSize;
+    const size_t inputSize = numberOfInputs() / m_recurrent.sequenceLength;
+    const size_t gateSize = numberOfGates() * hiddenSize;
+    const size_t rowSize = inputSize + hiddenSize + 1;
+    const size_t state = stateSize();
+    const size_t sampleStride = m_recurrent.sequenceLength * state;
+
+    // GRU rows hold the deltas of r, z, U_n h' and n, so
+    // that the ones of the recurrent products are contiguous
+    const size_t deltaSize = bGatedRecurrentUnit == true ? gateSize + hiddenSize : gateSize;
+    const size_t deltaStride = m_recurrent.sequenceLength * deltaSize;
+
+    const size_t steps = (m_recurrent.backpropagationSteps == 0 || m_recurrent.backpropagationSteps > m_recurrent.sequenceLength) ? m_recurrent.sequenceLength : m_recurrent.backpropagationSteps;
+    const size_t first = m_recurrent.bReturnSequences == true ? 0 : m_recurrent.sequenceLength - steps;
+
+    const real *pWeights = m_aWeights.data();
+    const real *pRecurrentWeights = pWeights + inputSize;
+
+    // Sequence deltas, dE/dh and dE/dc of the batch, bias gradients
+    thread_local std::vector<real> t_arDeltas;
+    t_arDeltas.assign(batchSize * (deltaStride + 2 * hiddenSize) + gateSize, 0.0);
+    real *pSequenceDeltas = t_arDeltas.data();
+    real *pHiddenDeltas = pSequenceDeltas + batchSize * deltaStride;
+    real *pCellDeltas = pHiddenDeltas + batchSize * hiddenSize;
+    real *pBiasGradients = pCellDeltas + batchSize * hiddenSize;
+
+    for(size_t t = m_recurrent.sequenceLength; t-- > first;)
+    {
+        real *pStepDeltas = pSequenceDeltas + t * deltaSize;
+
+        for(size_t b = 0; b < batchSize; ++b)
+        {
+            const real *pState = pStates + b * sampleStride + t * state;
+            const real *pPreviousState = pState - state;
+            real *pDelta = pStepDeltas + b * deltaStride;
+            real *pHiddenDelta = pHiddenDeltas + b * hiddenSize;
+            real *pCellDelta = pCellDeltas + b * hiddenSize;
+
+            if(m_recurrent.bReturnSequences == true || t + 1 == m_recurrent.sequenceLength)
+            {
+                const real *pOutputDeltas = pDeltas + b * size() + (m_recurrent.bReturnSequences == true ? t * hiddenSize : 0);
+                for(size_t j = 0; j < hiddenSize; ++j)
+                {
+                    pHiddenDelta[j] += pOutputDeltas[j];
+                }
+            }
+
+            switch(m_recurrent.eRecurrentCell)
+            {
+            case RecurrentCell::Elman:
+                for(size_t j = 0; j < hiddenSize; ++j)
+                {
+                    pDelta[j] = pHiddenDelta[j] * m_pfActivationDerivativePtr(pState[j]);
+                }
+                break;
+            case RecurrentCell::GatedRecurrentUnit:
+                for(size_t j = 0; j < hiddenSize; ++j)
+                {
+                    const real rReset = pState[j];
+                    const real rUpdate = pState[hiddenSize + j];
+                    const real rCandidate = pState[2 * hiddenSize + j];
+                    const real rRecurrentCandidate = pState[3 * hiddenSize + j];
+                    const real rPreviousHidden = t > 0 ? pPreviousState[state - hiddenSize + j] : 0.0;
+                    const real rHiddenDelta = pHiddenDelta[j];
+                    const real rCandidateDelta = rHiddenDelta * (1.0 - rUpdate) * (1.0 - rCandidate * rCandidate);
+
+                    pDelta[j] = rCandidateDelta * rRecurrentCandidate * rReset * (1.0 - rReset);
+                    pDelta[hiddenSize + j] = rHiddenDelta * (rPreviousHidden - rCandidate) * rUpdate * (1.0 - rUpdate);
+                    pDelta[2 * hiddenSize + j] = rCandidateDelta * rReset;
+                    pDelta[3 * hiddenSize + j] = rCandidateDelta;
+
+                    // Direct path to h', the recurrent products are added below
+                    pHiddenDelta[j] = rHiddenDelta * rUpdate;
+                }
+                break;
+            case RecurrentCell::LongShortTermMemory:
+                for(size_t j = 0; j < hiddenSize; ++j)
+                {
+                    const real rInput = pState[j];
+                    const real rForget = pState[hiddenSize + j];
+                    const real rCandidate = pState[2 * hiddenSize + j];
+                    const real rOutput = pState[3 * hiddenSize + j];
+                    const real rCell = tanh(pState[4 * hiddenSize + j]);
+                    const real rPreviousCell = t > 0 ? pPreviousState[4 * hiddenSize + j] : 0.0;
+                    const real rHiddenDelta = pHiddenDelta[j];
+                    const real rCellDelta = pCellDelta[j] + rHiddenDelta * rOutput * (1.0 - rCell * rCell);
+
+                    pDelta[j] = rCellDelta * rCandidate * rInput * (1.0 - rInput);
+                    pDelta[hiddenSize + j] = rCellDelta * rPreviousCell * rForget * (1.0 - rForget);
+                    pDelta[2 * hiddenSize + j] = rCellDelta * rInput * (1.0 - rCandidate * rCandidate);
+                    pDelta[3 * hiddenSize + j] = rHiddenDelta * rCell * rOutput * (1.0 - rOutput);
+
+                    pCellDelta[j] = rCellDelta * rForget;
+                }
+                break;
+            }
+        }
+
+        if(t == 0)
+        {
+            break;
+        }
+
+        // dE/dh' = D * U, cut at the start of a block of steps
+        if((m_recurrent.sequenceLength - t) % steps == 0)
+        {
+            std::fill(pHiddenDeltas, pHiddenDeltas + 2 * batchSize * hiddenSize, 0.0);
+        }
+        else
+        {
+            gemm(Transpose::No, Transpose::No, batchSize, hiddenSize, gateSize,
+                1.0, pStepDeltas, deltaStride,
+                pRecurrentWeights, rowSize,
+                bGatedRecurrentUnit == true ? 1.0 : 0.0, pHiddenDeltas, hiddenSize);
+        }
+    }
+
+    const size_t numberOfRows = batchSize * m_recurrent.sequenceLength;
+    const real rScale = 1.0 / static_cast<real>(batchSize);
+
+    // Mean gradient of the input weights: G = D^T * X / batchSize,
+    // then dE/dX = D * W (for GRU, n has its own block of deltas)
+    const size_t inputGates = bGatedRecurrentUnit == true ? 2 * hiddenSize : gateSize;
+    gemm(Transpose::Yes, Transpose::No, inputGates, inputSize, numberOfRows,
+        rScale, pSequenceDeltas, deltaSize,
+        pInputs, inputSize,
+        0.0, pGradients, rowSize);
+    if(bGatedRecurrentUnit == true)
+    {
+        gemm(Transpose::Yes, Transpose::No, hiddenSize, inputSize, numberOfRows,
+            rScale, pSequenceDeltas + 3 * hiddenSize, deltaSize,
+            pInputs, inputSize,
+            0.0, pGradients + 2 * hiddenSize * rowSize, rowSize);
+    }
+
+    if(pInputDeltas != nullptr)
+    {
+        gemm(Transpose::No, Transpose::No, numberOfRows, inputSize, inputGates,
+            1.0, pSequenceDeltas, deltaSize,
+            pWeights, rowSize,
+            0.0, pInputDeltas, inputSize);
+        if(bGatedRecurrentUnit == true)
+        {
+            gemm(Transpose::No, Transpose::No, numberOfRows, inputSize, hiddenSize,
+                1.0, pSequenceDeltas + 3 * hiddenSize, deltaSize,
+                pWeights + 2 * hiddenSize * rowSize, rowSize,
+                1.0, pInputDeltas, inputSize);
+        }
+    }
+
+    // Recurrent weights: G = sum over the timesteps of D^T * H' / batchSize
+    for(size_t i = 0; i < gateSize; ++i)
+    {
+        std::fill(pGradients + i * rowSize + inputSize, pGradients + i * rowSize + inputSize + hiddenSize, 0.0);
+    }
+    for(size_t t = std::max<size_t>(first, 1); t < m_recurrent.sequenceLength; ++t)
+    {
+        gemm(Transpose::Yes, Transpose::No, gateSize, hiddenSize, batchSize,
+            rScale, pSequenceDeltas + t * deltaSize, deltaStride,
+            pStates + t * state - hiddenSize, sampleStride,
+            1.0, pGradients + inputSize, rowSize);
+    }
+
+    // Biases: mean of the pre-activation deltas
+    for(size_t row = 0; row < numberOfRows; ++row)
+    {
+        const real *pDelta = pSequenceDeltas + row * deltaSize;
+        for(size_t i = 0; i < inputGates; ++i)
+        {
+            pBiasGradients[i] += pDelta[i];
+        }
+        for(size_t i = inputGates; i < gateSize; ++i)
+        {
+            pBiasGradients[i] += pDelta[i + hiddenSize];
+        }
+    }
+    for(size_t i = 0; i < gateSize; ++i)
+    {
+        pGradients[i * rowSize + rowSize - 1] = pBiasGradients[i] * rScale;
+    }
+}
@@ -0,0 +1,133 @@
+#include "neural/loss_function.h"
+
+#include "neural/assert.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace
+{
+    // Smallest probability taken in a logarithm
+    const real s_rMinimumProbability = std::numeric_limits<real>::min();
+
+    INLINE real logProbability(real rProbability)
+    {
+        return log(std::max(rProbability, s_rMinimumProbability));
+    }
+}
+
+LossFunction::LossFunction(LossFunctionType eLossFunctionType, real rHuberDelta) :
+    m_eLossFunctionType(eLossFunctionType),
+    m_rHuberDelta(rHuberDelta)
+{
+    ASSERT(rHuberDelta > 0.0);
+}
+
+void LossFunction::transform(real *pOutputs, size_t batchSize, size_t numberOfOutputs) const
+{
+    const size_t count = batchSize * numberOfOutputs;
+
+    switch(m_eLossFunctionType)
+    {
+    case LossFunctionType::SoftmaxCrossEntropy:
+        for(size_t b = 0; b < batchSize; ++b)
+        {
+            real *pSample = pOutputs + b * numberOfOutputs;
+
+            // Shifted by the largest logit, exp cannot overflow
+            const real rMaximum = *std::max_element(pSample, pSample + numberOfOutputs);
+            real rSum = 0.0;
+            for(size_t j = 0; j < numberOfOutputs; ++j)
+            {
+                pSample[j] = exp(pSample[j] - rMaximum);
+                rSum += pSample[j];
+            }
+
+            const real rInverseSum = 1.0 / rSum;
+            for(size_t j = 0; j < numberOfOutputs; ++j)
+            {
+                pSample[j] *= rInverseSum;
+            }
+        }
+        break;
+    case LossFunctionType::SigmoidCrossEntropy:
+        for(size_t i = 0; i < count; ++i)
+        {
+            pOutputs[i] = 1.0 / (1.0 + exp(-pOutputs[i]));
+        }
+        break;
+    default:
+        break;
+    }
+}
+
+real LossFunction::evaluate(const real *pOutputs, const real *pTargetOutputs, size_t batchSize, size_t numberOfOutputs,
+    real *pDeltas) const
+{
+    const size_t count = batchSize * numberOfOutputs;
+    real rLoss = 0.0;
+
+    // One loop per loss, the switch stays out of the inner loops
+    switch(m_eLossFunctionType)
+    {
+    case LossFunctionType::MeanSquaredError:
+        for(size_t i = 0; i < count; ++i)
+        {
+            const real rDifference = pOutputs[i] - pTargetOutputs[i];
+            rLoss += 0.5 * rDifference * rDifference;
+            if(pDeltas != nullptr)
+            {
+                pDeltas[i] = rDifference;
+            }
+        }
+        break;
+    case LossFunctionType::MeanAbsoluteError:
+        for(size_t i = 0; i < count; ++i)
+        {
+            const real rDifference = pOutputs[i] - pTargetOutputs[i];
+            rLoss += fabs(rDifference);
+            if(pDeltas != nullptr)
+            {
+                pDeltas[i] = static_cast<real>((rDifference > 0.0) - (rDifference < 0.0));
+            }
+        }
+        break;
+    case LossFunctionType::Huber:
+        for(size_t i = 0; i < count; ++i)
+        {
+            const real rDifference = pOutputs[i] - pTargetOutputs[i];
+            const real rClipped = std::min(std::max(rDifference, -m_rHuberDelta), m_rHuberDelta);
+
+            // 1/2 d^2 inside, linear with slope delta outside
+            rLoss += rClipped * (rDifference - 0.5 * rClipped);
+            if(pDeltas != nullptr)
+            {
+                pDeltas[i] = rClipped;
+            }
+        }
+        break;
+    case LossFunctionType::SoftmaxCrossEntropy:
+        for(size_t i = 0; i < count; ++i)
+        {
+            rLoss -= pTargetOutputs[i] * logProbability(pOutputs[i]);
+            if(pDeltas != nullptr)
+            {
+                pDeltas[i] = pOutputs[i] - pTargetOutputs[i];
+            }
+        }
+        break;
+    case LossFunctionType::SigmoidCrossEntropy:
+        for(size_t i = 0; i < count; ++i)
+        {
+            rLoss -= pTargetOutputs[i] * logProbability(pOutputs[i]) + (1.0 - pTargetOutputs[i]) * logProbability(1.0 - pOutputs[i]);
+            if(pDeltas != nullptr)
+            {
+                pDeltas[i] = pOutputs[i] - pTargetOutputs[i];
+            }
+        }
+        break;
+    }
+
+    return rLoss;
+}
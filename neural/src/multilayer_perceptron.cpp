@@ -1,91 +1,475 @@
 #include "neural/multilayer_perceptron.h"
 
 #include "neural/assert.h"
+#include "neural/profiler.h"
+#include "neural/telemetry.h"
+#include "serialisation.h"
 
-MultilayerPerceptron::MultilayerPerceptron(const MultilayerPerceptronParameters &parameters)
+#include <algorithm>
+#include <cmath>
+
+MultilayerPerceptron::MultilayerPerceptron(const MultilayerPerceptronParameters &parameters) :
+    m_lossFunction(parameters.eLossFunctionType, parameters.rHuberDelta),
+    m_checkpointInterval(parameters.checkpointInterval)
 {
     ASSERT(parameters.aLayerParameters.size() > 0 && parameters.numberOfInputs > 0);
+    ASSERT(m_lossFunction.fused() == false ||
+        parameters.aLayerParameters.back().perceptronParameters.eActivationFunctionType == ActivationFunctionType::Linear);
 
     m_aLayers.reserve(parameters.aLayerParameters.size());
-    m_aOutputs.resize(parameters.aLayerParameters.size());
-    m_aErrors.resize(parameters.aLayerParameters.size());
 
     m_numberOfInputs = parameters.numberOfInputs;
     size_t previousLayerSize = m_numberOfInputs;
 
+    // One stream per network, split per Layer
+    const RandomStream randomStream(parameters.seed != RandomStream::s_unsetSeed ? parameters.seed : e_uiSeed++);
+
     for(size_t i = 0; i < parameters.aLayerParameters.size(); ++i)
     {
-        m_aLayers.push_back(Layer(previousLayerSize, parameters.aLayerParameters[i]));
+        // Images coming out of a convolution or pooling Layer keep their shape
+        LayerParameters layerParameters = parameters.aLayerParameters[i];
+        if(i > 0 && m_aLayers[i - 1].spatial() == true && layerParameters.convolution.inputShape.size() == 0)
+        {
+            layerParameters.convolution.inputShape = m_aLayers[i - 1].outputShape();
+        }
+
+        // So do sequences coming out of a recurrent Layer
+        if(i > 0 && m_aLayers[i - 1].layerType() == LayerType::Recurrent && m_aLayers[i - 1].returnSequences() == true &&
+            layerParameters.recurrent.sequenceLength == 0)
+        {
+            layerParameters.recurrent.sequenceLength = m_aLayers[i - 1].sequenceLength();
+        }
+
+        m_aLayers.push_back(Layer(previousLayerSize, layerParameters,
+            layerParameters.seed != RandomStream::s_unsetSeed ? RandomStream(layerParameters.seed) : randomStream.split(i)));
         previousLayerSize = m_aLayers[i].size();
-        m_aOutputs[i].resize(parameters.aLayerParameters[i].layerSize);
-        m_aErrors[i].resize(parameters.aLayerParameters[i].layerSize);
-        for(size_t j = 0; j < parameters.aLayerParameters[i].layerSize; ++j)
+    }
+
+    resizeWorkspace(m_workspace, 1);
+}
+
+const LayerOutputs &MultilayerPerceptron::evaluate(const LayerInputs &aInputs)
+{
+    ASSERT(aInputs.size() == m_numberOfInputs);
+
+    return evaluate(aInputs.data(), 1);
+}
+
+real MultilayerPerceptron::train(const LayerInputs &aInputs, const LayerOutputs &aTargetOuputs)
+{
+    ASSERT(aInputs.size() == m_numberOfInputs && aTargetOuputs.size() == m_aLayers.back().size());
+
+    return train(aInputs.data(), aTargetOuputs.data(), 1);
+}
+
+const LayerOutputs &MultilayerPerceptron::evaluate(const real *pInputs, size_t batchSize)
+{
+    resizeWorkspace(m_workspace, batchSize);
+    m_peakWorkspaceBytes = std::max(m_peakWorkspaceBytes, workspaceBytes(m_workspace));
+
+    forward(pInputs, batchSize, 0, m_aLayers.size(), m_workspace, false, 0, m_pProfiler);
+
+    return m_workspace.aCheckpoints.back();
+}
+
+const LayerOutputs &MultilayerPerceptron::evaluate(const real *pInputs, size_t batchSize, MultilayerPerceptronWorkspace &workspace) const
+{
+    resizeWorkspace(workspace, batchSize);
+
+    forward(pInputs, batchSize, 0, m_aLayers.size(), workspace, false, 0);
+
+    return workspace.aCheckpoints.back();
+}
+
+/*
+ * Train on a batch and return the sum of the
+ * losses of its samples before the update
+ */
+real MultilayerPerceptron::train(const real *pInputs, const real *pTargetOutputs, size_t batchSize)
+{
+    resizeWorkspace(m_workspace, batchSize);
+    m_peakWorkspaceBytes = std::max(m_peakWorkspaceBytes, workspaceBytes(m_workspace));
+
+    const uint64_t step = m_trainingStep++;
+
+    /*
+     * Forward propagation
+     */
+    {
+        ScopedTimer timer(m_pTelemetry, TrainingPhase::Forward);
+
+        // Inputs layer, hidden layers, output layer
+        forward(pInputs, batchSize, 0, m_aLayers.size(), m_workspace, true, step, m_pProfiler);
+    }
+
+    const real rError = outputDeltas(pTargetOutputs, batchSize, m_workspace);
+
+    /*
+     * Back propagation, one segment at a time
+     * Errors sent to previous layers use the weights before the update
+     */
+    {
+        ScopedTimer timer(m_pTelemetry, TrainingPhase::Backward);
+
+        const size_t interval = m_workspace.checkpointInterval;
+        for(size_t end = m_aLayers.size(); end > 0;)
         {
-            if(i > 0)
+            const size_t begin = (end - 1) / interval * interval;
+
+            // Buffers of the last segment still hold its forward pass,
+            // the others are recomputed from the previous checkpoint
+            // (dropout masks only depend on the step)
+            if(end < m_aLayers.size())
             {
-                m_aErrors[i][j].resize(parameters.aLayerParameters[i - 1].layerSize);
+                forward(pInputs, batchSize, begin, end, m_workspace, true, step, m_pProfiler);
             }
-            else
+
+            for(size_t i = end; i-- > begin;)
             {
-                m_aErrors[i][j].resize(parameters.numberOfInputs);
+                const real *pLayerInputs = (i > 0) ? outputs(m_workspace, i - 1) : pInputs;
+                real *pInputDeltas = (i > 0) ? deltas(m_workspace, i - 1) : nullptr;
+                ScopedLayerTimer layerTimer(m_pProfiler, i, m_aLayers[i], TrainingPhase::Backward, batchSize, i > 0);
+                m_aLayers[i].backward(pLayerInputs, activations(m_workspace, i), deltas(m_workspace, i), pInputDeltas, batchSize,
+                    dropoutMask(m_workspace, i));
             }
+
+            end = begin;
         }
     }
+
+    {
+        ScopedTimer timer(m_pTelemetry, TrainingPhase::Update);
+
+        for(size_t i = 0; i < m_aLayers.size(); ++i)
+        {
+            ScopedLayerTimer layerTimer(m_pProfiler, i, m_aLayers[i], TrainingPhase::Update, batchSize, false);
+            m_aLayers[i].update();
+        }
+    }
+
+    if(m_pTelemetry != nullptr && m_pTelemetry->gradientNormsEnabled() == true)
+    {
+        m_pTelemetry->addGradientSquaredNorm(gradientSquaredNorm());
+    }
+
+    return rError;
 }
 
-const LayerOutputs &MultilayerPerceptron::evaluate(const LayerInputs &aInputs)
+real MultilayerPerceptron::trainAsynchronous(const real *pInputs, const real *pTargetOutputs, MultilayerPerceptronWorkspace &workspace)
 {
-    ASSERT(aInputs.size() == m_numberOfInputs);
+    resizeWorkspace(workspace, 1);
+
+    // Forward propagation
+    forward(pInputs, 1, 0, m_aLayers.size(), workspace, false, 0);
 
-    // Inputs layer
-    m_aLayers[0].evaluate(aInputs, m_aOutputs[0]);
+    const real rError = outputDeltas(pTargetOutputs, 1, workspace);
 
-    // Hidden layers + Output layer
-    for(size_t i = 1; i < m_aLayers.size(); ++i)
+    // Back propagation, each Layer is updated right after its backward pass
+    const size_t interval = workspace.checkpointInterval;
+    for(size_t end = m_aLayers.size(); end > 0;)
     {
-        m_aLayers[i].evaluate(m_aOutputs[i - 1], m_aOutputs[i]);
+        const size_t begin = (end - 1) / interval * interval;
+        if(end < m_aLayers.size())
+        {
+            forward(pInputs, 1, begin, end, workspace, false, 0);
+        }
+
+        for(size_t i = end; i-- > begin;)
+        {
+            const real *pLayerInputs = (i > 0) ? outputs(workspace, i - 1) : pInputs;
+            real *pInputDeltas = (i > 0) ? deltas(workspace, i - 1) : nullptr;
+            m_aLayers[i].trainAsynchronous(pLayerInputs, activations(workspace, i), deltas(workspace, i), pInputDeltas);
+        }
+
+        end = begin;
     }
 
-    return m_aOutputs.back();
+    return rError;
 }
 
-void MultilayerPerceptron::train(const LayerInputs &aInputs, const LayerOutputs &aTargetOuputs)
+const Layer &MultilayerPerceptron::layer(const size_t &i) const
 {
-    ASSERT(aInputs.size() == m_numberOfInputs && aTargetOuputs.size() == m_aLayers.back().size());
+    ASSERT(i < m_aLayers.size());
+    return m_aLayers[i];
+}
 
-    /*
-     * Forward propagation
-     */
+Layer &MultilayerPerceptron::layer(const size_t &i)
+{
+    ASSERT(i < m_aLayers.size());
+    return m_aLayers[i];
+}
+
+size_t MultilayerPerceptron::numberOfParameters(bool bOptimizerState) const
+{
+    size_t numberOfWeights = 0;
+    for(size_t i = 0; i < m_aLayers.size(); ++i)
+    {
+        numberOfWeights += m_aLayers[i].weights().size();
+    }
+
+    return bOptimizerState == true ? 2 * numberOfWeights : numberOfWeights;
+}
+
+void MultilayerPerceptron::exportParameters(Span<real> arParameters, bool bOptimizerState) const
+{
+    ASSERT(arParameters.contiguous() == true && arParameters.size() == numberOfParameters(bOptimizerState));
 
-    // Inputs layer
-    m_aLayers[0].evaluate(aInputs, m_aOutputs[0]);
+    real *pParameters = arParameters.data();
+    for(size_t i = 0; i < m_aLayers.size(); ++i)
+    {
+        const Span<const real> arWeights = m_aLayers[i].weightValues();
+        pParameters = std::copy(arWeights.data(), arWeights.data() + arWeights.size(), pParameters);
+    }
 
-    // Hidden layers + Output layer
-    for(size_t i = 1; i < m_aLayers.size(); ++i)
+    if(bOptimizerState == true)
     {
-        m_aLayers[i].evaluate(m_aOutputs[i - 1], m_aOutputs[i]);
+        for(size_t i = 0; i < m_aLayers.size(); ++i)
+        {
+            const Span<const real> arSavedDerivatives = m_aLayers[i].savedDerivatives();
+            pParameters = std::copy(arSavedDerivatives.data(), arSavedDerivatives.data() + arSavedDerivatives.size(), pParameters);
+        }
     }
+}
 
-    /*
-     * Back propagation
-     */
+void MultilayerPerceptron::importParameters(Span<const real> arParameters, bool bOptimizerState)
+{
+    ASSERT(arParameters.contiguous() == true && arParameters.size() == numberOfParameters(bOptimizerState));
+
+    const real *pParameters = arParameters.data();
+    for(size_t i = 0; i < m_aLayers.size(); ++i)
+    {
+        m_aLayers[i].setWeights(pParameters);
+        pParameters += m_aLayers[i].weights().size();
+    }
 
-    // Outputs layer
-    size_t i = m_aLayers.size() - 1;
-    m_aLayers.back().train(m_aOutputs[m_aOutputs.size() - 2], aTargetOuputs, m_aErrors[i]);
+    if(bOptimizerState == true)
+    {
+        for(size_t i = 0; i < m_aLayers.size(); ++i)
+        {
+            m_aLayers[i].setSavedDerivatives(pParameters);
+            pParameters += m_aLayers[i].savedDerivatives().size();
+        }
+    }
+}
+
+real MultilayerPerceptron::gradientSquaredNorm() const
+{
+    real rSquaredNorm = 0.0;
 
-    // Hidden layers
-    for(size_t i = m_aLayers.size() - 2; i > 0; --i)
+    for(size_t i = 0; i < m_aLayers.size(); ++i)
     {
-        m_aLayers[i].train(m_aOutputs[i - 1], m_aErrors[i + 1], m_aErrors[i]);
+        rSquaredNorm += m_aLayers[i].gradientSquaredNorm();
     }
 
-    // Inputs layer
-    m_aLayers.front().train(aInputs, m_aErrors[1], m_aErrors[0]);
+    return rSquaredNorm;
 }
 
-Layer MultilayerPerceptron::layer(const size_t &i) const
+void MultilayerPerceptron::write(std::ostream &stream) const
 {
-    ASSERT(i <= m_aLayers.size());
-    return m_aLayers[i];
+    Serialisation::write(stream, static_cast<uint64_t>(m_numberOfInputs));
+    Serialisation::write(stream, static_cast<uint64_t>(m_aLayers.size()));
+    Serialisation::write(stream, m_trainingStep);
+
+    for(size_t i = 0; i < m_aLayers.size(); ++i)
+    {
+        m_aLayers[i].write(stream);
+    }
+}
+
+/*
+ * Multilayer Perceptron must be constructed with
+ * the parameters of the saved one
+ */
+bool MultilayerPerceptron::read(std::istream &stream)
+{
+    uint64_t numberOfInputs = 0;
+    uint64_t numberOfLayers = 0;
+    if(Serialisation::read(stream, numberOfInputs) == false || Serialisation::read(stream, numberOfLayers) == false ||
+        numberOfInputs != m_numberOfInputs || numberOfLayers != m_aLayers.size() ||
+        Serialisation::read(stream, m_trainingStep) == false)
+    {
+        return false;
+    }
+
+    for(size_t i = 0; i < m_aLayers.size(); ++i)
+    {
+        if(m_aLayers[i].read(stream) == false)
+        {
+            return false;
+        }
+    }
+
+    // Dropout rates are read too, the dropout masks are laid out again
+    m_workspace.batchSize = 0;
+
+    return true;
+}
+
+void MultilayerPerceptron::setBackpropagationSteps(size_t backpropagationSteps)
+{
+    for(size_t i = 0; i < m_aLayers.size(); ++i)
+    {
+        m_aLayers[i].setBackpropagationSteps(backpropagationSteps);
+    }
+}
+
+void MultilayerPerceptron::setCheckpointInterval(size_t checkpointInterval)
+{
+    m_checkpointInterval = checkpointInterval;
+
+    // Release the buffers of the previous layout
+    m_workspace = MultilayerPerceptronWorkspace();
+}
+
+size_t MultilayerPerceptron::workspaceBytes(const MultilayerPerceptronWorkspace &workspace)
+{
+    size_t bytes = 0;
+
+    for(const std::vector<LayerOutputs> *pBuffers : {&workspace.aCheckpoints, &workspace.aActivations,
+        &workspace.aOutputs, &workspace.aDropoutMasks, &workspace.aDeltas})
+    {
+        for(size_t i = 0; i < pBuffers->size(); ++i)
+        {
+            bytes += (*pBuffers)[i].capacity() * sizeof(real);
+        }
+    }
+
+    return bytes;
+}
+
+/*
+ * Lay the workspace out for batchSize samples: each
+ * shared buffer is sized for the largest Layer using it
+ */
+void MultilayerPerceptron::resizeWorkspace(MultilayerPerceptronWorkspace &workspace, size_t batchSize) const
+{
+    const size_t numberOfLayers = m_aLayers.size();
+    const size_t interval = (m_checkpointInterval <= 1 || m_checkpointInterval >= numberOfLayers) ? numberOfLayers : m_checkpointInterval;
+
+    // Nothing to do on the hot path (same batch size as the previous pass)
+    if(workspace.checkpointInterval == interval && workspace.batchSize == batchSize)
+    {
+        return;
+    }
+
+    if(workspace.checkpointInterval != interval)
+    {
+        workspace = MultilayerPerceptronWorkspace();
+        workspace.checkpointInterval = interval;
+    }
+    workspace.batchSize = batchSize;
+
+    std::vector<size_t> aCheckpointSizes(numberOfLayers, 0);
+    std::vector<size_t> aActivationSizes(interval, 0);
+    std::vector<size_t> aOutputSizes(interval, 0);
+    std::vector<size_t> aDropoutMaskSizes(interval, 0);
+    std::vector<size_t> aDeltaSizes(2, 0);
+
+    for(size_t i = 0; i < numberOfLayers; ++i)
+    {
+        const size_t layerSize = batchSize * m_aLayers[i].size();
+        const size_t slot = i % interval;
+
+        if(checkpointed(workspace, i) == true)
+        {
+            aCheckpointSizes[i] = layerSize;
+        }
+        else
+        {
+            aOutputSizes[slot] = std::max(aOutputSizes[slot], layerSize);
+        }
+
+        aActivationSizes[slot] = std::max(aActivationSizes[slot], batchSize * m_aLayers[i].activationsSize());
+        aDeltaSizes[i % 2] = std::max(aDeltaSizes[i % 2], layerSize);
+
+        if(m_aLayers[i].dropoutRate() > 0.0 && i + 1 < numberOfLayers)
+        {
+            aDropoutMaskSizes[slot] = std::max(aDropoutMaskSizes[slot], layerSize);
+        }
+    }
+
+    const auto resizeBuffers = [](std::vector<LayerOutputs> &aBuffers, const std::vector<size_t> &aSizes)
+    {
+        aBuffers.resize(aSizes.size());
+        for(size_t i = 0; i < aSizes.size(); ++i)
+        {
+            aBuffers[i].resize(aSizes[i]);
+        }
+    };
+
+    resizeBuffers(workspace.aCheckpoints, aCheckpointSizes);
+    resizeBuffers(workspace.aActivations, aActivationSizes);
+    resizeBuffers(workspace.aOutputs, aOutputSizes);
+    resizeBuffers(workspace.aDropoutMasks, aDropoutMaskSizes);
+    resizeBuffers(workspace.aDeltas, aDeltaSizes);
+}
+
+/*
+ * Forward pass of Layers [begin, end), the inputs of
+ * Layer begin must be in the workspace (or be pInputs).
+ * Recomputed segments are profiled as forward passes.
+ */
+void MultilayerPerceptron::forward(const real *pInputs, size_t batchSize, size_t begin, size_t end,
+    MultilayerPerceptronWorkspace &workspace, bool bDropout, uint64_t step, Profiler *pProfiler) const
+{
+    for(size_t i = begin; i < end; ++i)
+    {
+        const real *pLayerInputs = (i > 0) ? outputs(workspace, i - 1) : pInputs;
+        ScopedLayerTimer layerTimer(pProfiler, i, m_aLayers[i], TrainingPhase::Forward, batchSize, false);
+        m_aLayers[i].forward(pLayerInputs, batchSize, activations(workspace, i), outputs(workspace, i),
+            bDropout == true ? dropoutMask(workspace, i) : nullptr, step);
+    }
+
+    if(end == m_aLayers.size())
+    {
+        m_lossFunction.transform(outputs(workspace, end - 1), batchSize, numberOfOutputs());
+    }
+}
+
+/*
+ * Outputs of the last Layer of every segment are kept
+ */
+bool MultilayerPerceptron::checkpointed(const MultilayerPerceptronWorkspace &workspace, size_t i) const
+{
+    return (i % workspace.checkpointInterval) + 1 == workspace.checkpointInterval || i + 1 == m_aLayers.size();
+}
+
+real *MultilayerPerceptron::activations(MultilayerPerceptronWorkspace &workspace, size_t i) const
+{
+    return workspace.aActivations[i % workspace.checkpointInterval].data();
+}
+
+real *MultilayerPerceptron::outputs(MultilayerPerceptronWorkspace &workspace, size_t i) const
+{
+    return checkpointed(workspace, i) == true ? workspace.aCheckpoints[i].data() : workspace.aOutputs[i % workspace.checkpointInterval].data();
+}
+
+real *MultilayerPerceptron::deltas(MultilayerPerceptronWorkspace &workspace, size_t i) const
+{
+    return workspace.aDeltas[i % 2].data();
+}
+
+/*
+ * Dropout mask of Layer i, null if the Layer has no dropout
+ */
+real *MultilayerPerceptron::dropoutMask(MultilayerPerceptronWorkspace &workspace, size_t i) const
+{
+    if(m_aLayers[i].dropoutRate() <= 0.0 || i + 1 == m_aLayers.size())
+    {
+        return nullptr;
+    }
+
+    return workspace.aDropoutMasks[i % workspace.checkpointInterval].data();
+}
+
+/*
+ * Derivatives of the loss with respect to the outputs
+ * (logits if fused), returns the sum of the sample losses
+ */
+real MultilayerPerceptron::outputDeltas(const real *pTargetOutputs, size_t batchSize, MultilayerPerceptronWorkspace &workspace) const
+{
+    const size_t outputLayer = m_aLayers.size() - 1;
+
+    return m_lossFunction.evaluate(outputs(workspace, outputLayer), pTargetOutputs, batchSize, numberOfOutputs(),
+        deltas(workspace, outputLayer));
 }
@@ -0,0 +1,190 @@
+#include "neural/online_learner.h"
+
+#include "neural/assert.h"
+
+#include <algorithm>
+
+OnlineLearner::OnlineLearner(const MultilayerPerceptron &multilayerPerceptron, const OnlineLearningParameters &parameters) :
+    m_batchSize(parameters.batchSize > 0 ? parameters.batchSize : 1),
+    m_maxWaitTime(parameters.maxWaitTime),
+    m_publicationInterval(parameters.publicationInterval > 0 ? parameters.publicationInterval : 1),
+    m_maxPendingSamples(std::max(parameters.maxPendingSamples, m_batchSize)),
+    m_pPublished(std::make_shared<MultilayerPerceptron>(multilayerPerceptron)),
+    m_shadow(multilayerPerceptron)
+{
+    m_shadow.setTelemetry(nullptr);
+    m_pPublished->setTelemetry(nullptr);
+
+    m_arBatchInputs.resize(m_batchSize * m_shadow.numberOfInputs());
+    m_arBatchOutputs.resize(m_batchSize * m_shadow.numberOfOutputs());
+
+    m_thread = std::thread(&OnlineLearner::run, this);
+}
+
+OnlineLearner::~OnlineLearner()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_bStop = true;
+    }
+    m_condition.notify_all();
+    m_thread.join();
+}
+
+void OnlineLearner::addSample(const LayerInputs &aInputs, const LayerOutputs &aOutputs)
+{
+    ASSERT(aInputs.size() == m_shadow.numberOfInputs());
+    ASSERT(aOutputs.size() == m_shadow.numberOfOutputs());
+
+    Sample sample;
+    sample.aInputs = aInputs;
+    sample.aOutputs = aOutputs;
+    sample.addTime = Clock::now();
+
+    bool bNotify;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if(m_aSamples.size() == m_maxPendingSamples)
+        {
+            m_aSamples.pop_front();
+            ++m_numberOfDroppedSamples;
+        }
+        m_aSamples.push_back(std::move(sample));
+
+        // The learning thread only waits for the first
+        // sample of a batch and for a full batch
+        bNotify = m_aSamples.size() == 1 || m_aSamples.size() == m_batchSize;
+    }
+
+    if(bNotify == true)
+    {
+        m_condition.notify_one();
+    }
+}
+
+void OnlineLearner::flush()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_bFlush = true;
+    m_condition.notify_one();
+    m_flushCondition.wait(lock, [this]{return m_bFlush == false;});
+}
+
+std::shared_ptr<const MultilayerPerceptron> OnlineLearner::model() const
+{
+    return std::atomic_load(&m_pPublished);
+}
+
+const LayerOutputs &OnlineLearner::evaluate(const real *pInputs, size_t batchSize, MultilayerPerceptronWorkspace &workspace) const
+{
+    // The outputs live in the workspace, the snapshot can go
+    const std::shared_ptr<const MultilayerPerceptron> pModel = model();
+    return pModel->evaluate(pInputs, batchSize, workspace);
+}
+
+size_t OnlineLearner::numberOfUpdates() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_numberOfUpdates;
+}
+
+size_t OnlineLearner::numberOfPublications() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_numberOfPublications;
+}
+
+size_t OnlineLearner::numberOfDroppedSamples() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_numberOfDroppedSamples;
+}
+
+/*
+ * Learning loop: wait for a first sample, then for
+ * the batch to fill up or the oldest sample to reach
+ * its deadline. A flush learns partial batches until
+ * no sample is left, and publishes right away.
+ */
+void OnlineLearner::run()
+{
+    const size_t numberOfInputs = m_shadow.numberOfInputs();
+    const size_t numberOfOutputs = m_shadow.numberOfOutputs();
+
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while(true)
+    {
+        m_condition.wait(lock, [this]{return m_aSamples.empty() == false || m_bFlush == true || m_bStop == true;});
+        if(m_bStop == true)
+        {
+            break;
+        }
+
+        if(m_aSamples.empty() == false)
+        {
+            const Clock::time_point deadline = m_aSamples.front().addTime + m_maxWaitTime;
+            m_condition.wait_until(lock, deadline, [this]{return m_aSamples.size() >= m_batchSize || m_bFlush == true || m_bStop == true;});
+            if(m_bStop == true)
+            {
+                break;
+            }
+
+            const size_t batchSize = std::min(m_aSamples.size(), m_batchSize);
+            for(size_t i = 0; i < batchSize; ++i)
+            {
+                const Sample &sample = m_aSamples.front();
+                std::copy(sample.aInputs.begin(), sample.aInputs.end(), m_arBatchInputs.begin() + i * numberOfInputs);
+                std::copy(sample.aOutputs.begin(), sample.aOutputs.end(), m_arBatchOutputs.begin() + i * numberOfOutputs);
+                m_aSamples.pop_front();
+            }
+
+            lock.unlock();
+            m_shadow.train(m_arBatchInputs.data(), m_arBatchOutputs.data(), batchSize);
+            ++m_updatesSincePublication;
+            lock.lock();
+
+            ++m_numberOfUpdates;
+        }
+
+        const bool bFlushed = m_bFlush == true && m_aSamples.empty() == true;
+        if(m_updatesSincePublication >= m_publicationInterval || (bFlushed == true && m_updatesSincePublication > 0))
+        {
+            lock.unlock();
+            publish();
+            lock.lock();
+
+            ++m_numberOfPublications;
+        }
+
+        if(bFlushed == true)
+        {
+            m_bFlush = false;
+            m_flushCondition.notify_all();
+        }
+    }
+
+    // Release a waiting flush
+    m_bFlush = false;
+    m_flushCondition.notify_all();
+}
+
+/*
+ * Copy the shadow into a snapshot no reader holds and
+ * swap it with the published one. The previous snapshot
+ * is retired until its last reader releases it, a new
+ * one is allocated meanwhile.
+ */
+void OnlineLearner::publish()
+{
+    if(m_pRetired != nullptr && m_pRetired.use_count() == 1)
+    {
+        *m_pRetired = m_shadow;
+    }
+    else
+    {
+        m_pRetired = std::make_shared<MultilayerPerceptron>(m_shadow);
+    }
+
+    m_pRetired = std::atomic_exchange(&m_pPublished, m_pRetired);
+    m_updatesSincePublication = 0;
+}
@@ -0,0 +1,299 @@
+#include "neural/profiler.h"
+
+#include "neural/gemm.h"
+#include "neural/thread_pool.h"
+
+#include <algorithm>
+#include <iomanip>
+
+namespace
+{
+    // Size of the square product of the compute probe
+    const size_t s_probeMatrixSize = 512;
+
+    // Values per buffer of the bandwidth probe (32 MiB), beyond the last level caches
+    const size_t s_probeBufferSize = size_t(1) << 22;
+    const size_t s_probeChunkSize = size_t(1) << 16;
+
+    const size_t s_probeRepetitions = 4;
+
+    const char *layerTypeName(LayerType eLayerType)
+    {
+        switch(eLayerType)
+        {
+        case LayerType::FullyConnected:
+            return "dense";
+        case LayerType::Convolution:
+            return "conv";
+        case LayerType::MaxPooling:
+            return "maxpool";
+        case LayerType::AveragePooling:
+            return "avgpool";
+        case LayerType::Flatten:
+            return "flatten";
+        case LayerType::Recurrent:
+            return "rnn";
+        default:
+            return "unknown";
+        }
+    }
+
+    template<typename Function>
+    real bestTime(Function function)
+    {
+        real rBest = 0.0;
+        for(size_t r = 0; r < s_probeRepetitions; ++r)
+        {
+            const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+            function();
+            const std::chrono::duration<real> elapsed = std::chrono::steady_clock::now() - start;
+
+            rBest = (r == 0) ? elapsed.count() : std::min(rBest, elapsed.count());
+        }
+        return rBest;
+    }
+}
+
+Profiler::Profiler(const MachinePeaks &peaks) :
+    m_peaks(peaks)
+{
+}
+
+MachinePeaks Profiler::measurePeaks()
+{
+    MachinePeaks peaks;
+
+    {
+        const size_t n = s_probeMatrixSize;
+        std::vector<real> arA(n * n, 1.0);
+        std::vector<real> arB(n * n, 0.5);
+        std::vector<real> arC(n * n, 0.0);
+
+        const real rTime = bestTime([&]()
+        {
+            gemm(Transpose::No, Transpose::No, n, n, n, 1.0, arA.data(), n, arB.data(), n, 0.0, arC.data(), n);
+        });
+        peaks.rFlopsPerSecond = 2.0 * static_cast<real>(n * n * n) / rTime;
+    }
+
+    {
+        // Buffers first touched by the threads streaming them
+        const size_t numberOfChunks = s_probeBufferSize / s_probeChunkSize;
+        std::vector<real> arA(s_probeBufferSize);
+        std::vector<real> arB(s_probeBufferSize);
+        std::vector<real> arC(s_probeBufferSize);
+
+        ThreadPool::global().parallelFor(numberOfChunks, [&](size_t chunk)
+        {
+            std::fill(arB.begin() + chunk * s_probeChunkSize, arB.begin() + (chunk + 1) * s_probeChunkSize, 1.0);
+            std::fill(arC.begin() + chunk * s_probeChunkSize, arC.begin() + (chunk + 1) * s_probeChunkSize, 2.0);
+        });
+
+        // Triad A = B + s * C: two reads and one write per value
+        const real rTime = bestTime([&]()
+        {
+            ThreadPool::global().parallelFor(numberOfChunks, [&](size_t chunk)
+            {
+                real *pA = arA.data() + chunk * s_probeChunkSize;
+                const real *pB = arB.data() + chunk * s_probeChunkSize;
+                const real *pC = arC.data() + chunk * s_probeChunkSize;
+                for(size_t i = 0; i < s_probeChunkSize; ++i)
+                {
+                    pA[i] = pB[i] + 3.0 * pC[i];
+                }
+            });
+        });
+        peaks.rBytesPerSecond = 3.0 * static_cast<real>(s_probeBufferSize * sizeof(real)) / rTime;
+    }
+
+    return peaks;
+}
+
+/*
+ * Cost model of the Layer implementations: products count
+ * two FLOPs per multiply-add, bias and activation one FLOP each,
+ * weights, inputs and outputs are moved once per call
+ */
+LayerCost Profiler::cost(const Layer &layer, TrainingPhase ePhase, size_t batchSize, bool bInputDeltas)
+{
+    const real rBatchSize = static_cast<real>(batchSize);
+    const real rInputs = rBatchSize * static_cast<real>(layer.numberOfInputs());
+    const real rOutputs = rBatchSize * static_cast<real>(layer.size());
+    const real rActivations = rBatchSize * static_cast<real>(layer.activationsSize());
+    const real rWeights = static_cast<real>(layer.weights().size());
+    const real rRealBytes = static_cast<real>(sizeof(real));
+
+    // Multiply-adds of the weighted sums of the batch
+    real rMultiplyAdds = 0.0;
+    switch(layer.layerType())
+    {
+    case LayerType::FullyConnected:
+        rMultiplyAdds = rBatchSize * rWeights;
+        break;
+    case LayerType::Convolution:
+        rMultiplyAdds = rOutputs * static_cast<real>(layer.kernelSize() * layer.kernelSize() * layer.inputShape().channels);
+        break;
+    case LayerType::Recurrent:
+        // Every timestep, input and recurrent products (bias column included)
+        rMultiplyAdds = rBatchSize * static_cast<real>(layer.sequenceLength()) * rWeights;
+        break;
+    case LayerType::MaxPooling:
+    case LayerType::AveragePooling:
+    case LayerType::Flatten:
+        break;
+    }
+
+    LayerCost cost;
+    switch(ePhase)
+    {
+    case TrainingPhase::Forward:
+        if(layer.sparse() == true)
+        {
+            // CSR: values and column indices of the kept weights, row offsets
+            const real rKept = layer.density() * rWeights;
+            cost.rFlops = 2.0 * rBatchSize * rKept;
+            cost.rBytes = rKept * (rRealBytes + sizeof(uint32_t)) + static_cast<real>((layer.size() + 1) * sizeof(uint32_t));
+        }
+        else
+        {
+            cost.rFlops = 2.0 * rMultiplyAdds;
+            cost.rBytes = rWeights * rRealBytes;
+        }
+
+        if(layer.layerType() == LayerType::MaxPooling || layer.layerType() == LayerType::AveragePooling)
+        {
+            cost.rFlops = rOutputs * static_cast<real>(layer.kernelSize() * layer.kernelSize());
+        }
+
+        // Inputs read, activations (states of every timestep) and outputs written
+        cost.rFlops += layer.layerType() == LayerType::Flatten ? 0.0 : 2.0 * rOutputs;
+        cost.rBytes += (rInputs + rActivations + rOutputs) * rRealBytes;
+        break;
+    case TrainingPhase::Backward:
+        // Activation derivatives: activations read, deltas updated
+        cost.rFlops = 2.0 * rOutputs;
+        cost.rBytes = (rActivations + 2.0 * rOutputs) * rRealBytes;
+
+        if(rMultiplyAdds > 0.0)
+        {
+            // Gradients from the inputs, then input deltas from the weights
+            cost.rFlops += 2.0 * rMultiplyAdds;
+            cost.rBytes += (rInputs + rWeights) * rRealBytes;
+            if(bInputDeltas == true)
+            {
+                cost.rFlops += 2.0 * rMultiplyAdds;
+                cost.rBytes += (rInputs + rWeights) * rRealBytes;
+            }
+        }
+        else if(bInputDeltas == true)
+        {
+            // Deltas routed back to the inputs (pooling re-reads them)
+            const bool bPooling = layer.layerType() != LayerType::Flatten;
+            cost.rFlops += bPooling == true ? rOutputs * static_cast<real>(layer.kernelSize() * layer.kernelSize()) : 0.0;
+            cost.rBytes += (bPooling == true ? 2.0 : 1.0) * rInputs * rRealBytes;
+        }
+        break;
+    case TrainingPhase::Update:
+        // Weight decay, momentum and step: weights, gradients and
+        // saved derivatives read, weights and gradients written
+        cost.rFlops = 10.0 * rWeights;
+        cost.rBytes = (layer.pruned() == true ? 6.0 : 5.0) * rWeights * rRealBytes;
+        break;
+    default:
+        break;
+    }
+
+    return cost;
+}
+
+void Profiler::add(size_t i, const Layer &layer, TrainingPhase ePhase, size_t batchSize, bool bInputDeltas, real rSeconds)
+{
+    if(i >= m_aLayers.size())
+    {
+        m_aLayers.resize(i + 1);
+    }
+
+    LayerProfile &profile = m_aLayers[i];
+    profile.eLayerType = layer.layerType();
+    profile.numberOfInputs = layer.numberOfInputs();
+    profile.size = layer.size();
+
+    const size_t phase = static_cast<size_t>(ePhase);
+    const LayerCost callCost = cost(layer, ePhase, batchSize, bInputDeltas);
+
+    ++profile.aCalls[phase];
+    profile.arTimes[phase] += rSeconds;
+    profile.aCosts[phase].rFlops += callCost.rFlops;
+    profile.aCosts[phase].rBytes += callCost.rBytes;
+}
+
+void Profiler::reset()
+{
+    m_aLayers.clear();
+}
+
+/*
+ * Per Layer and phase: time, achieved GFLOP/s and GB/s,
+ * arithmetic intensity, the roof bounding it (memory below
+ * the ridge point, compute above) and the fraction of that
+ * roof achieved (above 100% when the working set stays in cache)
+ */
+void Profiler::report(std::ostream &stream) const
+{
+    const real rRidge = m_peaks.rBytesPerSecond > 0.0 ? m_peaks.rFlopsPerSecond / m_peaks.rBytesPerSecond : 0.0;
+
+    real rTotalTime = 0.0;
+    for(size_t i = 0; i < m_aLayers.size(); ++i)
+    {
+        for(size_t phase = 0; phase < static_cast<size_t>(TrainingPhase::Count); ++phase)
+        {
+            rTotalTime += m_aLayers[i].arTimes[phase];
+        }
+    }
+
+    const std::ios_base::fmtflags flags = stream.flags();
+    const std::streamsize precision = stream.precision();
+
+    stream << std::fixed << std::setprecision(2)
+        << "Peaks: " << m_peaks.rFlopsPerSecond * 1e-9 << " GFLOP/s, " << m_peaks.rBytesPerSecond * 1e-9 << " GB/s, ridge "
+        << rRidge << " FLOP/byte" << std::endl
+        << std::left << std::setw(6) << "layer" << std::setw(9) << "type" << std::setw(12) << "shape" << std::setw(10) << "phase"
+        << std::right << std::setw(9) << "calls" << std::setw(11) << "time (ms)" << std::setw(8) << "share"
+        << std::setw(10) << "GFLOP/s" << std::setw(9) << "GB/s" << std::setw(11) << "FLOP/byte"
+        << std::setw(9) << "bound" << std::setw(8) << "roof" << std::endl;
+
+    for(size_t i = 0; i < m_aLayers.size(); ++i)
+    {
+        const LayerProfile &profile = m_aLayers[i];
+        const std::string strShape = std::to_string(profile.numberOfInputs) + "x" + std::to_string(profile.size);
+
+        for(size_t phase = 0; phase < static_cast<size_t>(TrainingPhase::Count); ++phase)
+        {
+            if(profile.aCalls[phase] == 0 || profile.aCosts[phase].rBytes <= 0.0)
+            {
+                continue;
+            }
+
+            const real rTime = profile.arTimes[phase];
+            const LayerCost &cost = profile.aCosts[phase];
+            const real rFlopsPerSecond = rTime > 0.0 ? cost.rFlops / rTime : 0.0;
+            const real rBytesPerSecond = rTime > 0.0 ? cost.rBytes / rTime : 0.0;
+            const real rIntensity = cost.rFlops / cost.rBytes;
+
+            // Fraction of the attainable rate at this intensity
+            const bool bMemoryBound = rIntensity < rRidge;
+            const real rRoof = bMemoryBound == true ? rBytesPerSecond / m_peaks.rBytesPerSecond : rFlopsPerSecond / m_peaks.rFlopsPerSecond;
+
+            stream << std::left << std::setw(6) << i << std::setw(9) << layerTypeName(profile.eLayerType) << std::setw(12) << strShape
+                << std::setw(10) << trainingPhaseName(static_cast<TrainingPhase>(phase))
+                << std::right << std::setw(9) << profile.aCalls[phase] << std::setw(11) << rTime * 1e3
+                << std::setw(7) << (rTotalTime > 0.0 ? 100.0 * rTime / rTotalTime : 0.0) << "%"
+                << std::setw(10) << rFlopsPerSecond * 1e-9 << std::setw(9) << rBytesPerSecond * 1e-9 << std::setw(11) << rIntensity
+                << std::setw(9) << (bMemoryBound == true ? "memory" : "compute")
+                << std::setw(7) << 100.0 * rRoof << "%" << std::endl;
+        }
+    }
+
+    stream.flags(flags);
+    stream.precision(precision);
+}
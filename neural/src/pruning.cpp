@@ -0,0 +1,96 @@
+#include "neural/pruning.h"
+
+#include "neural/multilayer_perceptron.h"
+#include "neural/trainer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+Pruner::Pruner(const PruningParameters &parameters) :
+    m_eScope(parameters.eScope),
+    m_rSparsity(parameters.rSparsity),
+    m_rThreshold(parameters.rThreshold)
+{
+
+}
+
+void Pruner::prune(MultilayerPerceptron &multilayerPerceptron) const
+{
+    std::vector<real> arMagnitudes;
+
+    if(m_eScope == PruningScope::Global)
+    {
+        if(m_rThreshold < 0.0)
+        {
+            for(size_t i = 0; i < multilayerPerceptron.numberOfLayers(); ++i)
+            {
+                const LayerWeights &aWeights = multilayerPerceptron.layer(i).weights();
+                for(size_t j = 0; j < aWeights.size(); ++j)
+                {
+                    arMagnitudes.push_back(fabs(aWeights[j]));
+                }
+            }
+        }
+
+        const real rThreshold = magnitudeThreshold(arMagnitudes);
+        for(size_t i = 0; i < multilayerPerceptron.numberOfLayers(); ++i)
+        {
+            multilayerPerceptron.layer(i).prune(rThreshold);
+        }
+    }
+    else
+    {
+        for(size_t i = 0; i < multilayerPerceptron.numberOfLayers(); ++i)
+        {
+            Layer &layer = multilayerPerceptron.layer(i);
+
+            arMagnitudes.clear();
+            if(m_rThreshold < 0.0)
+            {
+                const LayerWeights &aWeights = layer.weights();
+                for(size_t j = 0; j < aWeights.size(); ++j)
+                {
+                    arMagnitudes.push_back(fabs(aWeights[j]));
+                }
+            }
+
+            layer.prune(magnitudeThreshold(arMagnitudes));
+        }
+    }
+}
+
+void Pruner::prune(MultilayerPerceptron &multilayerPerceptron, Dataset &dataset, Trainer &trainer) const
+{
+    prune(multilayerPerceptron);
+    trainer.train(multilayerPerceptron, dataset);
+}
+
+/*
+ * Magnitude below which weights are pruned:
+ * the fixed threshold, or the rSparsity quantile of arMagnitudes
+ */
+real Pruner::magnitudeThreshold(const std::vector<real> &arMagnitudes) const
+{
+    if(m_rThreshold >= 0.0)
+    {
+        return m_rThreshold;
+    }
+
+    if(arMagnitudes.empty() == true || m_rSparsity <= 0.0)
+    {
+        return 0.0;
+    }
+
+    if(m_rSparsity >= 1.0)
+    {
+        return std::numeric_limits<real>::max();
+    }
+
+    const size_t index = static_cast<size_t>(m_rSparsity * static_cast<real>(arMagnitudes.size()));
+
+    std::vector<real> arSortedMagnitudes = arMagnitudes;
+    std::nth_element(arSortedMagnitudes.begin(), arSortedMagnitudes.begin() + index, arSortedMagnitudes.end());
+
+    return arSortedMagnitudes[index];
+}
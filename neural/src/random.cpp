@@ -0,0 +1,221 @@
+#include "neural/random.h"
+
+#include "neural/thread_pool.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace
+{
+    const uint32_t s_uiPhiloxMultiplier0 = 0xD2511F53;
+    const uint32_t s_uiPhiloxMultiplier1 = 0xCD9E8D57;
+    const uint32_t s_uiPhiloxWeyl0 = 0x9E3779B9;
+    const uint32_t s_uiPhiloxWeyl1 = 0xBB67AE85;
+
+    // Philox blocks computed together, plain loops over lanes get vectorised
+    const size_t s_lanes = 16;
+
+    // Fills above this size are split over the ThreadPool
+    const size_t s_parallelFillSize = 1 << 16;
+    const size_t s_parallelChunkSize = 1 << 14;
+
+    INLINE uint64_t mix(uint64_t value)
+    {
+        value += 0x9E3779B97F4A7C15ULL;
+        value = (value ^ (value >> 30)) * 0xBF58476D1CE4E5B9ULL;
+        value = (value ^ (value >> 27)) * 0x94D049BB133111EBULL;
+        return value ^ (value >> 31);
+    }
+
+    /*
+     * Philox4x32-10 on s_lanes consecutive blocks,
+     * each block gives two 64 bits values
+     */
+    void philox(uint64_t key, uint64_t firstBlock, uint64_t *pValues)
+    {
+        uint32_t c0[s_lanes], c1[s_lanes], c2[s_lanes], c3[s_lanes];
+        for(size_t l = 0; l < s_lanes; ++l)
+        {
+            const uint64_t block = firstBlock + l;
+            c0[l] = static_cast<uint32_t>(block);
+            c1[l] = static_cast<uint32_t>(block >> 32);
+            c2[l] = 0;
+            c3[l] = 0;
+        }
+
+        uint32_t k0 = static_cast<uint32_t>(key);
+        uint32_t k1 = static_cast<uint32_t>(key >> 32);
+
+        for(size_t round = 0; round < 10; ++round)
+        {
+            for(size_t l = 0; l < s_lanes; ++l)
+            {
+                const uint64_t product0 = static_cast<uint64_t>(s_uiPhiloxMultiplier0) * c0[l];
+                const uint64_t product1 = static_cast<uint64_t>(s_uiPhiloxMultiplier1) * c2[l];
+
+                const uint32_t n0 = static_cast<uint32_t>(product1 >> 32) ^ c1[l] ^ k0;
+                const uint32_t n2 = static_cast<uint32_t>(product0 >> 32) ^ c3[l] ^ k1;
+                c1[l] = static_cast<uint32_t>(product1);
+                c3[l] = static_cast<uint32_t>(product0);
+                c0[l] = n0;
+                c2[l] = n2;
+            }
+            k0 += s_uiPhiloxWeyl0;
+            k1 += s_uiPhiloxWeyl1;
+        }
+
+        for(size_t l = 0; l < s_lanes; ++l)
+        {
+            pValues[2 * l] = (static_cast<uint64_t>(c0[l]) << 32) | c1[l];
+            pValues[2 * l + 1] = (static_cast<uint64_t>(c2[l]) << 32) | c3[l];
+        }
+    }
+
+    // [0, 1) with the full mantissa
+    INLINE real toUniform(uint64_t value)
+    {
+#ifdef _SIMPLE_PRECISION
+        return static_cast<real>(static_cast<int32_t>(value >> 40)) * (1.0f / 16777216.0f);
+#else
+        return static_cast<real>(static_cast<int64_t>(value >> 11)) * (1.0 / 9007199254740992.0);
+#endif
+    }
+
+    /*
+     * Run function(position, pValues, count) over chunks of
+     * [position, position + count), in parallel for large counts
+     */
+    template<typename Function>
+    void forEachChunk(uint64_t position, size_t count, real *pValues, const Function &function)
+    {
+        if(count < s_parallelFillSize)
+        {
+            function(position, pValues, count);
+            return;
+        }
+
+        const size_t numberOfChunks = (count + s_parallelChunkSize - 1) / s_parallelChunkSize;
+        ThreadPool::global().parallelFor(numberOfChunks, [&](size_t chunk)
+        {
+            const size_t begin = chunk * s_parallelChunkSize;
+            function(position + begin, pValues + begin, std::min(s_parallelChunkSize, count - begin));
+        });
+    }
+}
+
+RandomStream::RandomStream(uint64_t key) :
+    m_key(key)
+{
+
+}
+
+RandomStream RandomStream::split(uint64_t id) const
+{
+    return RandomStream(mix(mix(m_key) ^ mix(~id)));
+}
+
+uint64_t RandomStream::next()
+{
+    static_assert(sizeof(m_aCachedValues) / sizeof(uint64_t) == 2 * s_lanes, "one value per lane and word pair");
+
+    const uint64_t group = m_position / (2 * s_lanes);
+    if(group != m_cachedGroup)
+    {
+        philox(m_key, group * s_lanes, m_aCachedValues);
+        m_cachedGroup = group;
+    }
+
+    return m_aCachedValues[m_position++ % (2 * s_lanes)];
+}
+
+real RandomStream::uniform()
+{
+    return toUniform(next());
+}
+
+real RandomStream::uniform(real rLowerBound, real rUpperBound)
+{
+    return rLowerBound + uniform() * (rUpperBound - rLowerBound);
+}
+
+size_t RandomStream::uniformIndex(size_t count)
+{
+    return std::min(static_cast<size_t>(uniform() * static_cast<real>(count)), count - 1);
+}
+
+real RandomStream::normal()
+{
+    const real rRadius = std::sqrt(-2.0 * std::log(1.0 - uniform()));
+    return rRadius * std::cos(6.283185307179586 * uniform());
+}
+
+void RandomStream::fillUniform(real *pValues, size_t count, real rLowerBound, real rUpperBound)
+{
+    const real rRange = rUpperBound - rLowerBound;
+
+    forEachChunk(m_position, count, pValues, [this, rLowerBound, rRange](uint64_t position, real *pChunkValues, size_t chunkSize)
+    {
+        uint64_t aValues[2 * s_lanes];
+        for(size_t i = 0; i < chunkSize; i += 2 * s_lanes)
+        {
+            const size_t blockSize = std::min(2 * s_lanes, chunkSize - i);
+            generate(position + i, blockSize, aValues);
+
+            for(size_t j = 0; j < blockSize; ++j)
+            {
+                pChunkValues[i + j] = rLowerBound + toUniform(aValues[j]) * rRange;
+            }
+        }
+    });
+
+    m_position += count;
+}
+
+void RandomStream::fillNormal(real *pValues, size_t count, real rMean, real rStandardDeviation)
+{
+    // Pairs start at even offsets from the first position
+    forEachChunk(m_position, count, pValues, [this, rMean, rStandardDeviation](uint64_t position, real *pChunkValues, size_t chunkSize)
+    {
+        uint64_t aValues[2 * s_lanes];
+        for(size_t i = 0; i < chunkSize; i += 2 * s_lanes)
+        {
+            const size_t blockSize = std::min(2 * s_lanes, chunkSize - i);
+            generate(position + i, 2 * s_lanes, aValues);
+
+            for(size_t j = 0; j < blockSize; j += 2)
+            {
+                const real rRadius = rStandardDeviation * std::sqrt(-2.0 * std::log(1.0 - toUniform(aValues[j])));
+                const real rAngle = 6.283185307179586 * toUniform(aValues[j + 1]);
+
+                pChunkValues[i + j] = rMean + rRadius * std::cos(rAngle);
+                if(j + 1 < blockSize)
+                {
+                    pChunkValues[i + j + 1] = rMean + rRadius * std::sin(rAngle);
+                }
+            }
+        }
+    });
+
+    m_position += count + (count & 1);
+}
+
+/*
+ * Raw values at [position, position + count),
+ * computed s_lanes blocks at a time
+ */
+void RandomStream::generate(uint64_t position, size_t count, uint64_t *pValues) const
+{
+    uint64_t aBlockValues[2 * s_lanes];
+
+    size_t i = 0;
+    while(i < count)
+    {
+        const uint64_t firstBlock = (position + i) >> 1;
+        philox(m_key, firstBlock, aBlockValues);
+
+        const size_t offset = (position + i) & 1;
+        const size_t available = std::min(2 * s_lanes - offset, count - i);
+        std::copy(aBlockValues + offset, aBlockValues + offset + available, pValues + i);
+        i += available;
+    }
+}
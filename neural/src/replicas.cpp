@@ -0,0 +1,73 @@
+#include "neural/replicas.h"
+
+#include "neural/thread_pool.h"
+
+MultilayerPerceptronReplicas::MultilayerPerceptronReplicas(const MultilayerPerceptron &multilayerPerceptron, ThreadPool &threadPool) :
+    m_threadPool(threadPool),
+    m_apReplicas(threadPool.topology().numberOfNodes()),
+    m_aNodeThreads(threadPool.topology().numberOfNodes(), 0)
+{
+    if(threadPool.pinned() == true)
+    {
+        for(size_t thread = threadPool.size(); thread-- > 1;)
+        {
+            m_aNodeThreads[threadPool.nodeOfThread(thread)] = thread;
+        }
+    }
+
+    copy(multilayerPerceptron);
+}
+
+void MultilayerPerceptronReplicas::update(const MultilayerPerceptron &multilayerPerceptron)
+{
+    copy(multilayerPerceptron);
+}
+
+const MultilayerPerceptron &MultilayerPerceptronReplicas::local() const
+{
+    const size_t node = m_threadPool.topology().currentNode();
+    return *m_apReplicas[node < m_apReplicas.size() ? node : 0];
+}
+
+const LayerOutputs &MultilayerPerceptronReplicas::evaluate(const real *pInputs, size_t batchSize, MultilayerPerceptronWorkspace &workspace) const
+{
+    return local().evaluate(pInputs, batchSize, workspace);
+}
+
+/*
+ * Replicas are created (first copy) or assigned
+ * (same sizes, memory is reused) by their node thread
+ */
+void MultilayerPerceptronReplicas::copy(const MultilayerPerceptron &multilayerPerceptron)
+{
+    const auto copyReplica = [this, &multilayerPerceptron](size_t node)
+    {
+        if(m_apReplicas[node] == nullptr)
+        {
+            m_apReplicas[node].reset(new MultilayerPerceptron(multilayerPerceptron));
+        }
+        else
+        {
+            *m_apReplicas[node] = multilayerPerceptron;
+        }
+    };
+
+    m_threadPool.forEachThread([this, &copyReplica](size_t thread)
+    {
+        for(size_t node = 0; node < m_aNodeThreads.size(); ++node)
+        {
+            if(thread != 0 && m_aNodeThreads[node] == thread)
+            {
+                copyReplica(node);
+            }
+        }
+    });
+
+    for(size_t node = 0; node < m_aNodeThreads.size(); ++node)
+    {
+        if(m_aNodeThreads[node] == 0)
+        {
+            copyReplica(node);
+        }
+    }
+}
@@ -0,0 +1,73 @@
+#ifndef SERIALISATION_H
+#define SERIALISATION_H
+
+#include "neural/defines.h"
+
+#include <cstdint>
+#include <istream>
+#include <ostream>
+#include <vector>
+
+/*
+ * Raw binary helpers, values are written in host
+ * byte order so that reading them back is bit-exact
+ */
+namespace Serialisation
+{
+    template<typename T>
+    INLINE void write(std::ostream &stream, const T &value)
+    {
+        stream.write(reinterpret_cast<const char *>(&value), sizeof(T));
+    }
+
+    template<typename T>
+    INLINE bool read(std::istream &stream, T &value)
+    {
+        return static_cast<bool>(stream.read(reinterpret_cast<char *>(&value), sizeof(T)));
+    }
+
+    template<typename T>
+    INLINE void writeVector(std::ostream &stream, const std::vector<T> &aValues)
+    {
+        const uint64_t size = aValues.size();
+        write(stream, size);
+        stream.write(reinterpret_cast<const char *>(aValues.data()), static_cast<std::streamsize>(sizeof(T) * aValues.size()));
+    }
+
+    /*
+     * Size must match the one already allocated in aValues
+     */
+    template<typename T>
+    INLINE bool readVector(std::istream &stream, std::vector<T> &aValues)
+    {
+        uint64_t size = 0;
+        if(read(stream, size) == false || size != aValues.size())
+        {
+            return false;
+        }
+        return static_cast<bool>(stream.read(reinterpret_cast<char *>(aValues.data()), static_cast<std::streamsize>(sizeof(T) * aValues.size())));
+    }
+
+    template<typename T>
+    INLINE void writeResizableVector(std::ostream &stream, const std::vector<T> &aValues)
+    {
+        writeVector(stream, aValues);
+    }
+
+    /*
+     * Size can be 0 or maxSize
+     */
+    template<typename T>
+    INLINE bool readResizableVector(std::istream &stream, std::vector<T> &aValues, size_t maxSize)
+    {
+        uint64_t size = 0;
+        if(read(stream, size) == false || (size != 0 && size != maxSize))
+        {
+            return false;
+        }
+        aValues.resize(static_cast<size_t>(size));
+        return static_cast<bool>(stream.read(reinterpret_cast<char *>(aValues.data()), static_cast<std::streamsize>(sizeof(T) * aValues.size())));
+    }
+}
+
+#endif // SERIALISATION_H
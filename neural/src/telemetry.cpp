@@ -0,0 +1,140 @@
+#include "neural/telemetry.h"
+
+#include <cmath>
+
+const char *trainingPhaseName(TrainingPhase ePhase)
+{
+    switch(ePhase)
+    {
+    case TrainingPhase::Forward:
+        return "forward";
+    case TrainingPhase::Backward:
+        return "backward";
+    case TrainingPhase::Update:
+        return "update";
+    case TrainingPhase::Validation:
+        return "validation";
+    default:
+        return "unknown";
+    }
+}
+
+TelemetrySink::~TelemetrySink()
+{
+}
+
+CsvTelemetrySink::CsvTelemetrySink(const std::string &strPath) :
+    m_file(strPath)
+{
+    if(m_file.is_open() == true)
+    {
+        m_file << "epoch,samples,training_error,validation_error,learning_rate,gradient_norm,epoch_time,samples_per_second";
+        for(size_t i = 0; i < static_cast<size_t>(TrainingPhase::Count); ++i)
+        {
+            m_file << "," << trainingPhaseName(static_cast<TrainingPhase>(i)) << "_time";
+        }
+        m_file << std::endl;
+    }
+}
+
+void CsvTelemetrySink::write(const EpochMetrics &metrics)
+{
+    if(m_file.is_open() == true)
+    {
+        m_file << metrics.epoch << ","
+            << metrics.numberOfSamples << ","
+            << metrics.rTrainingError << ","
+            << metrics.rValidationError << ","
+            << metrics.rLearningRate << ","
+            << metrics.rGradientNorm << ","
+            << metrics.rEpochTime << ","
+            << metrics.rSamplesPerSecond;
+        for(size_t i = 0; i < static_cast<size_t>(TrainingPhase::Count); ++i)
+        {
+            m_file << "," << metrics.arPhaseTimes[i];
+        }
+        m_file << std::endl;
+    }
+}
+
+JsonTelemetrySink::JsonTelemetrySink(const std::string &strPath) :
+    m_file(strPath)
+{
+}
+
+void JsonTelemetrySink::write(const EpochMetrics &metrics)
+{
+    if(m_file.is_open() == true)
+    {
+        m_file << "{\"epoch\":" << metrics.epoch
+            << ",\"samples\":" << metrics.numberOfSamples
+            << ",\"training_error\":" << metrics.rTrainingError
+            << ",\"validation_error\":" << metrics.rValidationError
+            << ",\"learning_rate\":" << metrics.rLearningRate
+            << ",\"gradient_norm\":" << metrics.rGradientNorm
+            << ",\"epoch_time\":" << metrics.rEpochTime
+            << ",\"samples_per_second\":" << metrics.rSamplesPerSecond
+            << ",\"phase_times\":{";
+        for(size_t i = 0; i < static_cast<size_t>(TrainingPhase::Count); ++i)
+        {
+            m_file << (i > 0 ? "," : "") << "\"" << trainingPhaseName(static_cast<TrainingPhase>(i)) << "\":" << metrics.arPhaseTimes[i];
+        }
+        m_file << "}}" << std::endl;
+    }
+}
+
+Telemetry::Telemetry(const TelemetryParameters &parameters) :
+    m_bPhaseTimers(parameters.bPhaseTimers),
+    m_bGradientNorms(parameters.bGradientNorms)
+{
+}
+
+void Telemetry::addCallback(const EpochCallback &callback)
+{
+    m_aCallbacks.push_back(callback);
+}
+
+void Telemetry::addSink(std::unique_ptr<TelemetrySink> pSink)
+{
+    m_aSinks.push_back(std::move(pSink));
+}
+
+void Telemetry::beginEpoch(unsigned long epoch)
+{
+    m_epoch = epoch;
+    for(size_t i = 0; i < static_cast<size_t>(TrainingPhase::Count); ++i)
+    {
+        m_arPhaseTimes[i] = 0.0;
+    }
+    m_rGradientSquaredNormSum = 0.0;
+    m_gradientNormCount = 0;
+    m_epochStart = std::chrono::steady_clock::now();
+}
+
+/*
+ * Complete metrics with the values accumulated
+ * during the epoch, and publish them to every
+ * callback and sink
+ */
+void Telemetry::endEpoch(EpochMetrics &metrics)
+{
+    const std::chrono::duration<real> elapsed = std::chrono::steady_clock::now() - m_epochStart;
+
+    metrics.epoch = m_epoch;
+    metrics.rEpochTime = elapsed.count();
+    metrics.rSamplesPerSecond = metrics.rEpochTime > 0.0 ? static_cast<real>(metrics.numberOfSamples) / metrics.rEpochTime : 0.0;
+    metrics.rGradientNorm = m_gradientNormCount > 0 ? sqrt(m_rGradientSquaredNormSum / static_cast<real>(m_gradientNormCount)) : 0.0;
+    for(size_t i = 0; i < static_cast<size_t>(TrainingPhase::Count); ++i)
+    {
+        metrics.arPhaseTimes[i] = m_arPhaseTimes[i];
+    }
+
+    for(size_t i = 0; i < m_aCallbacks.size(); ++i)
+    {
+        m_aCallbacks[i](metrics);
+    }
+    for(size_t i = 0; i < m_aSinks.size(); ++i)
+    {
+        m_aSinks[i]->write(metrics);
+    }
+}
@@ -0,0 +1,188 @@
+#include "neural/thread_pool.h"
+
+#ifdef __linux__
+    #include <pthread.h>
+    #include <sched.h>
+#endif
+
+ThreadPool::ThreadPool(size_t numberOfThreads) :
+    m_nextIndex(0)
+{
+    start(numberOfThreads, std::vector<size_t>());
+}
+
+ThreadPool::ThreadPool(size_t numberOfThreads, const Topology &topology) :
+    m_topology(topology),
+    m_nextIndex(0)
+{
+    // CPUs of every node in turn: node 0 first CPU, node 1 first CPU, ...
+    std::vector<size_t> aCpus;
+    for(size_t i = 0; aCpus.size() < topology.numberOfCpus(); ++i)
+    {
+        for(size_t node = 0; node < topology.numberOfNodes(); ++node)
+        {
+            if(i < topology.cpus(node).size())
+            {
+                aCpus.push_back(topology.cpus(node)[i]);
+            }
+        }
+    }
+
+    m_bPinned = true;
+    start(numberOfThreads == 0 ? aCpus.size() : numberOfThreads, aCpus);
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_bStop = true;
+    }
+    m_condition.notify_all();
+
+    for(size_t i = 0; i < m_aThreads.size(); ++i)
+    {
+        m_aThreads[i].join();
+    }
+}
+
+void ThreadPool::parallelFor(size_t count, const std::function<void(size_t)> &function)
+{
+    dispatch(count, function, false);
+}
+
+void ThreadPool::forEachThread(const std::function<void(size_t)> &function)
+{
+    dispatch(size(), function, true);
+}
+
+size_t ThreadPool::nodeOfThread(size_t thread) const
+{
+    return thread == 0 ? m_topology.currentNode() : m_aThreadNodes[thread];
+}
+
+ThreadPool &ThreadPool::global()
+{
+    static ThreadPool s_threadPool;
+    return s_threadPool;
+}
+
+/*
+ * Start numberOfThreads - 1 workers, worker i
+ * pinned to aCpus[i % size] if aCpus is not empty.
+ * Pinning to a CPU that does not exist (fake
+ * topologies) fails silently.
+ */
+void ThreadPool::start(size_t numberOfThreads, const std::vector<size_t> &aCpus)
+{
+    if(numberOfThreads == 0)
+    {
+        numberOfThreads = std::thread::hardware_concurrency();
+    }
+
+    m_aThreadNodes.assign(1, 0);
+
+    for(size_t i = 1; i < numberOfThreads; ++i)
+    {
+        m_aThreads.push_back(std::thread(&ThreadPool::run, this, i));
+
+        if(aCpus.empty() == true)
+        {
+            m_aThreadNodes.push_back(0);
+            continue;
+        }
+
+        const size_t cpu = aCpus[i % aCpus.size()];
+        m_aThreadNodes.push_back(m_topology.nodeOfCpu(cpu));
+
+#ifdef __linux__
+        if(cpu < CPU_SETSIZE)
+        {
+            cpu_set_t cpuSet;
+            CPU_ZERO(&cpuSet);
+            CPU_SET(cpu, &cpuSet);
+            pthread_setaffinity_np(m_aThreads.back().native_handle(), sizeof(cpu_set_t), &cpuSet);
+        }
+#endif
+    }
+}
+
+void ThreadPool::dispatch(size_t count, const std::function<void(size_t)> &function, bool bEachThread)
+{
+    std::unique_lock<std::mutex> jobLock(m_jobMutex, std::try_to_lock);
+
+    if((bEachThread == false && count <= 1) || m_aThreads.empty() == true || jobLock.owns_lock() == false)
+    {
+        for(size_t i = 0; i < count; ++i)
+        {
+            function(i);
+        }
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_pFunction = &function;
+        m_bEachThread = bEachThread;
+        m_count = count;
+        m_nextIndex = 0;
+        m_pendingWorkers = m_aThreads.size();
+        ++m_generation;
+    }
+    m_condition.notify_all();
+
+    if(bEachThread == true)
+    {
+        function(0);
+    }
+    else
+    {
+        runTasks();
+    }
+
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_doneCondition.wait(lock, [this]{return m_pendingWorkers == 0;});
+    m_pFunction = nullptr;
+}
+
+void ThreadPool::run(size_t thread)
+{
+    unsigned long generation = 0;
+
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while(true)
+    {
+        m_condition.wait(lock, [this, generation]{return m_generation != generation || m_bStop == true;});
+        if(m_bStop == true)
+        {
+            break;
+        }
+        generation = m_generation;
+        const bool bEachThread = m_bEachThread;
+
+        lock.unlock();
+        if(bEachThread == true)
+        {
+            (*m_pFunction)(thread);
+        }
+        else
+        {
+            runTasks();
+        }
+        lock.lock();
+
+        if(--m_pendingWorkers == 0)
+        {
+            m_doneCondition.notify_all();
+        }
+    }
+}
+
+void ThreadPool::runTasks()
+{
+    size_t i;
+    while((i = m_nextIndex.fetch_add(1)) < m_count)
+    {
+        (*m_pFunction)(i);
+    }
+}
@@ -0,0 +1,216 @@
+#include "neural/topology.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <thread>
+
+#ifdef __linux__
+    #include <sched.h>
+#endif
+
+#ifdef NEURAL_USE_NUMA
+    #include <numa.h>
+#endif
+
+Topology::Topology(size_t numberOfCpus) :
+    m_aaNodeCpus(1)
+{
+    for(size_t i = 0; i < std::max<size_t>(numberOfCpus, 1); ++i)
+    {
+        m_aaNodeCpus[0].push_back(i);
+    }
+}
+
+Topology Topology::detect()
+{
+    Topology topology(std::thread::hardware_concurrency());
+    std::vector<std::vector<size_t>> aaNodeCpus;
+
+#ifdef NEURAL_USE_NUMA
+    if(numa_available() >= 0)
+    {
+        struct bitmask *pCpus = numa_allocate_cpumask();
+        for(int node = 0; node <= numa_max_node(); ++node)
+        {
+            std::vector<size_t> aCpus;
+            if(numa_node_to_cpus(node, pCpus) == 0)
+            {
+                for(unsigned int cpu = 0; cpu < pCpus->size; ++cpu)
+                {
+                    if(numa_bitmask_isbitset(pCpus, cpu) != 0)
+                    {
+                        aCpus.push_back(cpu);
+                    }
+                }
+            }
+
+            // Memory only nodes have no CPU
+            if(aCpus.empty() == false)
+            {
+                aaNodeCpus.push_back(aCpus);
+            }
+        }
+        numa_free_cpumask(pCpus);
+    }
+#endif
+
+    if(aaNodeCpus.empty() == true)
+    {
+        return fromSysfs("/sys/devices/system/node");
+    }
+
+    topology.m_aaNodeCpus = aaNodeCpus;
+
+    return topology;
+}
+
+/*
+ * Every nodeN/cpulist file of the directory,
+ * node directories may not be contiguous
+ */
+Topology Topology::fromSysfs(const std::string &strNodeDirectory)
+{
+    Topology topology(std::thread::hardware_concurrency());
+    std::vector<std::vector<size_t>> aaNodeCpus;
+
+    for(size_t node = 0; node < 1024; ++node)
+    {
+        std::ifstream cpuListFile(strNodeDirectory + "/node" + std::to_string(node) + "/cpulist");
+        if(cpuListFile.is_open() == false)
+        {
+            continue;
+        }
+
+        std::string strCpuList;
+        std::vector<size_t> aCpus;
+        if(std::getline(cpuListFile, strCpuList) && parseCpuList(strCpuList, aCpus) == true && aCpus.empty() == false)
+        {
+            aaNodeCpus.push_back(aCpus);
+        }
+    }
+
+    if(aaNodeCpus.empty() == false)
+    {
+        topology.m_aaNodeCpus = aaNodeCpus;
+    }
+
+    return topology;
+}
+
+Topology Topology::fromString(const std::string &strDescription)
+{
+    Topology topology;
+    std::vector<std::vector<size_t>> aaNodeCpus;
+
+    std::istringstream stream(strDescription);
+    std::string strNode;
+    while(std::getline(stream, strNode, ';'))
+    {
+        std::vector<size_t> aCpus;
+        if(parseCpuList(strNode, aCpus) == false || aCpus.empty() == true)
+        {
+            return topology;
+        }
+        aaNodeCpus.push_back(aCpus);
+    }
+
+    if(aaNodeCpus.empty() == false)
+    {
+        topology.m_aaNodeCpus = aaNodeCpus;
+    }
+
+    return topology;
+}
+
+const Topology &Topology::system()
+{
+    static const Topology s_topology = []
+    {
+        const char *pDescription = std::getenv("NEURAL_TOPOLOGY");
+        return pDescription != nullptr ? fromString(pDescription) : detect();
+    }();
+
+    return s_topology;
+}
+
+size_t Topology::numberOfCpus() const
+{
+    size_t numberOfCpus = 0;
+    for(size_t i = 0; i < m_aaNodeCpus.size(); ++i)
+    {
+        numberOfCpus += m_aaNodeCpus[i].size();
+    }
+
+    return numberOfCpus;
+}
+
+size_t Topology::nodeOfCpu(size_t cpu) const
+{
+    for(size_t i = 0; i < m_aaNodeCpus.size(); ++i)
+    {
+        if(std::find(m_aaNodeCpus[i].begin(), m_aaNodeCpus[i].end(), cpu) != m_aaNodeCpus[i].end())
+        {
+            return i;
+        }
+    }
+
+    return 0;
+}
+
+size_t Topology::currentNode() const
+{
+#ifdef __linux__
+    const int cpu = sched_getcpu();
+    if(cpu >= 0)
+    {
+        return nodeOfCpu(static_cast<size_t>(cpu));
+    }
+#endif
+
+    return 0;
+}
+
+/*
+ * Linux cpulist format: "0-3,8,10-11"
+ */
+bool Topology::parseCpuList(const std::string &strCpuList, std::vector<size_t> &aCpus)
+{
+    std::istringstream stream(strCpuList);
+    std::string strRange;
+    while(std::getline(stream, strRange, ','))
+    {
+        strRange.erase(std::remove_if(strRange.begin(), strRange.end(), [](char c){return c == ' ' || c == '\n';}), strRange.end());
+        if(strRange.empty() == true)
+        {
+            continue;
+        }
+
+        const size_t dash = strRange.find('-');
+        char *pEnd = nullptr;
+        const unsigned long first = std::strtoul(strRange.c_str(), &pEnd, 10);
+        if(pEnd == strRange.c_str())
+        {
+            return false;
+        }
+
+        unsigned long last = first;
+        if(dash != std::string::npos)
+        {
+            const char *pLast = strRange.c_str() + dash + 1;
+            last = std::strtoul(pLast, &pEnd, 10);
+            if(pEnd == pLast || last < first)
+            {
+                return false;
+            }
+        }
+
+        for(unsigned long cpu = first; cpu <= last; ++cpu)
+        {
+            aCpus.push_back(cpu);
+        }
+    }
+
+    return true;
+}
@@ -2,8 +2,17 @@
 
 #include "neural/multilayer_perceptron.h"
 #include "neural/dataset.h"
+#include "neural/distributed.h"
+#include "neural/telemetry.h"
+#include "neural/checkpoint.h"
+#include "neural/random.h"
+#include "neural/thread_pool.h"
 
+#include <algorithm>
+#include <atomic>
+#include <cmath>
 #include <iostream>
+#include <memory>
 
 Trainer::Trainer(const TrainingParameters &parameters, const bool &bVerbose) :
     m_iMaxIterations(parameters.iMaxIterations),
@@ -11,6 +20,16 @@ Trainer::Trainer(const TrainingParameters &parameters, const bool &bVerbose) :
     m_rTrainingRateThreshold(parameters.rTrainingRateThreshold),
     m_rCrossValidationEvaluationPercent(parameters.rCrossValidationEvaluationPercent),
     m_eScalingMethod(parameters.eScalingMethod),
+    m_strCheckpointPath(parameters.strCheckpointPath),
+    m_uiCheckpointInterval(parameters.uiCheckpointInterval),
+    m_bResume(parameters.bResume),
+    m_batchSize(parameters.batchSize),
+    m_backpropagationSteps(parameters.backpropagationSteps),
+    m_bShuffle(parameters.bShuffle),
+    m_shuffleSeed(parameters.shuffleSeed),
+    m_eTrainingMode(parameters.eTrainingMode),
+    m_numberOfThreads(parameters.numberOfThreads),
+    m_bPinThreads(parameters.bPinThreads),
     m_bVerbose(bVerbose)
 {
     
@@ -26,23 +45,87 @@ void Trainer::train(MultilayerPerceptron &multilayerPerceptron, Dataset &dataset
     {
         dataset.standardise();
     }
+
+    train(multilayerPerceptron, static_cast<const Dataset &>(dataset));
+
+    // TODO denormalize Dataset?
+}
+
+void Trainer::train(MultilayerPerceptron &multilayerPerceptron, const Dataset &dataset)
+{
+    multilayerPerceptron.setTelemetry(m_pTelemetry);
+    multilayerPerceptron.setProfiler(m_pProfiler);
+
+    if(m_backpropagationSteps > 0)
+    {
+        multilayerPerceptron.setBackpropagationSteps(m_backpropagationSteps);
+    }
+
     const real rDatasetSize = static_cast<real>(dataset.size());
     const size_t crossValidationIndex = static_cast<size_t>(rDatasetSize * m_rCrossValidationEvaluationPercent);
-    
-    // Compute Evaluation Error
+
+    // With several workers, only the first one checkpoints and resumes
+    const bool bFirstWorker = m_pParameterAverager == nullptr || m_pParameterAverager->rank() == 0;
+
+    // Resume from the last checkpoint, if any
+    TrainingState state;
+    bool bResumed = false;
+    if(bFirstWorker == true && m_bResume == true && m_strCheckpointPath.empty() == false)
+    {
+        bResumed = Checkpointer::load(m_strCheckpointPath, multilayerPerceptron, state);
+    }
+
+    // Training samples of this worker, every worker starts from the weights
+    // and the resumed state of the first one, so that all of them run the same epochs
+    size_t trainingBegin = 0;
+    size_t trainingEnd = crossValidationIndex;
+    // Averaging steps per epoch, those of the smallest shard so that
+    // every worker takes part in the same reductions
+    size_t averagingSteps = 0;
+    if(m_pParameterAverager != nullptr)
+    {
+        m_pParameterAverager->shard(crossValidationIndex, trainingBegin, trainingEnd);
+        const size_t smallestShard = crossValidationIndex / m_pParameterAverager->numberOfWorkers();
+        averagingSteps = (m_batchSize <= 1) ? smallestShard : (smallestShard + m_batchSize - 1) / m_batchSize;
+
+        std::vector<real> arState = {bResumed == true ? 1.0 : 0.0, static_cast<real>(state.iterationsIndex),
+            state.rError, state.rPreviousError, state.rTrainingRate};
+        if(m_pParameterAverager->broadcast(multilayerPerceptron, arState) == true)
+        {
+            bResumed = arState[0] != 0.0;
+            state = {static_cast<unsigned long>(arState[1]), arState[2], arState[3], arState[4]};
+        }
+    }
+
     real rError = 0.0;
-    for(size_t i = crossValidationIndex; i < dataset.size(); ++i)
+    real rPreviousError = 0.0;
+    real rTrainingRate = 0.0;
+    unsigned long iterationsIndex = 0;
+    if(bResumed == true)
     {
-        const LayerOutputs &actualOutputs = multilayerPerceptron.evaluate(dataset.inputs(i));
+        iterationsIndex = state.iterationsIndex;
+        rError = state.rError;
+        rPreviousError = state.rPreviousError;
+        rTrainingRate = state.rTrainingRate;
 
-        // Add euclidian distance between target and actual Output to Error
-        for(size_t j = 0; j < actualOutputs.size(); ++j)
+        if(m_bVerbose == true)
         {
-            const real &rDifference = actualOutputs[j] - dataset.outputs(i)[j];
-            rError += sqrt(rDifference * rDifference);
+            std::cout << "Resume training at iteration " << iterationsIndex << std::endl;
         }
     }
-    rError /= rDatasetSize;
+    else
+    {
+        // Compute Evaluation Error
+        rError = evaluationError(multilayerPerceptron, dataset, crossValidationIndex, dataset.size()) / rDatasetSize;
+        rPreviousError = rError;
+        rTrainingRate = rError;
+    }
+
+    std::unique_ptr<Checkpointer> pCheckpointer;
+    if(bFirstWorker == true && m_uiCheckpointInterval > 0 && m_strCheckpointPath.empty() == false)
+    {
+        pCheckpointer.reset(new Checkpointer(m_strCheckpointPath));
+    }
 
     if(m_bVerbose == true)
     {
@@ -53,32 +136,87 @@ void Trainer::train(MultilayerPerceptron &multilayerPerceptron, Dataset &dataset
             << "[Training rate] current: " << 0.0 << " goal " << m_rTrainingRateThreshold << std::endl << std::endl;
     }
 
-    real rPreviousError = rError;
-    real rTrainingRate = rError;
-    unsigned long iterationsIndex = 0;
+    // Hogwild workers
+    std::unique_ptr<ThreadPool> pThreadPool;
+    std::vector<MultilayerPerceptronWorkspace> aWorkspaces;
+    if(m_eTrainingMode == TrainingMode::Hogwild && m_bPinThreads == true)
+    {
+        pThreadPool.reset(new ThreadPool(m_numberOfThreads, Topology::system()));
+    }
+    else if(m_eTrainingMode == TrainingMode::Hogwild && m_numberOfThreads > 0)
+    {
+        pThreadPool.reset(new ThreadPool(m_numberOfThreads));
+    }
+
     bool bEnd = false;
     while(iterationsIndex <= m_iMaxIterations && rError > m_rErrorThreshold && rTrainingRate > m_rTrainingRateThreshold && bEnd != true)
     {
-        // Train Neural Network
-        for(size_t i = 0; i < crossValidationIndex; ++i)
+        if(m_pTelemetry != nullptr)
         {
-            multilayerPerceptron.train(dataset.inputs(i), dataset.outputs(i));
+            m_pTelemetry->beginEpoch(iterationsIndex);
         }
 
-        // Compute Evaluation Error
-        rError = 0.0;
-        for(size_t i = crossValidationIndex; i < dataset.size(); ++i)
+        if(m_bShuffle == true)
         {
-            const LayerOutputs &actualOutputs = multilayerPerceptron.evaluate(dataset.inputs(i));
+            shuffleSamples(crossValidationIndex, iterationsIndex);
+        }
 
-            // Add euclidian distance between target and actual Output to Error
-            for(size_t j = 0; j < actualOutputs.size(); ++j)
+        // Train Neural Network
+        real rTrainingError = 0.0;
+        if(m_eTrainingMode == TrainingMode::Hogwild)
+        {
+            ThreadPool &threadPool = (pThreadPool != nullptr) ? *pThreadPool : ThreadPool::global();
+            rTrainingError = trainAsynchronous(multilayerPerceptron, dataset, trainingBegin, trainingEnd, threadPool, aWorkspaces);
+        }
+        else if(m_batchSize <= 1)
+        {
+            for(size_t i = trainingBegin; i < trainingEnd; ++i)
             {
-                const real &rDifference = actualOutputs[j] - dataset.outputs(i)[j];
-                rError += sqrt(rDifference * rDifference);
+                gatherBatch(dataset, i, i + 1);
+                rTrainingError += multilayerPerceptron.train(m_pBatchInputs, m_pBatchOutputs, 1);
+
+                if(m_pParameterAverager != nullptr && i - trainingBegin < averagingSteps)
+                {
+                    m_pParameterAverager->step(multilayerPerceptron);
+                }
             }
         }
-        rError /= rDatasetSize;
+        else
+        {
+            for(size_t i = trainingBegin; i < trainingEnd; i += m_batchSize)
+            {
+                const size_t batchSize = gatherBatch(dataset, i, std::min(i + m_batchSize, trainingEnd));
+                rTrainingError += multilayerPerceptron.train(m_pBatchInputs, m_pBatchOutputs, batchSize);
+
+                if(m_pParameterAverager != nullptr && (i - trainingBegin) / m_batchSize < averagingSteps)
+                {
+                    m_pParameterAverager->step(multilayerPerceptron);
+                }
+            }
+        }
+
+        // Same network on every worker, hence the same errors and stopping decisions
+        if(m_pParameterAverager != nullptr && m_pParameterAverager->synchronise(multilayerPerceptron) == false && m_bVerbose == true)
+        {
+            std::cout << "Parameter averaging failed, training goes on locally" << std::endl;
+        }
+
+        // Compute Evaluation Error
+        {
+            ScopedTimer timer(m_pTelemetry, TrainingPhase::Validation);
+
+            rError = evaluationError(multilayerPerceptron, dataset, crossValidationIndex, dataset.size()) / rDatasetSize;
+        }
+
+        if(m_pTelemetry != nullptr)
+        {
+            EpochMetrics metrics;
+            metrics.numberOfSamples = trainingEnd - trainingBegin;
+            metrics.rTrainingError = trainingEnd > trainingBegin ? rTrainingError / static_cast<real>(trainingEnd - trainingBegin) : 0.0;
+            metrics.rValidationError = rError;
+            metrics.rLearningRate = multilayerPerceptron.learningRate();
+            m_pTelemetry->endEpoch(metrics);
+        }
 
         if(m_bVerbose == true && (iterationsIndex % 100) == 0)
         {
@@ -90,6 +228,22 @@ void Trainer::train(MultilayerPerceptron &multilayerPerceptron, Dataset &dataset
         rPreviousError = rError;
 
         ++iterationsIndex;
+
+        if(pCheckpointer != nullptr && (iterationsIndex % m_uiCheckpointInterval) == 0)
+        {
+            pCheckpointer->save(multilayerPerceptron, {iterationsIndex, rError, rPreviousError, rTrainingRate});
+        }
+    }
+
+    if(pCheckpointer != nullptr)
+    {
+        pCheckpointer->save(multilayerPerceptron, {iterationsIndex, rError, rPreviousError, rTrainingRate});
+        pCheckpointer->flush();
+
+        if(m_bVerbose == true && pCheckpointer->failed() == true)
+        {
+            std::cout << "Failed to write checkpoint " << m_strCheckpointPath << std::endl;
+        }
     }
 
     if(m_bVerbose == true)
@@ -99,5 +253,138 @@ void Trainer::train(MultilayerPerceptron &multilayerPerceptron, Dataset &dataset
             << "[Training rate] final: " << rTrainingRate << " goal " << m_rTrainingRateThreshold << std::endl << std::endl;
     }
 
-    // TODO denormalize Dataset?
+    multilayerPerceptron.setTelemetry(nullptr);
+    multilayerPerceptron.setProfiler(nullptr);
+
+    m_aSampleOrder.clear();
+    m_rError = rError;
+}
+
+/*
+ * Sum of the losses (those minimised by train) of
+ * samples [begin, end), evaluated by batches
+ */
+real Trainer::evaluationError(MultilayerPerceptron &multilayerPerceptron, const Dataset &dataset, size_t begin, size_t end)
+{
+    real rError = 0.0;
+
+    for(size_t i = begin; i < end; i += std::max<size_t>(m_batchSize, 1))
+    {
+        const size_t batchSize = gatherBatch(dataset, i, std::min(i + std::max<size_t>(m_batchSize, 1), end));
+        const LayerOutputs &actualOutputs = multilayerPerceptron.evaluate(m_pBatchInputs, batchSize);
+
+        rError += multilayerPerceptron.lossFunction().evaluate(actualOutputs.data(), m_pBatchOutputs, batchSize, dataset.numberOfOutputs());
+    }
+
+    return rError;
+}
+
+/*
+ * Fisher-Yates shuffle of the training samples
+ * [0, numberOfSamples) from the stream of the epoch
+ */
+void Trainer::shuffleSamples(size_t numberOfSamples, uint64_t epoch)
+{
+    m_aSampleOrder.resize(numberOfSamples);
+    for(size_t i = 0; i < numberOfSamples; ++i)
+    {
+        m_aSampleOrder[i] = i;
+    }
+
+    RandomStream randomStream = RandomStream(m_shuffleSeed).split(epoch);
+    for(size_t i = numberOfSamples; i > 1; --i)
+    {
+        std::swap(m_aSampleOrder[i - 1], m_aSampleOrder[randomStream.uniformIndex(i)]);
+    }
+}
+
+/*
+ * Point the batch at samples [begin, end) and return the
+ * batch size: rows of a row-major Dataset are used in place
+ * when they follow each other, other batches are copied
+ * into the contiguous batch buffers
+ */
+size_t Trainer::gatherBatch(const Dataset &dataset, size_t begin, size_t end)
+{
+    const size_t inputSize = dataset.numberOfInputs();
+    const size_t outputSize = dataset.numberOfOutputs();
+
+    if(dataset.layout() == DatasetLayout::RowMajor && m_aSampleOrder.empty() == true)
+    {
+        m_pBatchInputs = dataset.inputsData() + begin * inputSize;
+        m_pBatchOutputs = dataset.outputsData() + begin * outputSize;
+        return end - begin;
+    }
+
+    m_arBatchInputs.resize((end - begin) * inputSize);
+    m_arBatchOutputs.resize((end - begin) * outputSize);
+
+    for(size_t i = begin; i < end; ++i)
+    {
+        const size_t index = sampleIndex(i);
+        std::copy(dataset.inputs(index).begin(), dataset.inputs(index).end(), m_arBatchInputs.begin() + (i - begin) * inputSize);
+        std::copy(dataset.outputs(index).begin(), dataset.outputs(index).end(), m_arBatchOutputs.begin() + (i - begin) * outputSize);
+    }
+
+    m_pBatchInputs = m_arBatchInputs.data();
+    m_pBatchOutputs = m_arBatchOutputs.data();
+    return end - begin;
+}
+
+/*
+ * One Hogwild! epoch over samples [begin, end): each worker
+ * pulls chunks of samples from a shared counter and updates
+ * the shared weights without any synchronisation.
+ * Worker i always uses workspace i, so its buffers are
+ * allocated on the node of the thread.
+ * Returns the sum of the sample errors.
+ */
+real Trainer::trainAsynchronous(MultilayerPerceptron &multilayerPerceptron, const Dataset &dataset, size_t begin, size_t end,
+    ThreadPool &threadPool, std::vector<MultilayerPerceptronWorkspace> &aWorkspaces)
+{
+    const size_t chunkSize = 16;
+    const size_t numberOfWorkers = threadPool.size();
+
+    aWorkspaces.resize(numberOfWorkers);
+    std::vector<real> arErrors(numberOfWorkers, 0.0);
+    std::atomic<size_t> nextSample(begin);
+
+    threadPool.forEachThread([&](size_t worker)
+    {
+        real rError = 0.0;
+
+        // Samples of a column-major Dataset are copied
+        LayerInputs aInputs;
+        LayerOutputs aOutputs;
+
+        size_t chunkBegin;
+        while((chunkBegin = nextSample.fetch_add(chunkSize)) < end)
+        {
+            for(size_t i = chunkBegin; i < std::min(chunkBegin + chunkSize, end); ++i)
+            {
+                const Span<const real> inputs = dataset.inputs(sampleIndex(i));
+                const Span<const real> outputs = dataset.outputs(sampleIndex(i));
+                if(inputs.contiguous() == true)
+                {
+                    rError += multilayerPerceptron.trainAsynchronous(inputs.data(), outputs.data(), aWorkspaces[worker]);
+                }
+                else
+                {
+                    aInputs.assign(inputs.begin(), inputs.end());
+                    aOutputs.assign(outputs.begin(), outputs.end());
+                    rError += multilayerPerceptron.trainAsynchronous(aInputs.data(), aOutputs.data(), aWorkspaces[worker]);
+                }
+            }
+        }
+
+        arErrors[worker] = rError;
+    });
+
+    real rError = 0.0;
+    for(size_t i = 0; i < numberOfWorkers; ++i)
+    {
+        rError += arErrors[i];
+    }
+
+    return rError;
 }
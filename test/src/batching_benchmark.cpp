@@ -0,0 +1,174 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <future>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "neural/batching_executor.h"
+#include "neural/multilayer_perceptron.h"
+#include "neural/random.h"
+#include "neural/defines.h"
+
+/*
+ * Serving benchmark of the BatchingExecutor: concurrent clients
+ * in a closed loop each submit one sample, wait for its output,
+ * then submit the next one. Throughput and p50/p99 latencies
+ * are compared with clients evaluating their own samples
+ * directly (one forward pass per sample, no batching)
+ */
+namespace
+{
+    using Clock = std::chrono::steady_clock;
+
+    const size_t s_numberOfInputs = 64;
+
+    struct BenchmarkResult
+    {
+        real rThroughput = 0.0;
+        real rMeanBatchSize = 1.0;
+
+        // Microseconds
+        real rP50 = 0.0;
+        real rP99 = 0.0;
+    };
+
+    real percentile(std::vector<real> &arLatencies, real rPercent)
+    {
+        const size_t index = std::min(arLatencies.size() - 1, static_cast<size_t>(rPercent * static_cast<real>(arLatencies.size())));
+        std::nth_element(arLatencies.begin(), arLatencies.begin() + static_cast<std::ptrdiff_t>(index), arLatencies.end());
+        return arLatencies[index];
+    }
+
+    /*
+     * numberOfClients threads evaluate requestsPerClient samples each,
+     * through the executor if pExecutor is set, directly otherwise
+     */
+    BenchmarkResult runClients(const MultilayerPerceptron &multilayerPerceptron, BatchingExecutor *pExecutor,
+        size_t numberOfClients, size_t requestsPerClient)
+    {
+        std::vector<std::vector<real>> aarLatencies(numberOfClients);
+        std::vector<std::thread> aClients;
+
+        const Clock::time_point start = Clock::now();
+        for(size_t c = 0; c < numberOfClients; ++c)
+        {
+            aClients.emplace_back([&, c]()
+            {
+                RandomStream randomStream = RandomStream(7).split(c);
+                MultilayerPerceptronWorkspace workspace;
+                LayerInputs aInputs(s_numberOfInputs);
+                std::vector<real> &arLatencies = aarLatencies[c];
+                arLatencies.reserve(requestsPerClient);
+
+                for(size_t r = 0; r < requestsPerClient; ++r)
+                {
+                    randomStream.split(r).fillUniform(aInputs.data(), aInputs.size(), -1.0, 1.0);
+
+                    const Clock::time_point submitTime = Clock::now();
+                    if(pExecutor != nullptr)
+                    {
+                        pExecutor->submit(aInputs).get();
+                    }
+                    else
+                    {
+                        multilayerPerceptron.evaluate(aInputs.data(), 1, workspace);
+                    }
+                    const std::chrono::duration<real, std::micro> latency = Clock::now() - submitTime;
+                    arLatencies.push_back(latency.count());
+                }
+            });
+        }
+        for(std::thread &client : aClients)
+        {
+            client.join();
+        }
+        const std::chrono::duration<real> elapsed = Clock::now() - start;
+
+        std::vector<real> arLatencies;
+        for(const std::vector<real> &arClientLatencies : aarLatencies)
+        {
+            arLatencies.insert(arLatencies.end(), arClientLatencies.begin(), arClientLatencies.end());
+        }
+
+        BenchmarkResult result;
+        result.rThroughput = static_cast<real>(arLatencies.size()) / elapsed.count();
+        result.rP50 = percentile(arLatencies, 0.5);
+        result.rP99 = percentile(arLatencies, 0.99);
+        if(pExecutor != nullptr && pExecutor->numberOfBatches() > 0)
+        {
+            result.rMeanBatchSize = static_cast<real>(pExecutor->numberOfRequests()) / static_cast<real>(pExecutor->numberOfBatches());
+        }
+
+        return result;
+    }
+
+    void printResult(const std::string &strName, size_t numberOfClients, const BenchmarkResult &result)
+    {
+        std::cout << std::left << std::setw(26) << strName << std::right
+            << std::setw(9) << numberOfClients
+            << std::setw(14) << static_cast<size_t>(result.rThroughput)
+            << std::setw(12) << std::setprecision(3) << result.rMeanBatchSize
+            << std::setw(12) << static_cast<size_t>(result.rP50)
+            << std::setw(12) << static_cast<size_t>(result.rP99) << std::endl;
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    if(argc != 1 && argc != 2)
+    {
+        std::cout << "Usage: BatchingBenchmark [<requests>]" << std::endl;
+        return 1;
+    }
+
+    const size_t numberOfRequests = (argc == 2) ? static_cast<size_t>(atoi(argv[1])) : 20000;
+    if(numberOfRequests == 0)
+    {
+        return 1;
+    }
+
+    PerceptronParameters perceptronParameters = { ActivationFunctionType::HyperbolicTangent, 0.01, 0.0, 0.0 };
+    PerceptronParameters outputParameters = { ActivationFunctionType::Linear, 0.01, 0.0, 0.0 };
+
+    MultilayerPerceptronParameters multilayerPerceptronParameters;
+    multilayerPerceptronParameters.numberOfInputs = s_numberOfInputs;
+    multilayerPerceptronParameters.aLayerParameters.push_back({ 256, perceptronParameters });
+    multilayerPerceptronParameters.aLayerParameters.push_back({ 256, perceptronParameters });
+    multilayerPerceptronParameters.aLayerParameters.push_back({ 10, outputParameters });
+    multilayerPerceptronParameters.seed = 0;
+
+    const MultilayerPerceptron multilayerPerceptron(multilayerPerceptronParameters);
+
+    std::cout << "Requests: " << numberOfRequests << ", hardware threads: " << std::thread::hardware_concurrency() << std::endl
+        << "Latencies in microseconds" << std::endl << std::endl;
+
+    std::cout << std::left << std::setw(26) << "mode" << std::right
+        << std::setw(9) << "clients" << std::setw(14) << "requests/s"
+        << std::setw(12) << "mean batch" << std::setw(12) << "p50" << std::setw(12) << "p99" << std::endl;
+
+    const size_t aNumberOfClients[] = { 1, 4, 16, 64 };
+    const size_t aMaxBatchSizes[] = { 8, 32 };
+
+    for(size_t numberOfClients : aNumberOfClients)
+    {
+        const size_t requestsPerClient = std::max<size_t>(numberOfRequests / numberOfClients, 1);
+
+        printResult("direct", numberOfClients, runClients(multilayerPerceptron, nullptr, numberOfClients, requestsPerClient));
+
+        for(size_t maxBatchSize : aMaxBatchSizes)
+        {
+            BatchingParameters batchingParameters;
+            batchingParameters.maxBatchSize = maxBatchSize;
+            BatchingExecutor executor(multilayerPerceptron, batchingParameters);
+
+            printResult("batched, max " + std::to_string(maxBatchSize) + ", " + std::to_string(batchingParameters.maxWaitTime.count()) + " us", numberOfClients,
+                runClients(multilayerPerceptron, &executor, numberOfClients, requestsPerClient));
+        }
+    }
+
+    return 0;
+}
@@ -2,43 +2,111 @@
 #define DATASETGENERATOR_H
 
 #include "neural/dataset.h"
+#include "neural/random.h"
+#include "neural/thread_pool.h"
 
-#include <chrono>
-#include <random>
+#include <algorithm>
 
 using GenerationFunctionPtr = void(*)(const LayerInputs &, LayerOutputs &);
 
+/*
+ * Samples are generated in chunks of s_chunkSize, in parallel
+ * over the global ThreadPool, straight into the contiguous
+ * sample matrix moved into the Dataset. Each chunk draws its inputs from
+ * its own stream (split by chunk index), so that a seed gives the
+ * same samples whatever the number of threads, in memory or on disk.
+ */
 namespace DatasetGenerator
 {
-    Dataset generateRandomDataset(const size_t &datasetSize, const real &rInputLowerBound, const real &rInputUpperBound, const MultilayerPerceptronParameters &networkParameters, GenerationFunctionPtr generationFunctionPtr)
+    const size_t s_chunkSize = 4096;
+
+    // Chunks generated at once when streaming to a file
+    const size_t s_chunksPerBlock = 64;
+
+    /*
+     * Fill samples [begin, end) of the dataset keyed by seed
+     * into contiguous row-major buffers (first sample at begin),
+     * begin must be a multiple of s_chunkSize
+     */
+    void generateRandomSamples(uint64_t seed, size_t begin, size_t end, size_t numberOfInputs, size_t numberOfOutputs,
+        const real &rInputLowerBound, const real &rInputUpperBound, GenerationFunctionPtr generationFunctionPtr,
+        real *pInputs, real *pOutputs)
+    {
+        const size_t numberOfChunks = (end - begin + s_chunkSize - 1) / s_chunkSize;
+
+        ThreadPool::global().parallelFor(numberOfChunks, [&](size_t chunk)
+        {
+            const size_t chunkBegin = chunk * s_chunkSize;
+            const size_t chunkEnd = std::min(chunkBegin + s_chunkSize, end - begin);
+
+            RandomStream(seed).split((begin + chunkBegin) / s_chunkSize).fillUniform(pInputs + chunkBegin * numberOfInputs,
+                (chunkEnd - chunkBegin) * numberOfInputs, rInputLowerBound, rInputUpperBound);
+
+            LayerInputs aInputs(numberOfInputs);
+            LayerOutputs aOutputs(numberOfOutputs);
+            for(size_t i = chunkBegin; i < chunkEnd; ++i)
+            {
+                std::copy(pInputs + i * numberOfInputs, pInputs + (i + 1) * numberOfInputs, aInputs.begin());
+                generationFunctionPtr(aInputs, aOutputs);
+                std::copy(aOutputs.begin(), aOutputs.end(), pOutputs + i * numberOfOutputs);
+            }
+        });
+    }
+
+    Dataset generateRandomDataset(const size_t &datasetSize, const real &rInputLowerBound, const real &rInputUpperBound, const MultilayerPerceptronParameters &networkParameters, GenerationFunctionPtr generationFunctionPtr,
+        uint64_t seed)
+    {
+        if(datasetSize > 0 && rInputLowerBound < rInputUpperBound)
+        {
+            size_t numberOfInputs = networkParameters.numberOfInputs;
+            size_t numberOfOutputs = networkParameters.aLayerParameters.back().layerSize;
+
+            std::vector<real> arInputs(datasetSize * numberOfInputs);
+            std::vector<real> arOutputs(datasetSize * numberOfOutputs);
+
+            generateRandomSamples(seed, 0, datasetSize, numberOfInputs, numberOfOutputs, rInputLowerBound, rInputUpperBound,
+                generationFunctionPtr, arInputs.data(), arOutputs.data());
+
+            // The sample matrix is moved into the Dataset
+            return Dataset(numberOfInputs, numberOfOutputs, std::move(arInputs), std::move(arOutputs));
+        }
+        return Dataset();
+    }
+
+    /*
+     * Samples of generateRandomDataset (for the same seed), streamed
+     * to a binary Dataset file (see DatasetWriter) block by block,
+     * so that datasets larger than memory can be generated
+     */
+    bool writeRandomDataset(const std::string &strDatasetPath, const size_t &datasetSize, const real &rInputLowerBound, const real &rInputUpperBound, const MultilayerPerceptronParameters &networkParameters, GenerationFunctionPtr generationFunctionPtr,
+        uint64_t seed)
     {
         if(datasetSize > 0 && rInputLowerBound < rInputUpperBound)
         {
             size_t numberOfInputs = networkParameters.numberOfInputs;
             size_t numberOfOutputs = networkParameters.aLayerParameters.back().layerSize;
 
-            std::vector<std::vector<real>> aInputs(datasetSize);
-            std::vector<std::vector<real>> aOutputs(datasetSize);
+            const size_t blockSize = s_chunksPerBlock * s_chunkSize;
 
-            std::uniform_real_distribution<real> unif(rInputLowerBound, rInputUpperBound);
-            std::default_random_engine re(e_uiSeed++);
+            std::vector<real> arInputs(std::min(blockSize, datasetSize) * numberOfInputs);
+            std::vector<real> arOutputs(std::min(blockSize, datasetSize) * numberOfOutputs);
 
-            for(size_t i = 0; i < datasetSize; ++i)
+            DatasetWriter writer(strDatasetPath, numberOfInputs, numberOfOutputs);
+            for(size_t begin = 0; begin < datasetSize; begin += blockSize)
             {
-                aInputs[i].resize(numberOfInputs);
-                for(int j = 0; j < numberOfInputs; ++j)
-                {
-                    aInputs[i][j] = unif(re);
-                }
-                aOutputs[i].resize(numberOfOutputs);
-                for(int j = 0; j < numberOfOutputs; ++j)
+                const size_t end = std::min(begin + blockSize, datasetSize);
+
+                generateRandomSamples(seed, begin, end, numberOfInputs, numberOfOutputs, rInputLowerBound, rInputUpperBound,
+                    generationFunctionPtr, arInputs.data(), arOutputs.data());
+
+                if(writer.write(arInputs.data(), arOutputs.data(), end - begin) == false)
                 {
-                    generationFunctionPtr(aInputs[i], aOutputs[i]);
+                    return false;
                 }
             }
-            return Dataset(aInputs, aOutputs);
+            return writer.close();
         }
-        return Dataset();
+        return false;
     }
 
     Dataset generateSampledDataset(const size_t &datasetSize, const real &rInputLowerBound, const real &rInputUpperBound, const MultilayerPerceptronParameters &networkParameters, GenerationFunctionPtr generationFunctionPtr)
@@ -48,8 +116,8 @@ namespace DatasetGenerator
             size_t numberOfInputs = networkParameters.numberOfInputs;
             size_t numberOfOutputs = networkParameters.aLayerParameters.back().layerSize;
 
-            std::vector<std::vector<real>> aInputs(datasetSize);
-            std::vector<std::vector<real>> aOutputs(datasetSize);
+            std::vector<real> arInputs(datasetSize * numberOfInputs);
+            std::vector<real> arOutputs(datasetSize * numberOfOutputs);
 
             real rDelta = 0.0;
             real rLowerBound = rInputLowerBound;
@@ -64,22 +132,28 @@ namespace DatasetGenerator
 
             real rStep = (rUpperBound - rLowerBound) / static_cast<real>(datasetSize);
 
-            real rInputValue = rLowerBound;
-            for(size_t i = 0; i < datasetSize; ++i)
+            // Input values follow each other across the samples,
+            // the value of input j of sample i is computed directly
+            ThreadPool::global().parallelFor((datasetSize + s_chunkSize - 1) / s_chunkSize, [&](size_t chunk)
             {
-                aInputs[i].resize(numberOfInputs);
-                for(int j = 0; j < numberOfInputs; ++j)
-                {
-                    aInputs[i][j] = rInputValue + rDelta;
-                    rInputValue += rStep;
-                }
-                aOutputs[i].resize(numberOfOutputs);
-                for(int j = 0; j < numberOfOutputs; ++j)
+                const size_t end = std::min((chunk + 1) * s_chunkSize, datasetSize);
+
+                LayerInputs aInputs(numberOfInputs);
+                LayerOutputs aOutputs(numberOfOutputs);
+                for(size_t i = chunk * s_chunkSize; i < end; ++i)
                 {
-                    generationFunctionPtr(aInputs[i], aOutputs[i]);
+                    for(size_t j = 0; j < numberOfInputs; ++j)
+                    {
+                        aInputs[j] = rLowerBound + static_cast<real>(i * numberOfInputs + j) * rStep + rDelta;
+                    }
+                    generationFunctionPtr(aInputs, aOutputs);
+
+                    std::copy(aInputs.begin(), aInputs.end(), arInputs.begin() + i * numberOfInputs);
+                    std::copy(aOutputs.begin(), aOutputs.end(), arOutputs.begin() + i * numberOfOutputs);
                 }
-            }
-            return Dataset(aInputs, aOutputs);
+            });
+
+            return Dataset(numberOfInputs, numberOfOutputs, std::move(arInputs), std::move(arOutputs));
         }
         return Dataset();
     }
@@ -0,0 +1,215 @@
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#ifdef __linux__
+    #include <sys/wait.h>
+    #include <unistd.h>
+#endif
+
+#include "neural/distributed.h"
+#include "neural/multilayer_perceptron.h"
+#include "neural/trainer.h"
+#include "neural/defines.h"
+#include "datasetgenerator.h"
+
+/*
+ * Regression check: data-parallel training over forked worker
+ * processes, on TCP and Unix domain sockets, with shards of
+ * different sizes. Every worker sends its final weights back
+ * through a pipe, they must be bitwise equal.
+ */
+namespace
+{
+    const size_t s_numberOfWorkers = 3;
+    const size_t s_numberOfInputs = 8;
+
+    // 1802 training samples: shards of 600, 601 and 601
+    const size_t s_datasetSize = 2003;
+
+    size_t s_numberOfFailures = 0;
+
+    void check(bool bCondition, const std::string &strMessage)
+    {
+        if(bCondition == false)
+        {
+            std::cout << "FAILED: " << strMessage << std::endl;
+            ++s_numberOfFailures;
+        }
+    }
+
+    void regressionFunction(const LayerInputs &aInputs, LayerOutputs &aOutputs)
+    {
+        real rSum = 0.0;
+        for(size_t i = 0; i < aInputs.size(); ++i)
+        {
+            rSum += std::sin(aInputs[i] * static_cast<real>(i + 1));
+        }
+        aOutputs[0] = std::tanh(rSum / 4.0);
+    }
+
+    MultilayerPerceptronParameters networkParameters()
+    {
+        PerceptronParameters perceptronParameters = { ActivationFunctionType::HyperbolicTangent, 0.05, 0.0, 0.0 };
+        PerceptronParameters outputParameters = { ActivationFunctionType::Linear, 0.05, 0.0, 0.0 };
+
+        MultilayerPerceptronParameters multilayerPerceptronParameters;
+        multilayerPerceptronParameters.numberOfInputs = s_numberOfInputs;
+        multilayerPerceptronParameters.aLayerParameters.push_back({ 16, perceptronParameters });
+        multilayerPerceptronParameters.aLayerParameters.push_back({ 1, outputParameters });
+        multilayerPerceptronParameters.seed = 0;
+        return multilayerPerceptronParameters;
+    }
+
+#ifdef __linux__
+    // Body of a forked worker: trains its shard and writes its weights to fd
+    bool trainWorker(const DistributedParameters &distributedParameters, int fd)
+    {
+        const MultilayerPerceptronParameters multilayerPerceptronParameters = networkParameters();
+        MultilayerPerceptron multilayerPerceptron(multilayerPerceptronParameters);
+        const Dataset dataset = DatasetGenerator::generateRandomDataset(s_datasetSize, -1.0, 1.0, multilayerPerceptronParameters, &regressionFunction, 1);
+
+        TrainingParameters trainingParameters;
+        trainingParameters.iMaxIterations = 3;
+        trainingParameters.rCrossValidationEvaluationPercent = 0.9;
+        trainingParameters.eScalingMethod = ScalingMethod::None;
+        trainingParameters.batchSize = 8;
+
+        ParameterAverager parameterAverager(distributedParameters);
+        if(parameterAverager.connect() == false)
+        {
+            return false;
+        }
+
+        Trainer trainer(trainingParameters);
+        trainer.setParameterAverager(&parameterAverager);
+        trainer.train(multilayerPerceptron, dataset);
+
+        std::vector<real> arWeights(multilayerPerceptron.numberOfParameters());
+        multilayerPerceptron.exportParameters(arWeights);
+
+        const char *pBytes = reinterpret_cast<const char *>(arWeights.data());
+        size_t remaining = arWeights.size() * sizeof(real);
+        while(remaining > 0)
+        {
+            const ssize_t written = write(fd, pBytes, remaining);
+            if(written <= 0)
+            {
+                return false;
+            }
+            pBytes += written;
+            remaining -= static_cast<size_t>(written);
+        }
+        return true;
+    }
+
+    bool readAll(int fd, std::vector<real> &arWeights)
+    {
+        char *pBytes = reinterpret_cast<char *>(arWeights.data());
+        size_t remaining = arWeights.size() * sizeof(real);
+        while(remaining > 0)
+        {
+            const ssize_t bytesRead = read(fd, pBytes, remaining);
+            if(bytesRead <= 0)
+            {
+                return false;
+            }
+            pBytes += bytesRead;
+            remaining -= static_cast<size_t>(bytesRead);
+        }
+        return true;
+    }
+
+    /*
+     * Forks the workers before any thread exists in this process,
+     * the workers build their own datasets and thread pools
+     */
+    void checkTraining(const DistributedParameters &baseParameters, const std::string &strTransport)
+    {
+        const size_t numberOfParameters = MultilayerPerceptron(networkParameters()).numberOfParameters();
+
+        std::vector<pid_t> aWorkers;
+        std::vector<int> aFds;
+        for(size_t rank = 0; rank < s_numberOfWorkers; ++rank)
+        {
+            int aPipe[2];
+            if(pipe(aPipe) != 0)
+            {
+                check(false, strTransport + ": pipe");
+                break;
+            }
+
+            const pid_t pid = fork();
+            if(pid == 0)
+            {
+                close(aPipe[0]);
+                DistributedParameters distributedParameters = baseParameters;
+                distributedParameters.rank = rank;
+                _exit(trainWorker(distributedParameters, aPipe[1]) == true ? 0 : 1);
+            }
+
+            close(aPipe[1]);
+            if(pid < 0)
+            {
+                close(aPipe[0]);
+                check(false, strTransport + ": fork");
+                break;
+            }
+            aWorkers.push_back(pid);
+            aFds.push_back(aPipe[0]);
+        }
+
+        // A worker that fails closes its pipe, so that reading cannot block
+        std::vector<std::vector<real>> aarWeights(aFds.size(), std::vector<real>(numberOfParameters));
+        std::vector<bool> abRead(aFds.size());
+        for(size_t rank = 0; rank < aFds.size(); ++rank)
+        {
+            abRead[rank] = readAll(aFds[rank], aarWeights[rank]);
+            close(aFds[rank]);
+        }
+
+        for(size_t rank = 0; rank < aWorkers.size(); ++rank)
+        {
+            int iStatus = 0;
+            const bool bExited = waitpid(aWorkers[rank], &iStatus, 0) == aWorkers[rank] && WIFEXITED(iStatus) && WEXITSTATUS(iStatus) == 0;
+            check(bExited == true && abRead[rank] == true, strTransport + ": worker " + std::to_string(rank) + " trained");
+        }
+
+        check(aWorkers.size() == s_numberOfWorkers, strTransport + ": all workers started");
+        for(size_t rank = 1; rank < aarWeights.size(); ++rank)
+        {
+            check(std::memcmp(aarWeights[rank].data(), aarWeights[0].data(), numberOfParameters * sizeof(real)) == 0,
+                strTransport + ": worker " + std::to_string(rank) + " weights equal to worker 0");
+        }
+    }
+#endif
+}
+
+int main()
+{
+#ifdef __linux__
+    // Ports and socket paths of this process only, so that checks can run concurrently
+    const pid_t pid = getpid();
+
+    DistributedParameters tcpParameters;
+    tcpParameters.numberOfWorkers = s_numberOfWorkers;
+    tcpParameters.basePort = static_cast<uint16_t>(30000 + (pid % 10000) * 3);
+    tcpParameters.averagingInterval = 8;
+    checkTraining(tcpParameters, "tcp");
+
+    DistributedParameters unixParameters = tcpParameters;
+    unixParameters.eTransport = DistributedTransport::UnixDomain;
+    unixParameters.strSocketPath = "/tmp/distributed_check." + std::to_string(pid);
+    checkTraining(unixParameters, "unix");
+
+    if(s_numberOfFailures == 0)
+    {
+        std::cout << "Distributed checks passed" << std::endl;
+    }
+#endif
+
+    return s_numberOfFailures == 0 ? 0 : 1;
+}
@@ -0,0 +1,164 @@
+#include <cmath>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "neural/multilayer_perceptron.h"
+#include "neural/telemetry.h"
+#include "neural/trainer.h"
+#include "neural/defines.h"
+#include "datasetgenerator.h"
+
+/*
+ * Convergence per wall-second of the Hogwild mode against
+ * the synchronous path: the same network (same initial weights)
+ * is trained on the same samples in each mode, the validation
+ * error is recorded against the cumulated epoch time
+ */
+namespace
+{
+    const size_t s_numberOfInputs = 16;
+
+    struct BenchmarkRun
+    {
+        std::string strName;
+        TrainingMode eTrainingMode;
+        size_t batchSize;
+        size_t numberOfThreads;
+
+        // Validation error and cumulated seconds at the end of each epoch
+        std::vector<real> arErrors;
+        std::vector<real> arSeconds;
+    };
+
+    void regressionFunction(const LayerInputs &aInputs, LayerOutputs &aOutputs)
+    {
+        real rSum = 0.0;
+        for(size_t i = 0; i < aInputs.size(); ++i)
+        {
+            rSum += std::sin(aInputs[i] * static_cast<real>(i + 1));
+        }
+        aOutputs[0] = std::tanh(rSum / 4.0);
+    }
+
+    void runBenchmark(BenchmarkRun &run, const MultilayerPerceptronParameters &multilayerPerceptronParameters, const Dataset &dataset, int iEpochs)
+    {
+        MultilayerPerceptron multilayerPerceptron(multilayerPerceptronParameters);
+
+        TelemetryParameters telemetryParameters;
+        telemetryParameters.bPhaseTimers = false;
+        telemetryParameters.bGradientNorms = false;
+        Telemetry telemetry(telemetryParameters);
+        real rSeconds = 0.0;
+        telemetry.addCallback([&](const EpochMetrics &metrics)
+        {
+            rSeconds += metrics.rEpochTime;
+            run.arErrors.push_back(metrics.rValidationError);
+            run.arSeconds.push_back(rSeconds);
+        });
+
+        TrainingParameters trainingParameters;
+        trainingParameters.iMaxIterations = iEpochs - 1;
+        trainingParameters.rCrossValidationEvaluationPercent = 0.9;
+        trainingParameters.eScalingMethod = ScalingMethod::None;
+        trainingParameters.eTrainingMode = run.eTrainingMode;
+        trainingParameters.batchSize = run.batchSize;
+        trainingParameters.numberOfThreads = run.numberOfThreads;
+
+        Trainer trainer(trainingParameters);
+        trainer.setTelemetry(&telemetry);
+        trainer.train(multilayerPerceptron, dataset);
+    }
+
+    // Seconds until the validation error reaches rTarget, negative if it never does
+    real secondsToError(const BenchmarkRun &run, real rTarget)
+    {
+        for(size_t i = 0; i < run.arErrors.size(); ++i)
+        {
+            if(run.arErrors[i] <= rTarget)
+            {
+                return run.arSeconds[i];
+            }
+        }
+        return -1.0;
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    if(argc != 1 && argc != 3)
+    {
+        std::cout << "Usage: HogwildBenchmark [<dataset_size> <epochs>]" << std::endl;
+        return 1;
+    }
+
+    const size_t datasetSize = (argc == 3) ? static_cast<size_t>(atoi(argv[1])) : 40000;
+    const int iEpochs = (argc == 3) ? atoi(argv[2]) : 10;
+    if(datasetSize == 0 || iEpochs <= 0)
+    {
+        return 1;
+    }
+
+    // Momentum is left out: it scales the raw derivatives in the update rule
+    PerceptronParameters perceptronParameters = { ActivationFunctionType::HyperbolicTangent, 0.01, 0.0, 0.0 };
+    PerceptronParameters outputParameters = { ActivationFunctionType::Linear, 0.01, 0.0, 0.0 };
+
+    MultilayerPerceptronParameters multilayerPerceptronParameters;
+    multilayerPerceptronParameters.numberOfInputs = s_numberOfInputs;
+    multilayerPerceptronParameters.aLayerParameters.push_back({ 64, perceptronParameters });
+    multilayerPerceptronParameters.aLayerParameters.push_back({ 64, perceptronParameters });
+    multilayerPerceptronParameters.aLayerParameters.push_back({ 1, outputParameters });
+    multilayerPerceptronParameters.seed = 1;
+
+    const Dataset dataset = DatasetGenerator::generateRandomDataset(datasetSize, -1.0, 1.0, multilayerPerceptronParameters, &regressionFunction, 0);
+
+    std::vector<BenchmarkRun> aRuns = {
+        { "synchronous, batch 1", TrainingMode::Synchronous, 1, 0 },
+        { "synchronous, batch 16", TrainingMode::Synchronous, 16, 0 },
+        { "hogwild, 1 thread", TrainingMode::Hogwild, 1, 1 },
+        { "hogwild, 2 threads", TrainingMode::Hogwild, 1, 2 },
+        { "hogwild, 4 threads", TrainingMode::Hogwild, 1, 4 },
+        { "hogwild, 8 threads", TrainingMode::Hogwild, 1, 8 }
+    };
+
+    for(BenchmarkRun &run : aRuns)
+    {
+        runBenchmark(run, multilayerPerceptronParameters, dataset, iEpochs);
+    }
+
+    // Target: the final error of stochastic gradient descent, within 5%
+    const real rTarget = aRuns[0].arErrors.back() * 1.05;
+
+    std::cout << "Samples: " << datasetSize << ", epochs: " << iEpochs << ", hardware threads: " << std::thread::hardware_concurrency() << std::endl
+        << "Target validation error: " << rTarget << std::endl << std::endl;
+
+    std::cout << std::left << std::setw(24) << "mode" << std::right
+        << std::setw(14) << "final error" << std::setw(12) << "seconds"
+        << std::setw(16) << "samples/s" << std::setw(18) << "s to target" << std::endl;
+
+    const real rTrainingSamples = static_cast<real>(static_cast<size_t>(static_cast<real>(datasetSize) * 0.9));
+    for(const BenchmarkRun &run : aRuns)
+    {
+        const real rSeconds = run.arSeconds.back();
+        const real rSecondsToTarget = secondsToError(run, rTarget);
+
+        std::cout << std::left << std::setw(24) << run.strName << std::right
+            << std::setw(14) << run.arErrors.back() << std::setw(12) << rSeconds
+            << std::setw(16) << static_cast<size_t>(rTrainingSamples * static_cast<real>(run.arErrors.size()) / rSeconds)
+            << std::setw(18);
+        if(rSecondsToTarget >= 0.0)
+        {
+            std::cout << rSecondsToTarget;
+        }
+        else
+        {
+            std::cout << "not reached";
+        }
+        std::cout << std::endl;
+    }
+
+    return 0;
+}
@@ -0,0 +1,97 @@
+#include <cmath>
+#include <iostream>
+
+#include "neural/multilayer_perceptron.h"
+#include "neural/trainer.h"
+#include "neural/defines.h"
+#include "datasetgenerator.h"
+
+/*
+ * Regression check: Hogwild training from several threads
+ * of networks with non-dense Layers (convolution, pooling,
+ * flatten, recurrent) must neither corrupt memory nor diverge
+ */
+namespace
+{
+    const size_t s_imageSize = 6;
+    const size_t s_numberOfThreads = 8;
+
+    void meanFunction(const LayerInputs &aInputs, LayerOutputs &aOutputs)
+    {
+        real rSum = 0.0;
+        for(size_t i = 0; i < aInputs.size(); ++i)
+        {
+            rSum += aInputs[i];
+        }
+        aOutputs[0] = rSum / static_cast<real>(aInputs.size());
+    }
+
+    real trainHogwild(MultilayerPerceptron &multilayerPerceptron, const MultilayerPerceptronParameters &multilayerPerceptronParameters, uint64_t datasetSeed)
+    {
+        Dataset dataset = DatasetGenerator::generateRandomDataset(20000, -1.0, 1.0, multilayerPerceptronParameters, &meanFunction, datasetSeed);
+
+        TrainingParameters trainingParameters;
+        trainingParameters.iMaxIterations = 10;
+        trainingParameters.rCrossValidationEvaluationPercent = 0.8;
+        trainingParameters.eScalingMethod = ScalingMethod::None;
+        trainingParameters.eTrainingMode = TrainingMode::Hogwild;
+        trainingParameters.numberOfThreads = s_numberOfThreads;
+
+        Trainer trainer(trainingParameters);
+        trainer.train(multilayerPerceptron, dataset);
+
+        return trainer.error();
+    }
+}
+
+int main()
+{
+    PerceptronParameters perceptronParameters = { ActivationFunctionType::HyperbolicTangent, 0.01, 0.0, 0.0 };
+    PerceptronParameters outputParameters = { ActivationFunctionType::Linear, 0.01, 0.0, 0.0 };
+
+    MultilayerPerceptronParameters multilayerPerceptronParameters;
+    multilayerPerceptronParameters.numberOfInputs = s_imageSize * s_imageSize;
+
+    LayerParameters convolutionParameters = { 0, perceptronParameters };
+    convolutionParameters.eLayerType = LayerType::Convolution;
+    convolutionParameters.convolution.inputShape = { s_imageSize, s_imageSize, 1 };
+    convolutionParameters.convolution.outputChannels = 4;
+    convolutionParameters.convolution.padding = 1;
+    multilayerPerceptronParameters.aLayerParameters.push_back(convolutionParameters);
+
+    LayerParameters poolingParameters = { 0, perceptronParameters };
+    poolingParameters.eLayerType = LayerType::MaxPooling;
+    poolingParameters.convolution.kernelSize = 2;
+    poolingParameters.convolution.stride = 2;
+    multilayerPerceptronParameters.aLayerParameters.push_back(poolingParameters);
+
+    LayerParameters flattenParameters = { 0, perceptronParameters };
+    flattenParameters.eLayerType = LayerType::Flatten;
+    multilayerPerceptronParameters.aLayerParameters.push_back(flattenParameters);
+
+    multilayerPerceptronParameters.aLayerParameters.push_back({ 8, perceptronParameters });
+    multilayerPerceptronParameters.aLayerParameters.push_back({ 1, outputParameters });
+    multilayerPerceptronParameters.seed = 0;
+
+    MultilayerPerceptron convolutionNetwork(multilayerPerceptronParameters);
+    const real rConvolutionError = trainHogwild(convolutionNetwork, multilayerPerceptronParameters, 1);
+    std::cout << "Hogwild convolution network error: " << rConvolutionError << std::endl;
+
+    // Rows of s_imageSize timesteps of s_imageSize values
+    MultilayerPerceptronParameters recurrentParameters;
+    recurrentParameters.numberOfInputs = s_imageSize * s_imageSize;
+
+    LayerParameters recurrentLayerParameters = { 8, perceptronParameters };
+    recurrentLayerParameters.eLayerType = LayerType::Recurrent;
+    recurrentLayerParameters.recurrent.eRecurrentCell = RecurrentCell::GatedRecurrentUnit;
+    recurrentLayerParameters.recurrent.sequenceLength = s_imageSize;
+    recurrentParameters.aLayerParameters.push_back(recurrentLayerParameters);
+    recurrentParameters.aLayerParameters.push_back({ 1, outputParameters });
+    recurrentParameters.seed = 2;
+
+    MultilayerPerceptron recurrentNetwork(recurrentParameters);
+    const real rRecurrentError = trainHogwild(recurrentNetwork, recurrentParameters, 3);
+    std::cout << "Hogwild recurrent network error: " << rRecurrentError << std::endl;
+
+    return std::isfinite(rConvolutionError) == true && std::isfinite(rRecurrentError) == true ? 0 : 1;
+}
@@ -3,6 +3,7 @@
 #include "neural/multilayer_perceptron.h"
 #include "neural/trainer.h"
 #include "neural/defines.h"
+#include "neural/distributed.h"
 #include "datasetgenerator.h"
 
 /*
@@ -17,9 +18,11 @@ int main(int argc, char *argv[])
 {
     size_t datasetSize = 0;
 
-    if(argc != 2)
+    // Optional rank and number of worker processes, for data-parallel
+    // training over local TCP sockets (run one process per rank)
+    if(argc != 2 && argc != 4)
     {
-        std::cout << "Usage: Neural <dataset_size>" << std::endl;
+        std::cout << "Usage: Neural <dataset_size> [<rank> <number_of_workers>]" << std::endl;
         return 1;
     }
 
@@ -37,11 +40,12 @@ int main(int argc, char *argv[])
     multilayerPerceptronParameters.aLayerParameters.push_back({ 5, perceptronParameters });
     multilayerPerceptronParameters.aLayerParameters.push_back({ 5, perceptronParameters });
     multilayerPerceptronParameters.aLayerParameters.push_back({ 1, perceptronParameters });
+    multilayerPerceptronParameters.seed = 0;
 
     MultilayerPerceptron multilayerPerceptron(multilayerPerceptronParameters);
 
     // Init Dataset
-    Dataset dataset = DatasetGenerator::generateRandomDataset(datasetSize, -100.0, 100.0, multilayerPerceptronParameters, &regressionFunction);
+    Dataset dataset = DatasetGenerator::generateRandomDataset(datasetSize, -100.0, 100.0, multilayerPerceptronParameters, &regressionFunction, 1);
 
     // Init Trainer
     TrainingParameters trainingParameters;
@@ -50,6 +54,31 @@ int main(int argc, char *argv[])
     trainingParameters.eScalingMethod = ScalingMethod::Normalisation;
     Trainer trainer(trainingParameters, true);
 
+    DistributedParameters distributedParameters;
+    if(argc == 4)
+    {
+        distributedParameters.rank = static_cast<size_t>(atoi(argv[2]));
+        distributedParameters.numberOfWorkers = static_cast<size_t>(atoi(argv[3]));
+
+        // Checked before the ParameterAverager asserts on it
+        if(distributedParameters.numberOfWorkers == 0 || distributedParameters.rank >= distributedParameters.numberOfWorkers)
+        {
+            std::cout << "Rank " << distributedParameters.rank << " out of [0, " << distributedParameters.numberOfWorkers << ")" << std::endl;
+            return 1;
+        }
+    }
+
+    ParameterAverager parameterAverager(distributedParameters);
+    if(distributedParameters.numberOfWorkers > 1)
+    {
+        if(parameterAverager.connect() == false)
+        {
+            std::cout << "Cannot connect worker " << distributedParameters.rank << std::endl;
+            return 1;
+        }
+        trainer.setParameterAverager(&parameterAverager);
+    }
+
     // Start training
     trainer.train(multilayerPerceptron, dataset);
 
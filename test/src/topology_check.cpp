@@ -0,0 +1,151 @@
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#ifdef __linux__
+    #include <sys/stat.h>
+    #include <unistd.h>
+#endif
+
+#include "neural/multilayer_perceptron.h"
+#include "neural/replicas.h"
+#include "neural/thread_pool.h"
+#include "neural/topology.h"
+#include "neural/defines.h"
+
+/*
+ * Regression check: NUMA placement on fake topologies
+ * (fromString, NEURAL_TOPOLOGY and a fake sysfs tree),
+ * thread pinning and one replica per node
+ */
+namespace
+{
+    size_t s_numberOfFailures = 0;
+
+    void check(bool bCondition, const std::string &strMessage)
+    {
+        if(bCondition == false)
+        {
+            std::cout << "FAILED: " << strMessage << std::endl;
+            ++s_numberOfFailures;
+        }
+    }
+
+    bool sameCpus(const Topology &topology, size_t node, const std::vector<size_t> &aCpus)
+    {
+        return node < topology.numberOfNodes() && topology.cpus(node) == aCpus;
+    }
+
+    void checkFromString()
+    {
+        const Topology topology = Topology::fromString("0-1;2-3");
+        check(topology.numberOfNodes() == 2, "\"0-1;2-3\" has 2 nodes");
+        check(sameCpus(topology, 0, {0, 1}) && sameCpus(topology, 1, {2, 3}), "\"0-1;2-3\" CPUs");
+        check(topology.numberOfCpus() == 4, "\"0-1;2-3\" has 4 CPUs");
+        check(topology.nodeOfCpu(1) == 0 && topology.nodeOfCpu(2) == 1, "node of CPUs 1 and 2");
+
+        const Topology interleaved = Topology::fromString("0,2;1,3");
+        check(sameCpus(interleaved, 0, {0, 2}) && sameCpus(interleaved, 1, {1, 3}), "\"0,2;1,3\" CPUs");
+
+        // Invalid descriptions fall back to a single node
+        for(const std::string &strDescription : {"0-1;x", "3-1", "0-1;;2-3", ""})
+        {
+            check(Topology::fromString(strDescription).numberOfNodes() == 1, "\"" + strDescription + "\" falls back to one node");
+        }
+    }
+
+    void checkPinning()
+    {
+        const Topology topology = Topology::fromString("0-1;2-3");
+
+        // Threads take the CPUs of the nodes in turn: 0, 2, 1, 3 (thread 0 is the caller)
+        ThreadPool threadPool(4, topology);
+        check(threadPool.pinned() == true, "pool on a topology is pinned");
+        check(threadPool.nodeOfThread(1) == 1 && threadPool.nodeOfThread(2) == 0 && threadPool.nodeOfThread(3) == 1,
+            "threads pinned round-robin over the nodes");
+
+        PerceptronParameters perceptronParameters = { ActivationFunctionType::HyperbolicTangent, 0.01, 0.0, 0.0 };
+        MultilayerPerceptronParameters multilayerPerceptronParameters;
+        multilayerPerceptronParameters.numberOfInputs = 4;
+        multilayerPerceptronParameters.aLayerParameters.push_back({ 8, perceptronParameters });
+        multilayerPerceptronParameters.aLayerParameters.push_back({ 1, perceptronParameters });
+        multilayerPerceptronParameters.seed = 0;
+        const MultilayerPerceptron multilayerPerceptron(multilayerPerceptronParameters);
+
+        MultilayerPerceptronReplicas replicas(multilayerPerceptron, threadPool);
+        check(replicas.size() == 2, "one replica per node");
+
+        std::vector<real> arWeights(multilayerPerceptron.numberOfParameters());
+        std::vector<real> arReplicaWeights(arWeights.size());
+        multilayerPerceptron.exportParameters(arWeights);
+        for(size_t node = 0; node < replicas.size(); ++node)
+        {
+            replicas.replica(node).exportParameters(arReplicaWeights);
+            check(arReplicaWeights == arWeights, "replica " + std::to_string(node) + " holds the weights");
+        }
+        check(replicas.size() < 2 || &replicas.replica(0) != &replicas.replica(1), "replicas are distinct copies");
+    }
+
+#ifdef __linux__
+    void writeCpuList(const std::string &strDirectory, size_t node, const std::string &strCpuList)
+    {
+        const std::string strNodeDirectory = strDirectory + "/node" + std::to_string(node);
+        mkdir(strNodeDirectory.c_str(), 0700);
+        std::ofstream(strNodeDirectory + "/cpulist") << strCpuList << std::endl;
+    }
+
+    void removeCpuList(const std::string &strDirectory, size_t node)
+    {
+        const std::string strNodeDirectory = strDirectory + "/node" + std::to_string(node);
+        unlink((strNodeDirectory + "/cpulist").c_str());
+        rmdir(strNodeDirectory.c_str());
+    }
+
+    // Two sockets, the node directories are not contiguous
+    void checkSysfs()
+    {
+        char szDirectory[] = "/tmp/topology_checkXXXXXX";
+        if(mkdtemp(szDirectory) == nullptr)
+        {
+            check(false, "temporary sysfs directory");
+            return;
+        }
+        const std::string strDirectory = szDirectory;
+
+        check(Topology::fromSysfs(strDirectory).numberOfNodes() == 1, "empty sysfs directory gives one node");
+
+        writeCpuList(strDirectory, 0, "0-1,4");
+        writeCpuList(strDirectory, 2, "2-3,5");
+        const Topology topology = Topology::fromSysfs(strDirectory);
+        check(topology.numberOfNodes() == 2, "sysfs nodes 0 and 2 give 2 nodes");
+        check(sameCpus(topology, 0, {0, 1, 4}) && sameCpus(topology, 1, {2, 3, 5}), "sysfs node CPUs");
+
+        removeCpuList(strDirectory, 0);
+        removeCpuList(strDirectory, 2);
+        rmdir(szDirectory);
+    }
+#endif
+}
+
+int main()
+{
+#ifdef __linux__
+    // Before anything reads Topology::system()
+    setenv("NEURAL_TOPOLOGY", "0-1;2-3", 1);
+    check(Topology::system().numberOfNodes() == 2, "NEURAL_TOPOLOGY overrides the detection");
+
+    checkSysfs();
+#endif
+
+    checkFromString();
+    checkPinning();
+
+    if(s_numberOfFailures == 0)
+    {
+        std::cout << "Topology checks passed" << std::endl;
+    }
+
+    return s_numberOfFailures == 0 ? 0 : 1;
+}